@@ -0,0 +1,335 @@
+/*!
+ * \file bench.c
+ * \brief Mesure du débit du simulateur sur des programmes synthétiques.
+ *
+ * Chaque charge de travail est un petit programme dont le nombre
+ * d'instructions exécutées est une fonction affine connue du nombre
+ * d'itérations rangé à l'adresse 0 du segment de données : on règle ce
+ * nombre pour approcher le nombre d'instructions demandé. Chaque couple
+ * (moteur, charge) s'exécute sans trace dans un processus fils, qui mesure
+ * la durée de simul_run() et son pic de mémoire résidente, puis écrit une
+ * ligne de la forme :
+ *
+ * \verbatim
+   bench label=- engine=jit workload=arith instructions=50000004 seconds=0.061728 instr_per_s=810000000 ns_per_instr=1.234 peak_rss_kib=1904
+   \endverbatim
+ *
+ * Les champs sont toujours présents et dans cet ordre ; l'étiquette (option
+ * \c -l) permet de comparer plusieurs versions du simulateur.
+ */
+
+#define _DEFAULT_SOURCE // Pour getopt(), clock_gettime() et getrusage()
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "simulator.h"
+
+//! Taille du tableau parcouru par la charge \c sweep
+#define SWEEP_SIZE 262144
+
+//! Début du tableau parcouru par la charge \c sweep
+#define SWEEP_BASE 16
+
+//! Profondeur de récursion de la charge \c calls
+#define CALL_DEPTH 1000
+
+//! Boucle arithmétique serrée : 5 n + 4 instructions
+static Instruction arith_text[] = {
+    {.instr_absolute =  {LOAD,   false, false, 1,  0}},   // 0: R1 = itérations
+    {.instr_immediate = {LOAD,   true,  false, 2,  0}},   // 1
+    {.instr_immediate = {ADD,    true,  false, 2,  3}},   // 2: boucle
+    {.instr_immediate = {SUB,    true,  false, 2,  1}},   // 3
+    {.instr_immediate = {ADD,    true,  false, 3,  7}},   // 4
+    {.instr_immediate = {SUB,    true,  false, 1,  1}},   // 5
+    {.instr_absolute =  {BRANCH, false, false, NE, 2}},   // 6
+    {.instr_absolute =  {STORE,  false, false, 2,  1}},   // 7
+    {.instr_generic =   {HALT,                      }},   // 8
+};
+
+//! Récursion (appels et retours) : n (4 CALL_DEPTH + 3) + 2 instructions
+static Instruction calls_text[] = {
+    {.instr_absolute =  {LOAD,   false, false, 1,  0}},   // 0: R1 = itérations
+    {.instr_immediate = {LOAD,   true,  false, 0,  CALL_DEPTH}}, // 1: boucle
+    {.instr_absolute =  {CALL,   false, false, NC, 6}},   // 2
+    {.instr_immediate = {SUB,    true,  false, 1,  1}},   // 3
+    {.instr_absolute =  {BRANCH, false, false, NE, 1}},   // 4
+    {.instr_generic =   {HALT,                      }},   // 5
+    {.instr_immediate = {SUB,    true,  false, 0,  1}},   // 6: sous-programme
+    {.instr_absolute =  {BRANCH, false, false, EQ, 9}},   // 7
+    {.instr_absolute =  {CALL,   false, false, NC, 6}},   // 8
+    {.instr_generic =   {RET,                       }},   // 9
+};
+
+//! Parcours indexé d'un grand tableau : n (5 SWEEP_SIZE + 3) + 2 instructions
+static Instruction sweep_text[] = {
+    {.instr_absolute =  {LOAD,   false, false, 1,  0}},   // 0: R1 = itérations
+    {.instr_immediate = {LOAD,   true,  false, 2,  SWEEP_SIZE}}, // 1: boucle externe
+    {.instr_indexed =   {LOAD,   false, true,  3,  2, SWEEP_BASE - 1}}, // 2: boucle interne
+    {.instr_immediate = {ADD,    true,  false, 3,  1}},   // 3
+    {.instr_indexed =   {STORE,  false, true,  3,  2, SWEEP_BASE - 1}}, // 4
+    {.instr_immediate = {SUB,    true,  false, 2,  1}},   // 5
+    {.instr_absolute =  {BRANCH, false, false, NE, 2}},   // 6
+    {.instr_immediate = {SUB,    true,  false, 1,  1}},   // 7
+    {.instr_absolute =  {BRANCH, false, false, NE, 1}},   // 8
+    {.instr_generic =   {HALT,                      }},   // 9
+};
+
+//! Empilements et dépilements : 8 n + 2 instructions
+static Instruction stack_text[] = {
+    {.instr_absolute =  {LOAD,   false, false, 1,  0}},   // 0: R1 = itérations
+    {.instr_absolute =  {PUSH,   false, false, 0,  1}},   // 1: boucle
+    {.instr_immediate = {PUSH,   true,  false, 0,  5}},   // 2
+    {.instr_absolute =  {PUSH,   false, false, 0,  2}},   // 3
+    {.instr_absolute =  {POP,    false, false, 0,  3}},   // 4
+    {.instr_absolute =  {POP,    false, false, 0,  2}},   // 5
+    {.instr_absolute =  {POP,    false, false, 0,  1}},   // 6
+    {.instr_immediate = {SUB,    true,  false, 1,  1}},   // 7
+    {.instr_absolute =  {BRANCH, false, false, NE, 1}},   // 8
+    {.instr_generic =   {HALT,                      }},   // 9
+};
+
+//! Une charge de travail
+typedef struct {
+    const char *_name; //!< Nom (pour l'option \c -w et les résultats)
+    Instruction *_text; //!< Segment de texte
+    unsigned _textsize; //!< Taille du segment de texte
+    unsigned _datasize; //!< Taille du segment de données
+    unsigned _dataend; //!< Fin des données statiques
+    uint64_t _per_iteration; //!< Instructions exécutées par itération
+    uint64_t _fixed; //!< Instructions exécutées hors itérations
+} Workload;
+
+//! Segment de texte et sa taille (pour l'initialisation de \c workloads)
+#define TEXT(t) t, sizeof (t) / sizeof (Instruction)
+
+//! Les charges de travail
+static const Workload workloads[] = {
+    {"arith", TEXT(arith_text), 16, 4, 5, 4},
+    {"calls", TEXT(calls_text), 4096, 1, 4 * CALL_DEPTH + 3, 2},
+    {"sweep", TEXT(sweep_text), SWEEP_BASE + SWEEP_SIZE + 16, SWEEP_BASE + SWEEP_SIZE, 5 * SWEEP_SIZE + 3, 2},
+    {"stack", TEXT(stack_text), 64, 4, 8, 2},
+};
+
+//! Nombre de charges de travail
+static const unsigned NWORKLOADS = sizeof workloads / sizeof workloads[0];
+
+//! Message d'aide
+static void usage(void) {
+    printf("Usage: bench [options]\n"
+           "where options are:\n"
+           "\t-e engine\tRun only this engine (may be repeated; default: all)\n"
+           "\t-w workload\tRun only this workload (may be repeated; default: all)\n"
+           "\t-n count\tGuest instructions per run (default: 50000000)\n"
+           "\t-l label\tLabel printed on each result line (default: -)\n"
+           "\t-W dir\t\tWrite each workload as dir/<workload>.bin and exit\n"
+           "\t-h\t\tprint this help message\n"
+           "Workloads: arith (tight arithmetic loop), calls (recursive\n"
+           "calls and returns), sweep (indexed sweep over a 1 MiB array),\n"
+           "stack (PUSH/POP churn).\n");
+}
+
+//! Segment de données initial d'une charge
+/*!
+ * \param pwork la charge
+ * \param iterations le nombre d'itérations
+ * \return le segment (un mot de plus, nul, comme read_program())
+ */
+static Word *initial_data(const Workload *pwork, uint64_t iterations) {
+    Word *data = calloc((size_t) pwork->_datasize + 1, sizeof (Word));
+    if (data == NULL) {
+        perror("bench");
+        exit(1);
+    }
+    data[0] = iterations;
+    return data;
+}
+
+//! Nombre d'itérations pour approcher un nombre d'instructions
+static uint64_t iterations_for(const Workload *pwork, uint64_t count) {
+    uint64_t n = count > pwork->_fixed ? (count - pwork->_fixed) / pwork->_per_iteration : 0;
+    if (n == 0) {
+        n = 1;
+    }
+    return n <= UINT32_MAX ? n : UINT32_MAX;
+}
+
+//! Écriture d'une charge au format de read_program()
+static bool write_workload(const Workload *pwork, uint64_t count, const char *dir) {
+    char file[4096];
+    uint32_t header[3] = {pwork->_textsize, pwork->_datasize, pwork->_dataend};
+    Word *data = initial_data(pwork, iterations_for(pwork, count));
+
+    snprintf(file, sizeof file, "%s/%s.bin", dir, pwork->_name);
+    FILE *out = fopen(file, "w");
+    if (out == NULL) {
+        perror(file);
+        free(data);
+        return false;
+    }
+    fwrite(header, sizeof (uint32_t), 3, out);
+    fwrite(pwork->_text, sizeof (Instruction), pwork->_textsize, out);
+    fwrite(data, sizeof (Word), pwork->_datasize, out);
+    bool ok = ferror(out) == 0;
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        perror(file);
+    }
+    free(data);
+    return ok;
+}
+
+//! Mesure d'une charge avec un moteur (dans le processus fils)
+/*!
+ * \return le code de sortie du processus fils
+ */
+static int run_workload(const Workload *pwork, Engine engine, uint64_t count, const char *label) {
+    Simul_Options options = {
+        ._engine = engine,
+        ._trace = TRACE_OFF,
+        ._debug = false,
+        ._warnings = false,
+        ._profile = NULL,
+        ._history = NULL,
+        ._cache = NULL,
+        ._sampler = NULL,
+        ._tracefile = NULL,
+    };
+    uint64_t iterations = iterations_for(pwork, count);
+    uint64_t instructions = iterations * pwork->_per_iteration + pwork->_fixed;
+    Word *data = initial_data(pwork, iterations);
+    Machine *pmach = simul_create();
+    struct timespec start, end;
+    struct rusage usage;
+
+    if (pmach == NULL) {
+        perror("bench");
+        return 1;
+    }
+    simul_load_memory(pmach, pwork->_textsize, pwork->_text, pwork->_datasize, data, pwork->_dataend);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Simul_Status status = simul_run(pmach, &options);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &usage);
+    simul_destroy(pmach);
+    free(data);
+
+    if (status._err != ERR_NOERROR) {
+        fprintf(stderr, "bench: %s/%s: ", engine_names[engine], pwork->_name);
+        print_error(status._err, status._addr);
+        return 1;
+    }
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+#ifdef __APPLE__
+    long rss = usage.ru_maxrss / 1024; // En octets sous Mac OS X
+#else
+    long rss = usage.ru_maxrss;
+#endif
+    printf("bench label=%s engine=%s workload=%s instructions=%" PRIu64
+           " seconds=%.6f instr_per_s=%.0f ns_per_instr=%.3f peak_rss_kib=%ld\n",
+           label, engine_names[engine], pwork->_name, instructions, seconds,
+           seconds > 0 ? instructions / seconds : 0.0,
+           1e9 * seconds / instructions, rss);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
+//! Programme de mesure
+int main(int argc, char *argv[]) {
+    bool engines[LAST_ENGINE + 1];
+    bool selected[sizeof workloads / sizeof workloads[0]] = {false};
+    bool any_engine = false, any_workload = false;
+    uint64_t count = 50000000;
+    const char *label = "-";
+    const char *dir = NULL;
+    Engine engine;
+    int opt;
+
+    memset(engines, 0, sizeof engines);
+    while ((opt = getopt(argc, argv, "e:w:n:l:W:h")) != -1) {
+        switch (opt) {
+            case 'e':
+                if (!engine_from_name(optarg, &engine)) {
+                    fprintf(stderr, "Unknown engine: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                engines[engine] = any_engine = true;
+                break;
+            case 'w':
+            {
+                unsigned w;
+                for (w = 0; w < NWORKLOADS && strcmp(workloads[w]._name, optarg) != 0; w++) {
+                }
+                if (w == NWORKLOADS) {
+                    fprintf(stderr, "Unknown workload: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                selected[w] = any_workload = true;
+                break;
+            }
+            case 'n':
+                count = strtoull(optarg, NULL, 10);
+                if (count == 0) {
+                    fprintf(stderr, "Invalid instruction count: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'W':
+                dir = optarg;
+                break;
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    int status = EXIT_SUCCESS;
+    for (unsigned w = 0; w < NWORKLOADS; w++) {
+        if (any_workload && !selected[w]) {
+            continue;
+        }
+        if (dir != NULL) {
+            if (!write_workload(&workloads[w], count, dir)) {
+                status = EXIT_FAILURE;
+            }
+            continue;
+        }
+        for (unsigned e = 0; e <= LAST_ENGINE; e++) {
+            if (any_engine && !engines[e]) {
+                continue;
+            }
+            // Un processus par mesure : le pic de mémoire résidente est le sien
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                return EXIT_FAILURE;
+            }
+            if (pid == 0) {
+                exit(run_workload(&workloads[w], e, count, label));
+            }
+            int child;
+            while (waitpid(pid, &child, 0) < 0 && errno == EINTR) {
+            }
+            if (!WIFEXITED(child) || WEXITSTATUS(child) != 0) {
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+    return status;
+}
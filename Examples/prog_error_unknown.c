@@ -3,7 +3,7 @@
 Instruction text[] = {
 //   type		 cop	imm	ind	regcond	operand
 //-------------------------------------------------------------
-    {.instr_immediate = {test,	false,	false, 	0, 	0	}},  // 2
+    {.instr_immediate = {63,	false,	false, 	0, 	0	}},  // 63 : plus grand code opération, inexistant
 };
 
 //! Taille utile du programme
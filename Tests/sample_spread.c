@@ -0,0 +1,93 @@
+/*!
+ * \file sample_spread.c
+ * \brief Vérification de l'échantillonnage : une boucle courte n'est pas
+ * toujours relevée à la même adresse.
+ *
+ * La boucle fait 5 instructions et la période en est un multiple : avec des
+ * tranches de longueur fixe, tous les échantillons tomberaient sur la même
+ * instruction (voir sample.h). Pour chaque moteur, on exige qu'ils se
+ * répartissent sur plus d'une adresse de la boucle.
+ *
+ * Le code de retour est non nul en cas d'échec.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sample.h"
+#include "simulator.h"
+
+//! Nombre d'itérations de la boucle
+#define ITERATIONS 200000
+
+//! Période moyenne d'échantillonnage (multiple de la longueur de la boucle)
+#define PERIOD 1000
+
+//! Boucle arithmétique serrée (celle de la charge \c arith de Bench/bench.c)
+static Instruction loop_text[] = {
+    {.instr_absolute =  {LOAD,   false, false, 1,  0}},   // 0: R1 = itérations
+    {.instr_immediate = {LOAD,   true,  false, 2,  0}},   // 1
+    {.instr_immediate = {ADD,    true,  false, 2,  3}},   // 2: boucle
+    {.instr_immediate = {SUB,    true,  false, 2,  1}},   // 3
+    {.instr_immediate = {ADD,    true,  false, 3,  7}},   // 4
+    {.instr_immediate = {SUB,    true,  false, 1,  1}},   // 5
+    {.instr_absolute =  {BRANCH, false, false, NE, 2}},   // 6
+    {.instr_absolute =  {STORE,  false, false, 2,  1}},   // 7
+    {.instr_generic =   {HALT,                      }},   // 8
+};
+
+//! Nombre d'adresses distinctes relevées avec un moteur
+/*!
+ * \param engine le moteur
+ * \return le nombre d'adresses, ou 0 si l'exécution échoue
+ */
+static unsigned sampled_addresses(Engine engine) {
+    Word data[16] = {ITERATIONS};
+    Sampler_Options sampling = {._period = PERIOD, ._interval_us = 0, ._depth = 0};
+    Sampler *psamp = create_sampler(&sampling);
+    Simul_Options options = {
+        ._engine = engine,
+        ._trace = TRACE_OFF,
+        ._debug = false,
+        ._warnings = false,
+        ._profile = NULL,
+        ._history = NULL,
+        ._cache = NULL,
+        ._sampler = psamp,
+        ._tracefile = NULL,
+    };
+    Machine *pmach = simul_create();
+    if (pmach == NULL) {
+        perror("sample_spread");
+        exit(EXIT_FAILURE);
+    }
+    simul_load_memory(pmach, sizeof loop_text / sizeof loop_text[0], loop_text, 16, data, 4);
+    Simul_Status status = simul_run(pmach, &options);
+
+    bool seen[sizeof loop_text / sizeof loop_text[0]] = {false};
+    unsigned addresses = 0;
+    for (unsigned i = 0; status._err == ERR_NOERROR && i < psamp->_capacity; i++) {
+        unsigned pc = psamp->_table[i]._stack[0];
+        if (psamp->_table[i]._count != 0 && pc < sizeof seen && !seen[pc]) {
+            seen[pc] = true;
+            addresses++;
+        }
+    }
+    simul_destroy(pmach);
+    free_sampler(psamp);
+    return addresses;
+}
+
+//! Programme de vérification
+int main(void) {
+    int status = EXIT_SUCCESS;
+
+    for (Engine engine = 0; engine <= LAST_ENGINE; engine++) {
+        unsigned addresses = sampled_addresses(engine);
+        printf("sample_spread: %s: %u sampled addresses\n", engine_names[engine], addresses);
+        if (addresses < 2) {
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,393 @@
+/*!
+ * \file aot.c
+ * \brief Traducteur de programmes binaires en C (compilation anticipée).
+ *
+ * aot lit un programme au format de read_program() et écrit un fichier C
+ * autonome :
+ *
+ *   - le texte et les données initiales du programme sont recopiés dans des
+ *   tableaux chargés par load_program() ;
+ *
+ *   - chaque adresse du segment de texte devient une étiquette \c L<i>addr</i>
+ *   et chaque instruction quelques lignes de C opérant sur la Machine, avec
+ *   les contrôles de exec.c (voir aot.h) ;
+ *
+ *   - les branchements absolus deviennent des \c goto ; les branchements
+ *   calculés (\c BRANCH et \c CALL indexés, \c RET) et l'entrée dans le
+ *   programme passent par une table de saut (un \c switch sur l'adresse
+ *   cible) ;
+ *
+ *   - \c HALT affiche le même avertissement et le même état final
+ *   (print_cpu(), print_data()) que test_simul.
+ *
+ * Les instructions invalides sont confiées à decode_execute() pour produire
+ * exactement la même erreur que l'interpréteur.
+ *
+ * Le fichier produit se compile avec <tt>gcc -O2</tt> et se lie aux modules
+ * du simulateur (voir la règle \c %_aot du Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "machine.h"
+#include "decode.h"
+#include "instruction.h"
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: aot [options] binfile\n");
+    printf("where options are:\n"
+           "\t-o\tOutput file: the next argument is the name of the C file\n"
+           "\t\tto write (default: standard output)\n"
+           "\t-h\tprint this help message\n"
+           "binfile must contain a valid program in binary format (see test_simul -b).\n"
+           "The C file, compiled and linked with the simulator modules, runs the\n"
+           "program natively and prints the same final machine state.\n");
+}
+
+//! Écriture de l'adresse de données d'une instruction absolue ou indexée.
+
+/*!
+ * \param out le fichier C produit
+ * \param d la micro-opération de l'instruction
+ */
+static void emit_address(FILE *out, const Decoded *d) {
+    if (d->_flags & DECODED_INDEXED) {
+        if (d->_operand < 0) {
+            fprintf(out, "R[%u] - %d", d->_rindex, -d->_operand);
+        } else {
+            fprintf(out, "R[%u] + %d", d->_rindex, d->_operand);
+        }
+    } else {
+        fprintf(out, "%u", (unsigned) d->_operand);
+    }
+}
+
+//! Écriture du mot de données désigné par une instruction absolue ou indexée.
+
+/*!
+ * Une adresse absolue a été vérifiée au chargement (voir predecode()) : seule
+ * une adresse indexée passe par le contrôle de aot_data().
+ *
+ * \param out le fichier C produit
+ * \param d la micro-opération de l'instruction
+ * \param addr l'adresse de l'instruction
+ */
+static void emit_data(FILE *out, const Decoded *d, unsigned addr) {
+    if (d->_flags & DECODED_INDEXED) {
+        fprintf(out, "*aot_data(pmach, ");
+        emit_address(out, d);
+        fprintf(out, ", %u)", addr);
+    } else {
+        fprintf(out, "pmach->_data[%u]", (unsigned) d->_operand);
+    }
+}
+
+//! Écriture de la valeur de l'opérande source d'une instruction.
+
+/*!
+ * \param out le fichier C produit
+ * \param d la micro-opération de l'instruction
+ * \param addr l'adresse de l'instruction
+ */
+static void emit_value(FILE *out, const Decoded *d, unsigned addr) {
+    if (d->_flags & DECODED_IMMEDIATE) {
+        fprintf(out, "0x%08X", (Word) d->_operand);
+    } else {
+        emit_data(out, d, addr);
+    }
+}
+
+//! Écriture d'un branchement (\c BRANCH ou \c CALL) vers son adresse cible.
+
+/*!
+ * \param out le fichier C produit
+ * \param pmach la machine dont on traduit le programme
+ * \param d la micro-opération du branchement
+ * \param indent l'indentation
+ */
+static void emit_jump(FILE *out, const Machine *pmach, const Decoded *d, const char *indent) {
+    if (d->_flags & DECODED_INDEXED) {
+        fprintf(out, "%starget = ", indent);
+        emit_address(out, d);
+        fprintf(out, ";\n%sgoto dispatch;\n", indent);
+    } else if ((unsigned) d->_operand < pmach->_textsize) {
+        fprintf(out, "%sgoto L%u;\n", indent, (unsigned) d->_operand);
+    } else {
+        fprintf(out, "%serror(ERR_SEGTEXT, %u);\n", indent, (unsigned) d->_operand);
+    }
+}
+
+//! Écriture d'un branchement conditionnel (\c BRANCH ou \c CALL).
+
+/*!
+ * Pour \c CALL, l'adresse de retour est empilée avant le branchement.
+ *
+ * \param out le fichier C produit
+ * \param pmach la machine dont on traduit le programme
+ * \param d la micro-opération du branchement
+ * \param addr l'adresse de l'instruction
+ * \param call s'agit-il d'un appel de sous-programme ?
+ */
+static void emit_branch(FILE *out, const Machine *pmach, const Decoded *d, unsigned addr, bool call) {
+    unsigned mask = condition_masks[d->_regcond];
+    const char *indent = "    ";
+
+    if (call) {
+        fprintf(out, "    aot_check_stack(pmach, %u);\n", addr);
+    }
+    bool conditional = mask != (1u << (LAST_CC + 1)) - 1;
+    if (conditional) {
+        fprintf(out, "    if (aot_condition(0x%X, pmach->_cc)) {\n", mask);
+        indent = "        ";
+    }
+    if (call) {
+        fprintf(out, "%spmach->_data[R[15]--] = %u;\n", indent, addr + 1);
+    }
+    emit_jump(out, pmach, d, indent);
+    if (conditional) {
+        fprintf(out, "    }\n");
+    }
+}
+
+//! Traduction d'une instruction.
+
+/*!
+ * \param out le fichier C produit
+ * \param pmach la machine dont on traduit le programme
+ * \param addr l'adresse de l'instruction
+ */
+static void emit_instruction(FILE *out, const Machine *pmach, unsigned addr) {
+    const Decoded *d = &pmach->_decoded[addr];
+    Instruction instr = pmach->_text[addr];
+    unsigned r = d->_regcond;
+
+    fprintf(out, "L%u: // 0x%08X %s\n", addr, instr._raw,
+            instr.instr_generic._cop <= LAST_COP ? cop_names[instr.instr_generic._cop] : "?");
+    switch (d->_handler) {
+        case UOP_NOP:
+            fprintf(out, "    ;\n");
+            break;
+        case UOP_LOAD_I:
+        case UOP_LOAD_A:
+        case UOP_LOAD_X:
+        case UOP_LOAD_G:
+            fprintf(out, "    R[%u] = ", r);
+            emit_value(out, d, addr);
+            fprintf(out, ";\n    pmach->_cc = cc_of(R[%u]);\n", r);
+            break;
+        case UOP_STORE_A:
+        case UOP_STORE_X:
+        case UOP_STORE_G:
+            fprintf(out, "    ");
+            emit_data(out, d, addr);
+            fprintf(out, " = R[%u];\n", r);
+            break;
+        case UOP_ADD_I:
+        case UOP_ADD_A:
+        case UOP_ADD_X:
+        case UOP_ADD_G:
+            fprintf(out, "    R[%u] += ", r);
+            emit_value(out, d, addr);
+            fprintf(out, ";\n    pmach->_cc = cc_of(R[%u]);\n", r);
+            break;
+        case UOP_SUB_I:
+        case UOP_SUB_A:
+        case UOP_SUB_X:
+        case UOP_SUB_G:
+            fprintf(out, "    R[%u] -= ", r);
+            emit_value(out, d, addr);
+            fprintf(out, ";\n    pmach->_cc = cc_of(R[%u]);\n", r);
+            break;
+        case UOP_BRANCH_A:
+        case UOP_BRANCH_X:
+            emit_branch(out, pmach, d, addr, false);
+            break;
+        case UOP_CALL_A:
+        case UOP_CALL_X:
+            emit_branch(out, pmach, d, addr, true);
+            break;
+        case UOP_RET:
+            fprintf(out, "    ++R[15];\n");
+            fprintf(out, "    aot_check_stack(pmach, %u);\n", addr);
+            fprintf(out, "    target = pmach->_data[R[15]];\n");
+            fprintf(out, "    goto dispatch;\n");
+            break;
+        case UOP_PUSH_I:
+        case UOP_PUSH_A:
+        case UOP_PUSH_X:
+        case UOP_PUSH_G:
+            fprintf(out, "    aot_check_stack(pmach, %u);\n", addr);
+            fprintf(out, "    {\n        Word value = ");
+            emit_value(out, d, addr);
+            fprintf(out, ";\n        pmach->_data[R[15]--] = value;\n    }\n");
+            break;
+        case UOP_POP_A:
+        case UOP_POP_X:
+            fprintf(out, "    {\n        Word *pword = &");
+            emit_data(out, d, addr);
+            fprintf(out, ";\n");
+            fprintf(out, "        ++R[15];\n");
+            fprintf(out, "        aot_check_stack(pmach, %u);\n", addr);
+            fprintf(out, "        *pword = pmach->_data[R[15]];\n    }\n");
+            break;
+        case UOP_XADD_A:
+        case UOP_XADD_X:
+        case UOP_XCHG_A:
+        case UOP_XCHG_X:
+            fprintf(out, "    R[%u] = %s(&", r,
+                    d->_handler == UOP_XADD_A || d->_handler == UOP_XADD_X ? "fetch_add_word" : "exchange_word");
+            emit_data(out, d, addr);
+            fprintf(out, ", R[%u]);\n    pmach->_cc = cc_of(R[%u]);\n", r, r);
+            break;
+        case UOP_BARRIER:
+            fprintf(out, "    ; // Machine seule : aucun autre cœur à attendre\n");
+            break;
+        case UOP_HALT:
+            fprintf(out, "    pmach->_pc = %u;\n", addr + 1);
+            fprintf(out, "    warning(WARN_HALT, %u);\n", addr);
+            fprintf(out, "    goto halt;\n");
+            break;
+        default:
+            // Instruction invalide : même erreur que l'interpréteur
+            fprintf(out, "    pmach->_pc = %u;\n", addr + 1);
+            fprintf(out, "    decode_execute(pmach, text[%u]);\n", addr);
+            break;
+    }
+}
+
+//! Traduction du programme complet.
+
+/*!
+ * \param out le fichier C produit
+ * \param pmach la machine dont on traduit le programme
+ * \param programfile le nom du fichier binaire (pour mémoire)
+ */
+static void translate(FILE *out, const Machine *pmach, const char *programfile) {
+    bool halt = false;
+
+    for (unsigned addr = 0; addr < pmach->_textsize; addr++) {
+        halt = halt || pmach->_decoded[addr]._handler == UOP_HALT;
+    }
+
+    fprintf(out, "/*\n * Traduction de %s par aot : ne pas modifier.\n */\n\n", programfile);
+    fprintf(out, "#include <stdio.h>\n\n#include \"aot.h\"\n\n");
+
+    fprintf(out, "static Instruction text[%u] = {", pmach->_textsize > 0 ? pmach->_textsize : 1);
+    for (unsigned i = 0; i < pmach->_textsize; i++) {
+        fprintf(out, "%s{0x%08X},", i % 4 == 0 ? "\n    " : " ", pmach->_text[i]._raw);
+    }
+    fprintf(out, "\n};\n\n");
+    // Un mot de plus : check_seg_data() autorise l'adresse datasize
+    fprintf(out, "static Word data[%u] = {", pmach->_datasize + 1);
+    for (unsigned i = 0; i < pmach->_datasize; i++) {
+        fprintf(out, "%s0x%08X,", i % 4 == 0 ? "\n    " : " ", pmach->_data[i]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "int main(void) {\n");
+    fprintf(out, "    Machine mach;\n    Machine *pmach = &mach;\n");
+    fprintf(out, "    Word *const R = mach._registers;\n");
+    fprintf(out, "    unsigned target;\n");
+    fprintf(out, "    (void) R;\n");
+    fprintf(out, "\n    load_program(pmach, %u, text, %u, data, %u);\n",
+            pmach->_textsize, pmach->_datasize, pmach->_dataend);
+    fprintf(out, "    target = pmach->_pc;\n    goto dispatch;\n\n");
+
+    for (unsigned addr = 0; addr < pmach->_textsize; addr++) {
+        emit_instruction(out, pmach, addr);
+    }
+    fprintf(out, "    error(ERR_SEGTEXT, %u);\n", pmach->_textsize);
+
+    // Table de saut : point d'entrée et branchements calculés
+    fprintf(out, "\ndispatch:\n    switch (target) {\n");
+    for (unsigned addr = 0; addr < pmach->_textsize; addr++) {
+        fprintf(out, "        case %u: goto L%u;\n", addr, addr);
+    }
+    fprintf(out, "        default: error(ERR_SEGTEXT, target);\n    }\n");
+
+    if (halt) {
+        fprintf(out, "\nhalt:\n");
+        fprintf(out, "    printf(\"\\n*** Machine state after execution ***\\n\");\n");
+        fprintf(out, "    print_cpu(pmach);\n    print_data(pmach);\n");
+        fprintf(out, "    unload_program(pmach);\n    return 0;\n");
+    }
+    fprintf(out, "}\n");
+}
+
+//! Programme de traduction
+/*!
+ * Options de la ligne de commande :
+ *
+ * <dl>
+ *   <dt>-o</dt><dd>nom du fichier C à produire (par défaut, la sortie
+ *   standard).</dd>
+ * </dl>
+ *
+ * Le dernier argument est le nom du fichier binaire à traduire.
+ */
+int main(int argc, char *argv[])
+{
+    char *programfile = NULL;
+    char *outfile = NULL;
+
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        if (argv[iarg][0] == '-')
+            switch (argv[iarg][1])
+            {
+            case 'o':
+                if (++iarg >= argc)
+                {
+                    fprintf(stderr, "Missing file name for option -o\n");
+                    usage();
+                    exit(EXIT_FAILURE);
+                }
+                outfile = argv[iarg];
+                break;
+            case 'h':
+                usage();
+                exit(EXIT_SUCCESS);
+            default:
+                fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        else if (programfile == NULL)
+            programfile = argv[iarg];
+        else
+            fprintf(stderr, "Trailing options ignored...\n");
+    }
+    if (programfile == NULL)
+    {
+        fprintf(stderr, "Missing binary file\n");
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    Machine mach;
+    read_program(&mach, programfile);
+
+    FILE *out = stdout;
+    if (outfile != NULL && (out = fopen(outfile, "w")) == NULL)
+    {
+        perror(outfile);
+        exit(EXIT_FAILURE);
+    }
+    translate(out, &mach, programfile);
+    if (ferror(out) != 0 || (out != stdout && fclose(out) != 0))
+    {
+        perror(outfile != NULL ? outfile : "aot");
+        exit(EXIT_FAILURE);
+    }
+
+    unload_program(&mach);
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef _AOT_H_
+#define _AOT_H_
+
+/*!
+ * \file aot.h
+ * \brief Support d'exécution des programmes traduits en C par aot.
+ *
+ * Le traducteur aot (voir aot.c) produit, pour un programme au format de
+ * read_program(), un fichier C où chaque adresse du segment de texte devient
+ * une étiquette et chaque instruction quelques lignes de C opérant sur une
+ * Machine. Ce fichier inclut le présent en-tête, qui fournit les contrôles
+ * de exec.c sous forme de fonctions en ligne : une fois le fichier compilé
+ * (avec <tt>gcc -O2</tt>) et lié aux modules du simulateur, on obtient un
+ * exécutable natif qui signale les mêmes erreurs aux mêmes adresses et
+ * affiche le même état final que l'interpréteur.
+ */
+
+#include "machine.h"
+#include "exec.h"
+#include "error.h"
+
+//! Accès à un mot du segment de données (comme check_seg_data())
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param addr l'adresse du mot dans le segment de données
+ * \param iaddr l'adresse de l'instruction en cours (pour l'erreur)
+ * \return l'adresse du mot
+ */
+static inline Word *aot_data(Machine *pmach, unsigned addr, unsigned iaddr) {
+    if (addr > pmach->_datasize) {
+        error(ERR_SEGDATA, iaddr);
+    }
+    return &pmach->_data[addr];
+}
+
+//! Contrôle du pointeur de pile (comme check_stack())
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param iaddr l'adresse de l'instruction en cours (pour l'erreur)
+ */
+static inline void aot_check_stack(Machine *pmach, unsigned iaddr) {
+    if (pmach->_sp < pmach->_dataend || pmach->_sp >= pmach->_datasize) {
+        error(ERR_SEGSTACK, iaddr);
+    }
+}
+
+//! Test d'une condition de branchement
+/*!
+ * \param mask les codes condition pour lesquels la condition est vraie (voir
+ * \c condition_masks)
+ * \param cc le code condition courant
+ */
+static inline bool aot_condition(unsigned mask, Condition_Code cc) {
+    return (mask >> cc) & 1;
+}
+
+#endif
@@ -0,0 +1,424 @@
+/*!
+ * \file batch.c
+ * \brief Exécution d'un lot de programmes par un groupe de threads.
+ */
+
+#define _DEFAULT_SOURCE // Pour scandir(), alphasort() et clock_gettime()
+
+#include "batch.h"
+#include "lanes.h"
+#include "simulator.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+//! Issue de l'exécution d'un programme
+typedef enum {
+    JOB_HALT, //!< Fin normale sur \c HALT
+    JOB_ERROR, //!< Erreur d'exécution
+    JOB_UNREADABLE, //!< Fichier illisible
+} Job_Status;
+
+//! Un programme du lot et son résultat
+typedef struct {
+    char *_file; //!< Nom du fichier binaire
+    Job_Status _status; //!< Issue de l'exécution
+    Error _err; //!< Erreur (si \c JOB_ERROR)
+    unsigned _addr; //!< Adresse du \c HALT ou de l'erreur
+    int _errno; //!< Cause de l'échec de lecture (si \c JOB_UNREADABLE)
+    unsigned _pc; //!< Compteur ordinal final
+    Condition_Code _cc; //!< Code condition final
+    Word _registers[NREGISTERS]; //!< Registres finaux
+    unsigned _datasize; //!< Taille du segment de données
+    Word *_data; //!< Copie du segment de données final
+    Machine *_mach; //!< Machine chargée en attente de son exécution en voies, ou NULL
+} Job;
+
+//! Lot en cours d'exécution, partagé par les threads
+typedef struct {
+    Job *_jobs; //!< Les programmes
+    unsigned _njobs; //!< Nombre de programmes
+    unsigned _next; //!< Prochain programme à exécuter
+    pthread_mutex_t _lock; //!< Protection de \c _next
+    Engine _engine; //!< Moteur d'exécution
+    unsigned _lanes; //!< Programmes par exécution en voies (0 : un par un)
+    unsigned *_order; //!< Programmes lisibles, regroupés par segment de texte
+    unsigned *_runs; //!< Début de chaque exécution en voies dans \c _order (plus la fin)
+    unsigned _nruns; //!< Nombre d'exécutions en voies
+} Batch;
+
+//! Forme imprimable du code condition
+static const char cc_letters[] = "UZPN";
+
+//! Ajout d'un programme au lot.
+
+/*!
+ * \param pjobs le tableau des programmes (réalloué si besoin)
+ * \param pnjobs le nombre de programmes
+ * \param file le nom du fichier (recopié)
+ */
+static void add_job(Job **pjobs, unsigned *pnjobs, const char *file) {
+    unsigned n = *pnjobs;
+    if (n == 0 || (n >= 16 && (n & (n - 1)) == 0)) { // Tableau plein : on double
+        *pjobs = realloc(*pjobs, sizeof (Job) * (n > 0 ? 2 * n : 16));
+    }
+    char *copy = malloc(strlen(file) + 1);
+    if (*pjobs == NULL || copy == NULL) {
+        perror("batch");
+        exit(1);
+    }
+    strcpy(copy, file);
+    memset(&(*pjobs)[*pnjobs], 0, sizeof (Job));
+    (*pjobs)[(*pnjobs)++]._file = copy;
+}
+
+//! Sélection des fichiers \c .bin d'un répertoire (voir scandir())
+static int is_bin(const struct dirent *entry) {
+    size_t len = strlen(entry->d_name);
+    return len > 4 && strcmp(entry->d_name + len - 4, ".bin") == 0;
+}
+
+//! Liste des programmes du lot.
+
+/*!
+ * \param input la liste des programmes ou un répertoire
+ * \param pjobs les programmes (alloués dynamiquement)
+ * \param pnjobs le nombre de programmes
+ * \return faux si la liste ou le répertoire sont illisibles
+ */
+static bool list_jobs(const char *input, Job **pjobs, unsigned *pnjobs) {
+    struct stat st;
+    char line[4096];
+
+    *pjobs = NULL;
+    *pnjobs = 0;
+    if (stat(input, &st) != 0) {
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        struct dirent **entries;
+        int n = scandir(input, &entries, is_bin, alphasort);
+        if (n < 0) {
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            snprintf(line, sizeof line, "%s/%s", input, entries[i]->d_name);
+            add_job(pjobs, pnjobs, line);
+            free(entries[i]);
+        }
+        free(entries);
+        return true;
+    }
+
+    FILE *manifest = fopen(input, "r");
+    if (manifest == NULL) {
+        return false;
+    }
+    while (fgets(line, sizeof line, manifest) != NULL) {
+        size_t len = strcspn(line, "\r\n");
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) {
+            len--;
+        }
+        line[len] = '\0';
+        if (len > 0 && line[0] != '#') {
+            add_job(pjobs, pnjobs, line);
+        }
+    }
+    bool ok = ferror(manifest) == 0;
+    fclose(manifest);
+    return ok;
+}
+
+//! Relevé de l'état final d'un programme exécuté.
+
+/*!
+ * \param pjob le programme
+ * \param pmach sa machine
+ * \param status l'issue de son exécution
+ */
+static void record_job(Job *pjob, const Machine *pmach, Simul_Status status) {
+    pjob->_status = status._err == ERR_NOERROR ? JOB_HALT : JOB_ERROR;
+    pjob->_err = status._err;
+    pjob->_addr = status._addr;
+
+    pjob->_pc = pmach->_pc;
+    pjob->_cc = current_cc(pmach);
+    memcpy(pjob->_registers, pmach->_registers, sizeof pjob->_registers);
+    pjob->_datasize = pmach->_datasize;
+    pjob->_data = malloc(sizeof (Word) * (pmach->_datasize > 0 ? pmach->_datasize : 1));
+    if (pjob->_data == NULL) {
+        perror("batch");
+        exit(1);
+    }
+    memcpy(pjob->_data, pmach->_data, sizeof (Word) * pmach->_datasize);
+}
+
+//! Exécution d'un programme du lot et relevé de son état final.
+
+/*!
+ * \param pjob le programme
+ * \param engine le moteur d'exécution
+ */
+static void run_job(Job *pjob, Engine engine) {
+    Simul_Options options = {
+        ._engine = engine,
+        ._trace = TRACE_OFF,
+        ._debug = false,
+        ._warnings = false,
+        ._profile = NULL,
+        ._history = NULL,
+        ._cache = NULL,
+        ._sampler = NULL,
+        ._tracefile = NULL,
+    };
+    Machine *pmach = simul_create();
+
+    if (pmach == NULL) {
+        perror("batch");
+        exit(1);
+    }
+    if (!simul_load(pmach, pjob->_file)) {
+        pjob->_status = JOB_UNREADABLE;
+        pjob->_errno = errno;
+        simul_destroy(pmach);
+        return;
+    }
+    Simul_Status status = simul_run(pmach, &options);
+    record_job(pjob, pmach, status);
+    simul_destroy(pmach);
+}
+
+//! Chargement des programmes et regroupement par segment de texte (exécution en voies).
+
+/*!
+ * Les programmes d'un même groupe gardent l'ordre de la liste et sont
+ * découpés en exécutions de \c _lanes programmes au plus ; les programmes
+ * illisibles ne font partie d'aucune exécution.
+ *
+ * \param pbatch le lot
+ */
+static void group_jobs(Batch *pbatch) {
+    unsigned n = pbatch->_njobs > 0 ? pbatch->_njobs : 1;
+    unsigned *group = malloc(sizeof (unsigned) * n);
+    unsigned *leader = malloc(sizeof (unsigned) * n);
+    unsigned *start = calloc(n + 1, sizeof (unsigned));
+    pbatch->_order = malloc(sizeof (unsigned) * n);
+    pbatch->_runs = malloc(sizeof (unsigned) * (n + 1));
+    if (group == NULL || leader == NULL || start == NULL
+            || pbatch->_order == NULL || pbatch->_runs == NULL) {
+        perror("batch");
+        exit(1);
+    }
+
+    unsigned ngroups = 0;
+    for (unsigned i = 0; i < pbatch->_njobs; i++) {
+        Job *pjob = &pbatch->_jobs[i];
+        if ((pjob->_mach = simul_create()) == NULL) {
+            perror("batch");
+            exit(1);
+        }
+        if (!simul_load(pjob->_mach, pjob->_file)) {
+            pjob->_status = JOB_UNREADABLE;
+            pjob->_errno = errno;
+            simul_destroy(pjob->_mach);
+            pjob->_mach = NULL;
+            continue;
+        }
+        unsigned k = 0;
+        while (k < ngroups && !lanes_compatible(pbatch->_jobs[leader[k]]._mach, pjob->_mach)) {
+            k++;
+        }
+        if (k == ngroups) {
+            leader[ngroups++] = i;
+        }
+        group[i] = k;
+        start[k + 1]++;
+    }
+
+    // Début de chaque groupe dans _order, puis les programmes à leur place
+    for (unsigned k = 0; k < ngroups; k++) {
+        start[k + 1] += start[k];
+    }
+    unsigned nrun = 0;
+    for (unsigned k = 0; k < ngroups; k++) {
+        for (unsigned j = start[k]; j < start[k + 1]; j += pbatch->_lanes) {
+            pbatch->_runs[nrun++] = j;
+        }
+    }
+    pbatch->_runs[nrun] = start[ngroups];
+    pbatch->_nruns = nrun;
+    for (unsigned i = 0; i < pbatch->_njobs; i++) {
+        if (pbatch->_jobs[i]._mach != NULL) {
+            pbatch->_order[start[group[i]]++] = i;
+        }
+    }
+    free(group);
+    free(leader);
+    free(start);
+}
+
+//! Exécution en voies parallèles d'un groupe de programmes et relevé de leur état final.
+
+/*!
+ * \param pbatch le lot
+ * \param run le numéro de l'exécution (voir group_jobs())
+ */
+static void run_lane_jobs(Batch *pbatch, unsigned run) {
+    unsigned first = pbatch->_runs[run];
+    unsigned n = pbatch->_runs[run + 1] - first;
+    Machine **machines = malloc(sizeof (Machine *) * n);
+    Simul_Status *status = malloc(sizeof (Simul_Status) * n);
+    if (machines == NULL || status == NULL) {
+        perror("batch");
+        exit(1);
+    }
+    for (unsigned j = 0; j < n; j++) {
+        machines[j] = pbatch->_jobs[pbatch->_order[first + j]]._mach;
+    }
+    run_lanes(n, machines, pbatch->_engine, status);
+    for (unsigned j = 0; j < n; j++) {
+        Job *pjob = &pbatch->_jobs[pbatch->_order[first + j]];
+        record_job(pjob, machines[j], status[j]);
+        simul_destroy(machines[j]);
+        pjob->_mach = NULL;
+    }
+    free(machines);
+    free(status);
+}
+
+//! Thread d'exécution : prend les programmes du lot un par un (ou les exécutions en voies)
+static void *worker(void *arg) {
+    Batch *pbatch = arg;
+    for (;;) {
+        pthread_mutex_lock(&pbatch->_lock);
+        unsigned i = pbatch->_next++;
+        pthread_mutex_unlock(&pbatch->_lock);
+        if (i >= (pbatch->_lanes > 0 ? pbatch->_nruns : pbatch->_njobs)) {
+            return NULL;
+        }
+        if (pbatch->_lanes > 0) {
+            run_lane_jobs(pbatch, i);
+        } else {
+            run_job(&pbatch->_jobs[i], pbatch->_engine);
+        }
+    }
+}
+
+//! Écriture du résultat d'un programme.
+
+/*!
+ * \param out le fichier des résultats
+ * \param pjob le programme exécuté
+ */
+static void write_job(FILE *out, const Job *pjob) {
+    fprintf(out, "program %s\n", pjob->_file);
+    switch (pjob->_status) {
+        case JOB_UNREADABLE:
+            fprintf(out, "status unreadable %s\n\n", strerror(pjob->_errno));
+            return;
+        case JOB_HALT:
+            fprintf(out, "status halt 0x%04X\n", pjob->_addr);
+            break;
+        case JOB_ERROR:
+            fprintf(out, "status error %s 0x%04X\n",
+                    pjob->_err <= LAST_ERROR ? error_names[pjob->_err] : "?", pjob->_addr);
+            break;
+    }
+    fprintf(out, "cpu pc=0x%04X cc=%c", pjob->_pc,
+            pjob->_cc <= LAST_CC ? cc_letters[pjob->_cc] : '?');
+    for (unsigned r = 0; r < NREGISTERS; r++) {
+        fprintf(out, " R%02u=0x%08X", r, pjob->_registers[r]);
+    }
+    fprintf(out, "\ndata %u", pjob->_datasize);
+    for (unsigned i = 0; i < pjob->_datasize; i++) {
+        fprintf(out, " %08X", pjob->_data[i]);
+    }
+    fprintf(out, "\n\n");
+}
+
+bool run_batch(const Batch_Options *options) {
+    Batch batch = {._next = 0, ._engine = options->_engine, ._lanes = options->_lanes};
+    struct timespec start, end;
+
+    if (!list_jobs(options->_input, &batch._jobs, &batch._njobs)) {
+        perror(options->_input);
+        return false;
+    }
+    FILE *out = stdout;
+    if (options->_output != NULL && (out = fopen(options->_output, "w")) == NULL) {
+        perror(options->_output);
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (batch._lanes > 0) {
+        group_jobs(&batch);
+    }
+
+    unsigned nthreads = options->_threads;
+    unsigned nwork = batch._lanes > 0 ? batch._nruns : batch._njobs;
+    if (nthreads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = n > 0 ? n : 1;
+    }
+    if (nthreads > nwork) {
+        nthreads = nwork > 0 ? nwork : 1;
+    }
+
+    pthread_mutex_init(&batch._lock, NULL);
+    pthread_t *threads = malloc(sizeof (pthread_t) * nthreads);
+    if (threads == NULL) {
+        perror("batch");
+        exit(1);
+    }
+    for (unsigned t = 0; t < nthreads; t++) {
+        int err = pthread_create(&threads[t], NULL, worker, &batch);
+        if (err != 0) {
+            fprintf(stderr, "batch: %s\n", strerror(err));
+            exit(1);
+        }
+    }
+    for (unsigned t = 0; t < nthreads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&batch._lock);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    unsigned count[JOB_UNREADABLE + 1] = {0};
+    for (unsigned i = 0; i < batch._njobs; i++) {
+        Job *pjob = &batch._jobs[i];
+        write_job(out, pjob);
+        count[pjob->_status]++;
+        free(pjob->_file);
+        free(pjob->_data);
+    }
+    free(batch._jobs);
+    free(batch._order);
+    free(batch._runs);
+    bool ok = ferror(out) == 0;
+    if (out != stdout) {
+        ok = fclose(out) == 0 && ok;
+    }
+    if (!ok) {
+        perror(options->_output != NULL ? options->_output : "batch");
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "batch: %u programs (%u halted, %u errors, %u unreadable)"
+            " in %.3f s with %u threads",
+            batch._njobs, count[JOB_HALT], count[JOB_ERROR], count[JOB_UNREADABLE],
+            seconds, nthreads);
+    if (batch._lanes > 0) {
+        fprintf(stderr, " and %u runs of up to %u lanes", batch._nruns, batch._lanes);
+    }
+    fprintf(stderr, ": %.1f programs/s\n", seconds > 0 ? batch._njobs / seconds : 0.0);
+    return ok;
+}
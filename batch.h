@@ -0,0 +1,61 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+/*!
+ * \file batch.h
+ * \brief Exécution d'un lot de programmes par un groupe de threads.
+ */
+
+#include <stdbool.h>
+
+#include "engine.h"
+
+//! Options d'exécution d'un lot
+typedef struct {
+    const char *_input; //!< Liste des programmes (un nom de fichier par ligne) ou répertoire
+    const char *_output; //!< Fichier des résultats (NULL : sortie standard)
+    unsigned _threads; //!< Nombre de threads (0 : un par processeur)
+    Engine _engine; //!< Moteur d'exécution
+    unsigned _lanes; //!< Programmes par exécution en voies parallèles (0 : un par un, voir lanes.h)
+} Batch_Options;
+
+//! Exécution d'un lot de programmes
+/*!
+ * Les programmes (fichiers binaires au format de read_program()) sont soit
+ * listés dans le fichier \c _input, un par ligne (les lignes vides et celles
+ * qui commencent par \c # sont ignorées), soit les fichiers \c .bin du
+ * répertoire \c _input, par ordre alphabétique.
+ *
+ * Chaque thread prend le programme suivant de la liste et l'exécute sans
+ * trace ni mise au point, sur sa propre Machine ; les erreurs du programme
+ * simulé sont récupérées (voir simul_run()) au lieu de terminer le
+ * simulateur. Une fois tous les programmes exécutés, on écrit pour chacun,
+ * dans l'ordre de la liste, un bloc de la forme :
+ *
+ * \verbatim
+   program Examples/prog_simple.bin
+   status halt 0x0008
+   cpu pc=0x0009 cc=Z R00=0x00000000 ... R15=0x00000013
+   data 20 00000000 00000014 ...
+   \endverbatim
+ *
+ * Le statut est \c halt, \c error suivi du nom de l'erreur (\c segdata,
+ * \c segstack...), ou \c unreadable si le fichier n'a pas pu être lu ; il
+ * est suivi de l'adresse de l'instruction concernée. Un résumé (nombre de
+ * programmes, durée, programmes par seconde) est écrit sur la sortie
+ * d'erreur.
+ *
+ * Avec \c _lanes, les programmes qui ont le même segment de texte (voir
+ * lanes_compatible()) sont regroupés, par \c _lanes au plus, et chaque
+ * thread exécute un groupe à la fois en voies parallèles (voir run_lanes()) ;
+ * les résultats sont les mêmes.
+ *
+ * \note Un programme qui ne s'arrête jamais bloque son thread, donc le lot.
+ *
+ * \param options les options du lot
+ * \return faux si la liste des programmes ou le fichier des résultats sont
+ * inaccessibles
+ */
+bool run_batch(const Batch_Options *options);
+
+#endif
@@ -0,0 +1,299 @@
+/*!
+ * \file cache.c
+ * \brief Modèle de hiérarchie de caches pour les accès au segment de données.
+ */
+
+#include "cache.h"
+#include "decode.h"
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const Cache_Config default_cache_config = {
+    ._nlevels = 2,
+    ._levels = {
+        {._size = 256, ._ways = 4, ._line = 8, ._latency = 1},
+        {._size = 4096, ._ways = 8, ._line = 8, ._latency = 10},
+    },
+    ._memory_latency = 100,
+};
+
+//! Lecture d'un entier non nul suivi de \c sep
+/*!
+ * \param pspec le texte à lire, avancé après le séparateur
+ * \param sep le séparateur attendu (\c '\0' : fin du texte)
+ * \param pvalue l'entier lu
+ * \return faux si le texte n'a pas cette forme
+ */
+static bool parse_field(const char **pspec, char sep, unsigned *pvalue) {
+    char *end;
+    unsigned long value = strtoul(*pspec, &end, 0);
+    if (end == *pspec || *end != sep || value == 0 || value >= UINT_MAX) {
+        return false;
+    }
+    *pvalue = value;
+    *pspec = *end != '\0' ? end + 1 : end;
+    return true;
+}
+
+bool cache_config_from_string(const char *spec, Cache_Config *pconfig) {
+    if (strcmp(spec, "default") == 0) {
+        *pconfig = default_cache_config;
+        return true;
+    }
+    // Autant de niveaux que de groupes de quatre champs, puis la latence mémoire
+    unsigned nfields = 1;
+    for (const char *p = spec; *p != '\0'; p++) {
+        nfields += *p == ',';
+    }
+    pconfig->_nlevels = nfields - 1;
+    if (pconfig->_nlevels == 0 || pconfig->_nlevels > CACHE_MAX_LEVELS) {
+        return false;
+    }
+    for (unsigned l = 0; l < pconfig->_nlevels; l++) {
+        Cache_Level_Config *plevel = &pconfig->_levels[l];
+        if (!parse_field(&spec, ':', &plevel->_size)
+                || !parse_field(&spec, ':', &plevel->_ways)
+                || !parse_field(&spec, ':', &plevel->_line)
+                || !parse_field(&spec, ',', &plevel->_latency)
+                || plevel->_size / plevel->_ways < plevel->_line
+                || plevel->_size % ((uint64_t) plevel->_ways * plevel->_line) != 0) {
+            return false;
+        }
+    }
+    return parse_field(&spec, '\0', &pconfig->_memory_latency);
+}
+
+Cache_Model *create_cache_model(const Cache_Config *pconfig, unsigned textsize) {
+    Cache_Model *pcache = calloc(1, sizeof (Cache_Model));
+    if (pcache == NULL
+            || (pcache->_stats = calloc(textsize > 0 ? textsize : 1, sizeof (Cache_Stats))) == NULL) {
+        perror("create_cache_model");
+        exit(1);
+    }
+    pcache->_nlevels = pconfig->_nlevels;
+    pcache->_memory_latency = pconfig->_memory_latency;
+    pcache->_textsize = textsize;
+    for (unsigned l = 0; l < pcache->_nlevels; l++) {
+        Cache_Level *plevel = &pcache->_levels[l];
+        plevel->_config = pconfig->_levels[l];
+        plevel->_sets = plevel->_config._size / (plevel->_config._ways * plevel->_config._line);
+        plevel->_ways = calloc(plevel->_config._size / plevel->_config._line, sizeof (Cache_Way));
+        if (plevel->_ways == NULL) {
+            perror("create_cache_model");
+            exit(1);
+        }
+    }
+    return pcache;
+}
+
+void free_cache_model(Cache_Model *pcache) {
+    if (pcache != NULL) {
+        for (unsigned l = 0; l < pcache->_nlevels; l++) {
+            free(pcache->_levels[l]._ways);
+        }
+        free(pcache->_stats);
+        free(pcache->_frames);
+        free(pcache);
+    }
+}
+
+//! Recherche d'un mot dans un niveau, avec chargement de sa ligne en cas d'absence
+/*!
+ * \param plevel le niveau
+ * \param address l'adresse du mot
+ * \param clock la date de l'accès
+ * \return vrai si la ligne était présente (hit)
+ */
+static bool lookup(Cache_Level *plevel, unsigned address, uint64_t clock) {
+    unsigned tag = address / plevel->_config._line;
+    Cache_Way *ways = &plevel->_ways[(size_t) (tag % plevel->_sets) * plevel->_config._ways];
+    Cache_Way *victim = &ways[0];
+
+    for (unsigned w = 0; w < plevel->_config._ways; w++) {
+        if (ways[w]._used != 0 && ways[w]._tag == tag) {
+            ways[w]._used = clock;
+            return true;
+        }
+        if (ways[w]._used < victim->_used) {
+            victim = &ways[w];
+        }
+    }
+    // La voie la moins récemment utilisée (ou une voie libre) reçoit la ligne
+    victim->_tag = tag;
+    victim->_used = clock;
+    return false;
+}
+
+//! Accès à un mot du segment de données, compté pour le sous-programme courant
+static void access_word(Cache_Model *pcache, unsigned address) {
+    unsigned entry = pcache->_depth > 0 ? pcache->_frames[pcache->_depth - 1] : 0;
+    Cache_Stats *pstats = &pcache->_stats[entry];
+    uint64_t cycles = 0;
+    unsigned l;
+
+    pcache->_clock++;
+    pstats->_accesses++;
+    for (l = 0; l < pcache->_nlevels; l++) {
+        cycles += pcache->_levels[l]._config._latency;
+        if (lookup(&pcache->_levels[l], address, pcache->_clock)) {
+            break;
+        }
+        pstats->_misses[l]++;
+    }
+    if (l == pcache->_nlevels) {
+        cycles += pcache->_memory_latency;
+    }
+    pstats->_cycles += cycles;
+}
+
+//! Entrée dans un sous-programme
+static void enter(Cache_Model *pcache, unsigned entry) {
+    if (pcache->_depth == pcache->_capacity) {
+        pcache->_capacity = pcache->_capacity > 0 ? 2 * pcache->_capacity : 64;
+        pcache->_frames = realloc(pcache->_frames, pcache->_capacity * sizeof (unsigned));
+        if (pcache->_frames == NULL) {
+            perror("cache_instruction");
+            exit(1);
+        }
+    }
+    pcache->_frames[pcache->_depth++] = entry;
+}
+
+void cache_instruction(Cache_Model *pcache, const Machine *pmach, unsigned addr) {
+    Instruction instr = pmach->_text[addr];
+    unsigned sp = pmach->_sp;
+    // Mêmes contrôles que check_seg_data() et check_stack() dans exec.c
+    bool stack_ok = sp >= pmach->_dataend && sp < pmach->_datasize;
+    bool pop_ok = sp + 1 >= pmach->_dataend && sp + 1 < pmach->_datasize;
+    unsigned operand = instr.instr_absolute._address;
+    bool operand_ok;
+
+    if (instr.instr_generic._indexed) {
+        operand = pmach->_registers[instr.instr_indexed._rindex] + instr.instr_indexed._offset;
+    }
+    operand_ok = !instr.instr_generic._immediate && operand <= pmach->_datasize;
+
+    switch (instr.instr_generic._cop) {
+        case LOAD:
+        case STORE:
+        case ADD:
+        case SUB:
+        case XADD:
+        case XCHG:
+            if (operand_ok) {
+                access_word(pcache, operand);
+            }
+            break;
+        case PUSH:
+            if (stack_ok && (instr.instr_generic._immediate || operand_ok)) {
+                if (operand_ok) {
+                    access_word(pcache, operand);
+                }
+                access_word(pcache, sp);
+            }
+            break;
+        case POP:
+            if (operand_ok && pop_ok) {
+                access_word(pcache, sp + 1);
+                access_word(pcache, operand);
+            }
+            break;
+        case CALL:
+            if (!instr.instr_generic._immediate && stack_ok
+                    && instr.instr_generic._regcond <= LAST_CONDITION
+                    && (condition_masks[instr.instr_generic._regcond] >> current_cc(pmach)) & 1) {
+                access_word(pcache, sp);
+                if (operand < pcache->_textsize) {
+                    enter(pcache, operand);
+                }
+            }
+            break;
+        case RET:
+            if (pop_ok) {
+                access_word(pcache, sp + 1);
+                if (pcache->_depth > 0) {
+                    pcache->_depth--;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+//! Cycles d'un sous-programme (pour le tri)
+typedef struct {
+    unsigned _entry; //!< Adresse d'entrée
+    uint64_t _cycles; //!< Cycles estimés
+} Entry_Cycles;
+
+//! Comparaison pour qsort() : les plus coûteux d'abord, puis par adresse
+static int by_cycles(const void *a, const void *b) {
+    const Entry_Cycles *ea = a;
+    const Entry_Cycles *eb = b;
+    if (ea->_cycles != eb->_cycles) {
+        return ea->_cycles > eb->_cycles ? -1 : 1;
+    }
+    return ea->_entry < eb->_entry ? -1 : ea->_entry > eb->_entry;
+}
+
+void print_cache_model(const Cache_Model *pcache) {
+    Cache_Stats total = {0};
+    unsigned nentries = 0;
+    Entry_Cycles *entries = malloc((pcache->_textsize > 0 ? pcache->_textsize : 1) * sizeof (Entry_Cycles));
+    if (entries == NULL) {
+        perror("print_cache_model");
+        return;
+    }
+    for (unsigned e = 0; e < pcache->_textsize; e++) {
+        const Cache_Stats *pstats = &pcache->_stats[e];
+        if (pstats->_accesses == 0) {
+            continue;
+        }
+        total._accesses += pstats->_accesses;
+        total._cycles += pstats->_cycles;
+        for (unsigned l = 0; l < pcache->_nlevels; l++) {
+            total._misses[l] += pstats->_misses[l];
+        }
+        entries[nentries++] = (Entry_Cycles) {._entry = e, ._cycles = pstats->_cycles};
+    }
+    qsort(entries, nentries, sizeof (Entry_Cycles), by_cycles);
+
+    printf("\n*** Cache model ***\n\n");
+    for (unsigned l = 0; l < pcache->_nlevels; l++) {
+        const Cache_Level_Config *pconfig = &pcache->_levels[l]._config;
+        printf("L%u: %u words, %u-way, %u-word lines, latency %u\n", l + 1,
+                pconfig->_size, pconfig->_ways, pconfig->_line, pconfig->_latency);
+    }
+    printf("Memory: latency %u\n\n", pcache->_memory_latency);
+
+    printf("Level %14s %14s %14s %8s\n", "accesses", "hits", "misses", "hit %");
+    uint64_t reaching = total._accesses;
+    for (unsigned l = 0; l < pcache->_nlevels; l++) {
+        uint64_t misses = total._misses[l];
+        printf("L%-4u %14" PRIu64 " %14" PRIu64 " %14" PRIu64 " %7.2f%%\n", l + 1,
+                reaching, reaching - misses, misses,
+                reaching > 0 ? 100.0 * (reaching - misses) / reaching : 0.0);
+        reaching = misses;
+    }
+    printf("Cycles: %" PRIu64 " (%.2f per access)\n\n", total._cycles,
+            total._accesses > 0 ? (double) total._cycles / total._accesses : 0.0);
+
+    printf("Subroutine %14s", "accesses");
+    for (unsigned l = 0; l < pcache->_nlevels; l++) {
+        printf("   L%u misses", l + 1);
+    }
+    printf(" %14s\n", "cycles");
+    for (unsigned i = 0; i < nentries; i++) {
+        const Cache_Stats *pstats = &pcache->_stats[entries[i]._entry];
+        printf("0x%04X     %14" PRIu64, entries[i]._entry, pstats->_accesses);
+        for (unsigned l = 0; l < pcache->_nlevels; l++) {
+            printf(" %11" PRIu64, pstats->_misses[l]);
+        }
+        printf(" %14" PRIu64 "\n", pstats->_cycles);
+    }
+    free(entries);
+}
@@ -0,0 +1,129 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/*!
+ * \file cache.h
+ * \brief Modèle de hiérarchie de caches pour les accès au segment de données.
+ *
+ * Quand l'option \c _cache est fournie à simul_engine(), chaque accès d'une
+ * instruction au segment de données (opérande mémoire de \c LOAD, \c STORE,
+ * \c ADD, \c SUB, \c PUSH et \c POP, pile de \c PUSH, \c POP, \c CALL et
+ * \c RET) est présenté à un ou deux niveaux de cache associatifs par
+ * ensembles, à remplacement LRU. Les hits, les misses et une estimation du
+ * nombre de cycles passés en accès mémoire sont comptés par sous-programme.
+ * Comme le profil, le modèle impose l'exécution instruction par instruction ;
+ * sans modèle, les boucles rapides des moteurs n'en contiennent aucune trace.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Nombre maximal de niveaux de cache
+#define CACHE_MAX_LEVELS 2
+
+//! Géométrie et latence d'un niveau de cache (tailles en mots)
+typedef struct {
+    unsigned _size; //!< Capacité totale
+    unsigned _ways; //!< Nombre de voies (associativité)
+    unsigned _line; //!< Taille d'une ligne
+    unsigned _latency; //!< Cycles d'un accès à ce niveau
+} Cache_Level_Config;
+
+//! Configuration de la hiérarchie
+typedef struct {
+    unsigned _nlevels; //!< Nombre de niveaux (1 ou 2)
+    Cache_Level_Config _levels[CACHE_MAX_LEVELS]; //!< Niveaux, L1 en premier
+    unsigned _memory_latency; //!< Cycles d'un accès à la mémoire
+} Cache_Config;
+
+//! Configuration par défaut : L1 de 256 mots, L2 de 4096 mots, mémoire à 100 cycles
+extern const Cache_Config default_cache_config;
+
+//! Compteurs d'un sous-programme
+typedef struct {
+    uint64_t _accesses; //!< Accès au segment de données
+    uint64_t _misses[CACHE_MAX_LEVELS]; //!< Misses à chaque niveau
+    uint64_t _cycles; //!< Cycles estimés de ces accès
+} Cache_Stats;
+
+//! Une ligne présente dans un niveau de cache
+typedef struct {
+    unsigned _tag; //!< Numéro de ligne mémoire
+    uint64_t _used; //!< Date du dernier accès (0 : voie libre)
+} Cache_Way;
+
+//! État d'un niveau de cache
+typedef struct {
+    Cache_Level_Config _config; //!< Géométrie et latence
+    unsigned _sets; //!< Nombre d'ensembles
+    Cache_Way *_ways; //!< Les \c _sets × \c _ways voies, ensemble par ensemble
+} Cache_Level;
+
+//! Modèle de caches d'une exécution
+typedef struct {
+    unsigned _nlevels; //!< Nombre de niveaux
+    Cache_Level _levels[CACHE_MAX_LEVELS]; //!< Niveaux, L1 en premier
+    unsigned _memory_latency; //!< Cycles d'un accès à la mémoire
+    uint64_t _clock; //!< Nombre d'accès, qui date les voies pour LRU
+    unsigned _textsize; //!< Taille du segment de texte
+    Cache_Stats *_stats; //!< Compteurs indexés par adresse d'entrée de sous-programme
+    unsigned *_frames; //!< Pile des adresses d'entrée des sous-programmes appelés
+    unsigned _depth; //!< Nombre de sous-programmes appelés en cours
+    unsigned _capacity; //!< Taille allouée de \c _frames
+} Cache_Model;
+
+//! Lecture d'une configuration
+/*!
+ * La configuration est soit \c default (voir \c default_cache_config), soit
+ * un ou deux niveaux suivis de la latence de la mémoire, séparés par des
+ * virgules ; un niveau s'écrit <tt>taille:voies:ligne:latence</tt>, par
+ * exemple <tt>256:4:8:1,4096:8:8:10,100</tt>. La taille doit être un
+ * multiple non nul de <tt>voies × ligne</tt>.
+ *
+ * \param spec la configuration sous forme de texte
+ * \param pconfig la configuration lue
+ * \return faux si \c spec est mal formée
+ */
+bool cache_config_from_string(const char *spec, Cache_Config *pconfig);
+
+//! Création d'un modèle aux caches vides
+/*!
+ * \param pconfig la configuration (valide)
+ * \param textsize la taille du segment de texte du programme
+ * \return le modèle (à libérer par free_cache_model())
+ */
+Cache_Model *create_cache_model(const Cache_Config *pconfig, unsigned textsize);
+
+//! Libération d'un modèle
+/*!
+ * \param pcache le modèle (ou NULL)
+ */
+void free_cache_model(Cache_Model *pcache);
+
+//! Accès d'une instruction au segment de données
+/*!
+ * Appelée avant l'exécution de l'instruction : les accès sont déduits de
+ * l'instruction et de l'état de la machine, et attribués au sous-programme
+ * courant. Un accès hors du segment, qui provoquera une erreur, n'est pas
+ * compté. Après un \c CALL effectué, les accès suivants sont attribués au
+ * sous-programme appelé, jusqu'à son \c RET.
+ *
+ * \param pcache le modèle
+ * \param pmach la machine, dans l'état qui précède l'instruction
+ * \param addr l'adresse de l'instruction
+ */
+void cache_instruction(Cache_Model *pcache, const Machine *pmach, unsigned addr);
+
+//! Rapport du modèle de caches
+/*!
+ * La configuration, les totaux par niveau, puis une ligne par sous-programme
+ * (désigné par son adresse d'entrée, 0 pour le programme principal) par
+ * nombre de cycles décroissant.
+ *
+ * \param pcache le modèle
+ */
+void print_cache_model(const Cache_Model *pcache);
+
+#endif
@@ -0,0 +1,414 @@
+/*!
+ * \file checker.c
+ * \brief Vérification pas à pas d'un moteur rapide contre l'interpréteur de référence.
+ */
+
+#include "checker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Nombre maximal de mots de données différents affichés par le rapport
+#define MAX_REPORTED_WORDS 16
+
+uint64_t data_hash(const Machine *pmach) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (unsigned i = 0; i < pmach->_datasize; i++) {
+        Word w = pmach->_data[i];
+        for (unsigned b = 0; b < sizeof (Word); b++) {
+            hash ^= (w >> (8 * b)) & 0xFF;
+            hash *= 0x100000001B3ULL;
+        }
+    }
+    return hash;
+}
+
+//! Exécution d'une tranche par les deux machines
+typedef struct {
+    Simul_Status _status[2]; //!< Issue de l'exécution (référence, moteur vérifié)
+    uint64_t _executed[2]; //!< Instructions exécutées (référence, moteur vérifié)
+} Step_Pair;
+
+//! Exécution d'au plus \c count instructions par les deux machines.
+
+/*!
+ * \param pref la machine de référence
+ * \param pfast la machine vérifiée
+ * \param engine le moteur vérifié
+ * \param count le nombre d'instructions
+ * \return les issues des deux exécutions
+ */
+static Step_Pair run_pair(Machine *pref, Machine *pfast, Engine engine, uint64_t count) {
+    Step_Pair pair;
+    uint64_t budget = count;
+    pair._status[0] = simul_run_budget(pref, ENGINE_SWITCH, &budget);
+    pair._executed[0] = count - budget;
+    budget = count;
+    pair._status[1] = simul_run_budget(pfast, engine, &budget);
+    pair._executed[1] = count - budget;
+    return pair;
+}
+
+//! Les deux machines sont-elles dans le même état après une tranche ?
+
+/*!
+ * Après une erreur, seuls l'erreur, son adresse et l'état des machines
+ * comptent : le nombre d'instructions exécutées n'est pas précis (voir
+ * run_budget()).
+ *
+ * \param pref la machine de référence
+ * \param pfast la machine vérifiée
+ * \param ppair les issues de la tranche
+ */
+static bool same_state(const Machine *pref, const Machine *pfast, const Step_Pair *ppair) {
+    const Simul_Status *s = ppair->_status;
+    return (ppair->_executed[0] == ppair->_executed[1] || s[0]._err != ERR_NOERROR)
+            && s[0]._stopped == s[1]._stopped && s[0]._err == s[1]._err && s[0]._addr == s[1]._addr
+            && pref->_pc == pfast->_pc && current_cc(pref) == current_cc(pfast)
+            && memcmp(pref->_registers, pfast->_registers, sizeof pref->_registers) == 0
+            && pref->_datasize == pfast->_datasize && data_hash(pref) == data_hash(pfast);
+}
+
+//! Affichage de l'issue d'une exécution et de l'état de la machine.
+
+/*!
+ * \param name le nom du moteur
+ * \param pmach la machine
+ * \param status l'issue de l'exécution
+ * \param executed le nombre d'instructions exécutées
+ */
+static void print_side(const char *name, Machine *pmach, Simul_Status status, uint64_t executed) {
+    printf("*** %s (%llu instruction%s): ", name, (unsigned long long) executed,
+           executed == 1 ? "" : "s");
+    if (status._stopped) {
+        printf("running, next instruction at 0x%04x\n", status._addr);
+    } else if (status._err == ERR_NOERROR) {
+        printf("HALT at address 0x%04x\n", status._addr);
+    } else {
+        print_error(status._err, status._addr);
+    }
+    print_cpu(pmach);
+}
+
+//! Rapport de divergence.
+
+/*!
+ * Les machines sont dans l'état qui précède l'instruction divergente ; elles
+ * l'exécutent avant le rapport.
+ *
+ * \param pref la machine de référence
+ * \param pfast la machine vérifiée
+ * \param engine le moteur vérifié
+ * \param executed le nombre d'instructions déjà exécutées à l'identique
+ * \return l'issue de l'instruction divergente sur la machine de référence
+ */
+static Simul_Status report(Machine *pref, Machine *pfast, Engine engine, uint64_t executed) {
+    printf("*** Divergence between %s and %s at instruction #%llu",
+           engine_names[ENGINE_SWITCH], engine_names[engine],
+           (unsigned long long) executed + 1);
+    unsigned pc = pref->_pc;
+    if (pc < pref->_textsize) {
+        Instruction instr = pref->_text[pc];
+        printf(", address 0x%04x: ", pc);
+        if (instr.instr_generic._cop <= LAST_COP) {
+            print_instruction(instr, pc);
+        } else {
+            printf("0x%08X", instr._raw);
+        }
+    }
+    printf("\n");
+
+    Step_Pair pair = run_pair(pref, pfast, engine, 1);
+    print_side(engine_names[ENGINE_SWITCH], pref, pair._status[0], pair._executed[0]);
+    print_side(engine_names[engine], pfast, pair._status[1], pair._executed[1]);
+
+    unsigned reported = 0;
+    for (unsigned i = 0; i < pref->_datasize && i < pfast->_datasize; i++) {
+        if (pref->_data[i] != pfast->_data[i]) {
+            if (reported++ == MAX_REPORTED_WORDS) {
+                printf("...\n");
+                break;
+            }
+            printf("data[0x%04x]: 0x%08x (%s) 0x%08x (%s)\n", i,
+                   pref->_data[i], engine_names[ENGINE_SWITCH],
+                   pfast->_data[i], engine_names[engine]);
+        }
+    }
+    return pair._status[0];
+}
+
+//! Recherche de la première instruction divergente d'une tranche.
+
+/*!
+ * Les machines sont remises au début de la tranche autant de fois que
+ * nécessaire, puis laissées juste avant l'instruction divergente.
+ *
+ * \param pref la machine de référence
+ * \param pfast la machine vérifiée
+ * \param sref la photographie de la machine de référence au début de la tranche
+ * \param sfast la photographie de la machine vérifiée au début de la tranche
+ * \param engine le moteur vérifié
+ * \param count la longueur de la tranche (après laquelle les machines diffèrent)
+ * \return le nombre d'instructions de la tranche exécutées à l'identique
+ */
+static uint64_t bisect(Machine *pref, Machine *pfast, Snapshot *sref, Snapshot *sfast,
+        Engine engine, uint64_t count) {
+    uint64_t same = 0, differ = count;
+    while (differ - same > 1) {
+        uint64_t middle = same + (differ - same) / 2;
+        restore_snapshot(sref, pref);
+        restore_snapshot(sfast, pfast);
+        Step_Pair pair = run_pair(pref, pfast, engine, middle);
+        if (same_state(pref, pfast, &pair)) {
+            same = middle;
+        } else {
+            differ = middle;
+        }
+    }
+    restore_snapshot(sref, pref);
+    restore_snapshot(sfast, pfast);
+    if (same > 0) {
+        run_pair(pref, pfast, engine, same);
+    }
+    return same;
+}
+
+Check_Result check_lockstep(Machine *pref, Machine *pfast, const Check_Options *options) {
+    Check_Result result = {._diverged = false, ._executed = 0};
+    uint64_t interval = options->_interval > 0 ? options->_interval : 1;
+
+    for (;;) {
+        uint64_t count = interval;
+        if (options->_limit > 0 && options->_limit - result._executed < count) {
+            count = options->_limit - result._executed;
+        }
+        if (count == 0) { // Limite atteinte
+            result._status = (Simul_Status) {ERR_NOERROR, pref->_pc, true};
+            return result;
+        }
+
+        Snapshot *sref = take_snapshot(pref);
+        Snapshot *sfast = take_snapshot(pfast);
+        if (sref == NULL || sfast == NULL) {
+            perror("checker");
+            exit(1);
+        }
+        Step_Pair pair = run_pair(pref, pfast, options->_engine, count);
+        if (!same_state(pref, pfast, &pair)) {
+            uint64_t same = bisect(pref, pfast, sref, sfast, options->_engine, count);
+            free_snapshot(sref);
+            free_snapshot(sfast);
+            result._executed += same;
+            result._status = report(pref, pfast, options->_engine, result._executed);
+            result._diverged = true;
+            return result;
+        }
+        free_snapshot(sref);
+        free_snapshot(sfast);
+        result._executed += pair._executed[0];
+        result._status = pair._status[0];
+        if (!pair._status[0]._stopped) { // HALT ou erreur, identiques
+            return result;
+        }
+    }
+}
+
+//! État du générateur de programmes aléatoires
+typedef struct {
+    uint32_t _random; //!< État du générateur pseudo-aléatoire (xorshift 32 bits)
+    unsigned _textsize; //!< Taille du segment de texte
+    unsigned _datasize; //!< Taille du segment de données
+    unsigned _depth; //!< Profondeur de pile estimée (en suivant le texte en séquence)
+} Generator;
+
+//! Tirage d'un mot (indépendant de rand(), donc reproductible partout)
+static uint32_t next_random(Generator *pgen) {
+    uint32_t x = pgen->_random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return pgen->_random = x;
+}
+
+//! Tirage d'un entier dans [0, n[
+static unsigned random_below(Generator *pgen, unsigned n) {
+    return next_random(pgen) % n;
+}
+
+//! Tirage d'un registre (les premiers sont plus fréquents, pour créer des dépendances ; SP est rare)
+static unsigned random_register(Generator *pgen) {
+    unsigned r = random_below(pgen, 64);
+    return r == 0 ? NREGISTERS - 1 : r < 48 ? r % 4 : 4 + r % (NREGISTERS - 5);
+}
+
+//! Tirage d'une instruction à adressage immédiat, absolu ou indexé.
+
+/*!
+ * Les valeurs immédiates sont surtout de petits entiers positifs, pour que
+ * les registres servent d'index ; les adresses tombent presque toujours dans
+ * le segment visé.
+ *
+ * \param pgen le générateur
+ * \param cop le code opération
+ * \param regcond le registre ou la condition
+ * \param mode \c 'I' (immédiat), \c 'A' (absolu), \c 'X' (indexé) ou 0 (au hasard)
+ * \return l'instruction
+ */
+static Instruction random_operand(Generator *pgen, Code_Op cop, unsigned regcond, char mode) {
+    bool immediate_ok = cop == LOAD || cop == ADD || cop == SUB || cop == PUSH;
+    bool control = cop == BRANCH || cop == CALL;
+    unsigned size = control ? pgen->_textsize : pgen->_datasize;
+    if (mode == 0) {
+        unsigned m = random_below(pgen, 10);
+        mode = m < 4 && immediate_ok ? 'I' : m < 7 || (control && m < 9) ? 'A' : 'X';
+    }
+
+    Instruction instr = {._raw = 0};
+    instr.instr_generic._cop = cop;
+    instr.instr_generic._regcond = regcond;
+    switch (mode) {
+        case 'I':
+            instr.instr_immediate._immediate = true;
+            if (random_below(pgen, 16) == 0) {
+                instr.instr_immediate._value = (int) random_below(pgen, 1 << 20) - (1 << 19);
+            } else if (cop == LOAD) {
+                instr.instr_immediate._value = random_below(pgen, pgen->_datasize);
+            } else {
+                instr.instr_immediate._value = 1 + random_below(pgen, 8);
+            }
+            break;
+        case 'A':
+            // Parfois juste après le segment de données, pour exercer les erreurs
+            instr.instr_absolute._address = !control && random_below(pgen, 32) == 0
+                    ? size + random_below(pgen, 2) : random_below(pgen, size);
+            break;
+        default:
+            instr.instr_indexed._indexed = true;
+            instr.instr_indexed._rindex = random_register(pgen);
+            instr.instr_indexed._offset = (int) random_below(pgen, size / 2 + 4) - 4;
+            break;
+    }
+    return instr;
+}
+
+//! Tirage d'une condition
+static Condition random_condition(Generator *pgen) {
+    return random_below(pgen, LAST_CONDITION + 1);
+}
+
+//! Tirage d'une instruction invalide
+
+/*!
+ * Chacune des erreurs de décodage a sa part : \c ILLOP (\c ERR_ILLEGAL), code
+ * opération inexistant (\c ERR_UNKNOWN), condition inexistante
+ * (\c ERR_CONDITION), adressage immédiat interdit (\c ERR_IMMEDIATE).
+ *
+ * \param pgen le générateur
+ * \param reg le registre (pour l'adressage immédiat interdit)
+ * \return l'instruction
+ */
+static Instruction random_invalid(Generator *pgen, unsigned reg) {
+    static const Code_Op no_immediate[] = {STORE, BRANCH, CALL, POP, XADD, XCHG};
+    Instruction instr = {._raw = 0};
+    Code_Op cop;
+
+    switch (random_below(pgen, 4)) {
+        case 0:
+            instr.instr_generic._cop = ILLOP;
+            instr.instr_generic._regcond = reg;
+            return instr;
+        case 1:
+            instr.instr_generic._cop = LAST_COP + 1 + random_below(pgen, 63 - LAST_COP);
+            instr.instr_generic._regcond = reg;
+            return instr;
+        case 2:
+            cop = random_below(pgen, 2) == 0 ? BRANCH : CALL;
+            return random_operand(pgen, cop, LAST_CONDITION + 1 + random_below(pgen, 15 - LAST_CONDITION), 'A');
+        default:
+            cop = no_immediate[random_below(pgen, sizeof no_immediate / sizeof no_immediate[0])];
+            return random_operand(pgen, cop, cop == BRANCH || cop == CALL ? random_condition(pgen) : reg, 'I');
+    }
+}
+
+bool write_random_program(unsigned seed, const char *file) {
+    Generator gen = {._random = seed * 2654435761u + 1, ._depth = 0};
+    if (gen._random == 0) {
+        gen._random = 1;
+    }
+    unsigned header[3];
+    unsigned textsize = header[0] = gen._textsize = 8 + random_below(&gen, 57);
+    unsigned datasize = header[1] = gen._datasize = 32 + random_below(&gen, 225);
+    header[2] = 1 + random_below(&gen, datasize / 2); // dataend
+    Instruction *text = malloc(sizeof (Instruction) * textsize);
+    Word *data = malloc(sizeof (Word) * datasize);
+    if (text == NULL || data == NULL) {
+        free(text);
+        free(data);
+        return false;
+    }
+
+    static const Code_Op cops[] = {
+        NOP, LOAD, LOAD, LOAD, STORE, STORE, ADD, ADD, SUB, SUB,
+        BRANCH, BRANCH, CALL, RET, PUSH, PUSH, POP, POP, XADD, XCHG, BARRIER,
+    };
+    unsigned i = 0;
+    while (i < textsize - 1) {
+        unsigned left = textsize - 1 - i;
+        unsigned r = random_below(&gen, 100);
+        unsigned reg = random_register(&gen);
+        if (r < 8 && left >= 2) { // Boucle : SUB# (ou ADD#) puis BRANCH en arrière
+            text[i] = random_operand(&gen, r < 6 ? SUB : ADD, reg, 'I');
+            text[i + 1] = random_operand(&gen, BRANCH, r < 6 ? NE : random_condition(&gen), 'A');
+            text[i + 1].instr_absolute._address = i > 0 ? i - random_below(&gen, i < 8 ? i : 8) : 0;
+            i += 2;
+        } else if (r < 14 && left >= 2) { // LOAD puis ADD sur le même registre
+            text[i++] = random_operand(&gen, LOAD, reg, "AX"[r % 2]);
+            text[i++] = random_operand(&gen, ADD, reg, "IAX"[r % 3]);
+        } else if (r < 18 && left >= 3) { // Passage d'arguments : PUSH PUSH CALL
+            char mode = "IAX"[r % 3];
+            text[i++] = random_operand(&gen, PUSH, 0, mode);
+            text[i++] = random_operand(&gen, PUSH, 0, mode);
+            text[i++] = random_operand(&gen, CALL, NC, 'A');
+            gen._depth += 3;
+        } else if (r < 20) {
+            text[i++] = (Instruction) {.instr_generic = {HALT}};
+        } else if (r < 21) { // Erreur de décodage, rare (voir random_invalid())
+            text[i++] = random_invalid(&gen, reg);
+        } else {
+            Code_Op cop = cops[random_below(&gen, sizeof cops / sizeof cops[0])];
+            if ((cop == POP || cop == RET) && gen._depth == 0 && random_below(&gen, 16) != 0) {
+                cop = PUSH; // Pas de dépilement sur une pile vide, sauf exception
+            }
+            if (cop == NOP || cop == RET || cop == BARRIER) {
+                text[i++] = (Instruction) {.instr_generic = {cop}};
+            } else if (cop == BRANCH || cop == CALL) {
+                text[i++] = random_operand(&gen, cop, random_condition(&gen), 0);
+            } else {
+                text[i++] = random_operand(&gen, cop, reg, 0);
+            }
+            if (cop == PUSH || cop == CALL) {
+                gen._depth++;
+            } else if ((cop == POP || cop == RET) && gen._depth > 0) {
+                gen._depth--;
+            }
+        }
+    }
+    text[i] = (Instruction) {.instr_generic = {HALT}};
+
+    for (unsigned d = 0; d < datasize; d++) {
+        data[d] = random_below(&gen, 4) == 0 ? next_random(&gen) : random_below(&gen, datasize);
+    }
+
+    FILE *out = fopen(file, "w");
+    bool ok = out != NULL;
+    if (ok) {
+        fwrite(header, sizeof (unsigned), 3, out);
+        fwrite(text, sizeof (Instruction), textsize, out);
+        fwrite(data, sizeof (Word), datasize, out);
+        ok = ferror(out) == 0;
+        ok = fclose(out) == 0 && ok;
+    }
+    free(text);
+    free(data);
+    return ok;
+}
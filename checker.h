@@ -0,0 +1,90 @@
+#ifndef _CHECKER_H_
+#define _CHECKER_H_
+
+/*!
+ * \file checker.h
+ * \brief Vérification pas à pas d'un moteur rapide contre l'interpréteur de référence.
+ *
+ * Un moteur d'exécution (voir \link Engine \endlink) doit reproduire
+ * exactement decode_execute() : mêmes registres, même code condition, mêmes
+ * données, et mêmes erreurs aux mêmes adresses. Le vérificateur exécute le
+ * même programme sur deux machines, l'une avec \c ENGINE_SWITCH, l'autre avec
+ * le moteur à vérifier, par tranches d'un nombre fixé d'instructions (voir
+ * simul_run_budget()). Après chaque tranche, il compare l'issue de
+ * l'exécution, \c _pc, \c _cc, les registres et une empreinte du segment de
+ * données.
+ *
+ * En cas de divergence, les deux machines sont remises au début de la
+ * tranche (voir take_snapshot()) et on cherche par dichotomie la première
+ * instruction après laquelle elles diffèrent ; le rapport donne cette
+ * instruction et l'état des deux machines juste après.
+ *
+ * Le générateur de programmes aléatoires (voir write_random_program())
+ * fournit les programmes à vérifier en masse (voir l'outil lockstep).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simulator.h"
+
+//! Options de la vérification
+typedef struct {
+    Engine _engine; //!< Moteur vérifié
+    uint64_t _interval; //!< Nombre d'instructions entre deux comparaisons
+    uint64_t _limit; //!< Nombre maximal d'instructions exécutées (0 : pas de limite)
+} Check_Options;
+
+//! Résultat de la vérification
+typedef struct {
+    bool _diverged; //!< Les deux moteurs ont-ils divergé ?
+    uint64_t _executed; //!< Instructions exécutées à l'identique
+    Simul_Status _status; //!< Issue de l'exécution de référence (\c _stopped si la limite est atteinte)
+} Check_Result;
+
+//! Empreinte du segment de données
+/*!
+ * Empreinte FNV-1a 64 bits des \c _datasize mots du segment.
+ *
+ * \param pmach la machine
+ * \return l'empreinte
+ */
+uint64_t data_hash(const Machine *pmach);
+
+//! Exécution comparée de deux machines
+/*!
+ * Les deux machines doivent avoir été chargées avec le même programme. La
+ * vérification s'arrête sur \c HALT, sur une erreur, sur la limite
+ * d'instructions, ou à la première divergence ; dans ce dernier cas, un
+ * rapport est affiché sur la sortie standard. Les machines restent dans
+ * l'état final (juste après l'instruction fautive en cas de divergence).
+ *
+ * \param pref la machine exécutée par l'interpréteur de référence
+ * \param pfast la machine exécutée par le moteur vérifié
+ * \param options le moteur, l'intervalle des comparaisons et la limite
+ * \return le résultat de la vérification
+ */
+Check_Result check_lockstep(Machine *pref, Machine *pfast, const Check_Options *options);
+
+//! Écriture d'un programme aléatoire valide
+/*!
+ * Le programme (au format de read_program()) utilise presque toujours des
+ * codes opération, des conditions et des modes d'adressage légaux ; environ
+ * une instruction sur cent est invalide (\c ILLOP, code opération ou
+ * condition inexistants, adressage immédiat interdit), pour exercer les
+ * erreurs de décodage. Les branchements absolus visent le segment de texte
+ * et les adresses de données tombent presque toujours dans le segment,
+ * parfois juste au-delà (pour exercer les erreurs de segment). On y place aussi les séquences reconnues par la
+ * fusion d'instructions (voir fusion.h). Le programme peut boucler
+ * indéfiniment : d'où la limite de check_lockstep().
+ *
+ * Le même germe produit toujours le même programme, quelle que soit la
+ * plate-forme.
+ *
+ * \param seed le germe du générateur
+ * \param file le nom du fichier à écrire
+ * \return faux (avec \c errno positionné) si le fichier n'a pas pu être écrit
+ */
+bool write_random_program(unsigned seed, const char *file);
+
+#endif
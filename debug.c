@@ -4,29 +4,133 @@
  */
 
 #include "debug.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "machine.h"
 
-//! Dialogue de mise au point interactive pour l'instruction courante.
+void init_debugger(Debugger *pdbg, uint64_t *breakpoints, unsigned textsize) {
+	memset(breakpoints, 0, sizeof (uint64_t) * BREAKPOINT_WORDS(textsize));
+	pdbg->_breakpoints = breakpoints;
+	pdbg->_textsize = textsize;
+	pdbg->_nbreakpoints = 0;
+	pdbg->_mode = DEBUG_STEP;
+	pdbg->_count = 0;
+	pdbg->_frame = 0;
+	pdbg->_history = NULL;
+}
+
+//! Lecture du nombre qui suit une commande (décimal, ou hexadécimal avec \c 0x)
 /*!
- * Cette fonction gère le dialogue pour l'option \c -d (debug). Dans ce mode,
- * elle est invoquée après l'exécution de chaque instruction.  Elle affiche le
- * menu de mise au point et on exécute le choix de l'utilisateur. Si cette
- * fonction retourne faux, on abandonne le mode de mise au point interactive
- * pour les instructions suivantes et jusqu'à la fin du programme.
- * 
- * \param mach la machine/programme en cours de simulation
- * \return vrai si l'on doit continuer en mode debug, faux sinon
+ * \param arg le texte après la lettre de la commande
+ * \param pvalue la valeur lue
+ * \return faux s'il n'y a pas de nombre valide
  */
-bool debug_ask(Machine *pmach) {
+static bool parse_argument(const char *arg, uint64_t *pvalue) {
+	char *end;
+	while (*arg == ' ' || *arg == '\t') {
+		arg++;
+	}
+	if (*arg < '0' || *arg > '9') {
+		return false;
+	}
+	*pvalue = strtoull(arg, &end, 0);
+	while (*end == ' ' || *end == '\t' || *end == '\n') {
+		end++;
+	}
+	return *end == '\0';
+}
+
+//! Lecture d'une adresse du segment de texte après une commande
+static bool parse_address(Debugger *pdbg, const char *arg, unsigned *paddr) {
+	uint64_t value;
+	if (!parse_argument(arg, &value)) {
+		printf("Missing or invalid address\n");
+		return false;
+	}
+	if (value >= pdbg->_textsize) {
+		printf("Address 0x%08llX is out of the text segment\n", (unsigned long long) value);
+		return false;
+	}
+	*paddr = value;
+	return true;
+}
+
+//! Pose ou retrait d'un point d'arrêt
+static void set_breakpoint(Debugger *pdbg, unsigned addr, bool on) {
+	uint64_t bit = (uint64_t) 1 << (addr % 64);
+	if (is_breakpoint(pdbg, addr) == on) {
+		return;
+	}
+	pdbg->_breakpoints[addr / 64] ^= bit;
+	pdbg->_nbreakpoints += on ? 1 : -1;
+}
+
+//! Retour en arrière d'au plus \c count instructions, ou jusqu'au point d'arrêt précédent
+/*!
+ * \param pmach la machine
+ * \param pdbg l'état de la mise au point (avec un historique)
+ * \param count le nombre maximal d'instructions à annuler
+ * \param to_breakpoint arrêt dès que \c _pc porte un point d'arrêt ?
+ */
+static void step_back(Machine *pmach, Debugger *pdbg, uint64_t count, bool to_breakpoint) {
+	uint64_t undone = 0;
+	while (undone < count && undo_instruction(pdbg->_history, pmach)) {
+		undone++;
+		if (to_breakpoint && is_breakpoint(pdbg, pmach->_pc)) {
+			break;
+		}
+	}
+	if (undone == 0) {
+		printf("No instruction left to undo\n");
+		return;
+	}
+	printf("\t0x%04X: ", pmach->_pc);
+	print_instruction(pmach->_text[pmach->_pc], pmach->_pc);
+	printf("\n");
+}
+
+//! Liste des points d'arrêt, avec l'instruction de chacun
+static void list_breakpoints(Machine *pmach, Debugger *pdbg) {
+	if (pdbg->_nbreakpoints == 0) {
+		printf("No breakpoint\n");
+		return;
+	}
+	for (unsigned w = 0; w < BREAKPOINT_WORDS(pdbg->_textsize); w++) {
+		for (uint64_t bits = pdbg->_breakpoints[w]; bits != 0; bits &= bits - 1) {
+			unsigned addr = 64 * w + __builtin_ctzll(bits);
+			printf("\t0x%04X: ", addr);
+			print_instruction(pmach->_text[addr], addr);
+			printf("\n");
+		}
+	}
+}
+
+bool debug_command(Machine *pmach, Debugger *pdbg) {
 	bool debug_mode = true;
-	char buff[2];
+	char buff[128];
+	uint64_t count;
+	unsigned addr;
+	settle_cc(pmach);
 	while (debug_mode) {
 		printf("DEBUG?");
-		fgets(buff, 2, stdin);
-		int c;
-		while ((c=getchar()) != '\n' && c != EOF);
+		if (fgets(buff, sizeof buff, stdin) == NULL) {
+			return false;
+		}
+		if (strchr(buff, '\n') == NULL) {
+			int c;
+			while ((c=getchar()) != '\n' && c != EOF);
+		}
+		if (pdbg == NULL && buff[0] != '\0' && strchr("blxgnfuUw", buff[0]) != NULL) {
+			printf("Breakpoints are not available here\n");
+			continue;
+		}
+		if (pdbg != NULL && pdbg->_history == NULL && buff[0] != '\0'
+				&& strchr("uUw", buff[0]) != NULL) {
+			printf("No history: execution is not recorded\n");
+			continue;
+		}
 			switch (buff[0]) {
 			case 'h':
 				printf("Available commands:\n");
@@ -34,6 +138,15 @@ bool debug_ask(Machine *pmach) {
 				printf("\tc\tcontinue (exit interactive debug mode)\n");
 				printf("\ts\tstep by step (next instruction)\n");
 				printf("\tRET\tstep by step (next instruction)\n");
+				printf("\tn N\trun N instructions\n");
+				printf("\tf\trun until the current subroutine returns\n");
+				printf("\tg\trun until the next breakpoint\n");
+				printf("\tb ADDR\tset a breakpoint at text address ADDR (0x for hex)\n");
+				printf("\tx ADDR\tclear the breakpoint at ADDR (all without ADDR)\n");
+				printf("\tl\tlist breakpoints\n");
+				printf("\tu [N]\tstep back N instructions (1 by default; recording only)\n");
+				printf("\tU\trun back to the previous breakpoint (recording only)\n");
+				printf("\tw [N]\tshow the last N instructions (10 by default; recording only)\n");
 				printf("\tr\tprint registers\n");
 				printf("\td\tprint data memory\n");
 				printf("\tt\tprint text (program) memory\n");
@@ -45,8 +158,65 @@ bool debug_ask(Machine *pmach) {
 				break;
 			case '\n':
 			case 's':
+				if (pdbg != NULL) {
+					pdbg->_mode = DEBUG_STEP;
+				}
+				return true;
+				break;
+			case 'n':
+				if (!parse_argument(buff + 1, &count) || count == 0) {
+					printf("Usage: n N (N > 0)\n");
+					break;
+				}
+				pdbg->_mode = DEBUG_COUNT;
+				pdbg->_count = count;
+				return true;
+				break;
+			case 'f':
+				pdbg->_mode = DEBUG_RETURN;
+				pdbg->_frame = pmach->_sp;
+				return true;
+				break;
+			case 'g':
+				if (pdbg->_nbreakpoints == 0) {
+					printf("No breakpoint (use c to run to the end)\n");
+					break;
+				}
+				pdbg->_mode = DEBUG_BREAK;
 				return true;
 				break;
+			case 'b':
+				if (parse_address(pdbg, buff + 1, &addr)) {
+					set_breakpoint(pdbg, addr, true);
+				}
+				break;
+			case 'x':
+				if (strspn(buff + 1, " \t\n") == strlen(buff + 1)) {
+					memset(pdbg->_breakpoints, 0,
+							sizeof (uint64_t) * BREAKPOINT_WORDS(pdbg->_textsize));
+					pdbg->_nbreakpoints = 0;
+				} else if (parse_address(pdbg, buff + 1, &addr)) {
+					set_breakpoint(pdbg, addr, false);
+				}
+				break;
+			case 'l':
+				list_breakpoints(pmach, pdbg);
+				break;
+			case 'u':
+			case 'w':
+				count = buff[0] == 'u' ? 1 : 10;
+				if (strspn(buff + 1, " \t\n") != strlen(buff + 1)
+						&& (!parse_argument(buff + 1, &count) || count == 0)) {
+					printf("Usage: %c [N] (N > 0)\n", buff[0]);
+				} else if (buff[0] == 'u') {
+					step_back(pmach, pdbg, count, false);
+				} else {
+					print_history(pdbg->_history, pmach, count < UINT_MAX ? count : UINT_MAX);
+				}
+				break;
+			case 'U':
+				step_back(pmach, pdbg, UINT64_MAX, true);
+				break;
 			case 'r':
 				print_cpu(pmach);
 				break;
@@ -68,3 +238,18 @@ bool debug_ask(Machine *pmach) {
 	}
 	return false;
 }
+
+//! Dialogue de mise au point interactive pour l'instruction courante.
+/*!
+ * Cette fonction gère le dialogue pour l'option \c -d (debug). Dans ce mode,
+ * elle est invoquée après l'exécution de chaque instruction.  Elle affiche le
+ * menu de mise au point et on exécute le choix de l'utilisateur. Si cette
+ * fonction retourne faux, on abandonne le mode de mise au point interactive
+ * pour les instructions suivantes et jusqu'à la fin du programme.
+ *
+ * \param mach la machine/programme en cours de simulation
+ * \return vrai si l'on doit continuer en mode debug, faux sinon
+ */
+bool debug_ask(Machine *pmach) {
+	return debug_command(pmach, NULL);
+}
@@ -6,8 +6,103 @@
  * \brief Fonctions de mise au point interactive.
  */
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "machine.h"
+#include "history.h"
+
+//! Manière de reprendre l'exécution après un dialogue de mise au point
+typedef enum {
+    DEBUG_STEP = 0, //!< Arrêt après chaque instruction
+    DEBUG_COUNT, //!< Arrêt après un nombre donné d'instructions
+    DEBUG_RETURN, //!< Arrêt au retour (\c RET) du sous-programme courant
+    DEBUG_BREAK, //!< Arrêt au prochain point d'arrêt seulement
+} Debug_Mode;
+
+//! État de la mise au point : points d'arrêt et condition du prochain arrêt
+/*!
+ * Les points d'arrêt sont les bits d'un tableau indexé par l'adresse de
+ * l'instruction : le test après chaque instruction ne coûte qu'un accès
+ * mémoire. Hors du mode \c DEBUG_STEP, le moteur exécute le programme sans
+ * dialogue jusqu'à l'arrêt suivant (voir debug_stop()).
+ */
+typedef struct {
+    uint64_t *_breakpoints; //!< Un bit par adresse du segment de texte
+    unsigned _textsize; //!< Taille du segment de texte
+    unsigned _nbreakpoints; //!< Nombre de points d'arrêt posés
+    Debug_Mode _mode; //!< Condition du prochain arrêt
+    uint64_t _count; //!< Instructions restant à exécuter (\c DEBUG_COUNT)
+    unsigned _frame; //!< Valeur de SP dans le sous-programme à quitter (\c DEBUG_RETURN)
+    History *_history; //!< Historique pour revenir en arrière (NULL : pas d'historique)
+} Debugger;
+
+//! Nombre de mots de 64 bits du tableau des points d'arrêt
+#define BREAKPOINT_WORDS(textsize) (((textsize) + 63) / 64 + 1)
+
+//! Initialisation de la mise au point, sans point d'arrêt ni historique, en mode pas à pas
+/*!
+ * \param pdbg l'état de la mise au point
+ * \param breakpoints le tableau des points d'arrêt, de
+ * BREAKPOINT_WORDS(textsize) mots (fourni par l'appelant, par exemple sur
+ * la pile : il ne fuit pas si une erreur interrompt l'exécution)
+ * \param textsize la taille du segment de texte
+ */
+void init_debugger(Debugger *pdbg, uint64_t *breakpoints, unsigned textsize);
+
+//! Y a-t-il un point d'arrêt à une adresse ?
+static inline bool is_breakpoint(const Debugger *pdbg, unsigned addr) {
+    return addr < pdbg->_textsize && ((pdbg->_breakpoints[addr / 64] >> (addr % 64)) & 1);
+}
+
+//! Faut-il s'arrêter après une instruction ?
+/*!
+ * On s'arrête avant d'exécuter une instruction qui porte un point d'arrêt,
+ * et selon le mode : après chaque instruction, quand le nombre
+ * d'instructions demandé est atteint, ou après le \c RET qui quitte le
+ * sous-programme courant.
+ *
+ * \param pdbg l'état de la mise au point
+ * \param pmach la machine
+ * \param addr l'adresse de l'instruction qui vient d'être exécutée
+ * \return vrai s'il faut dialoguer
+ */
+static inline bool debug_stop(Debugger *pdbg, const Machine *pmach, unsigned addr) {
+    if (is_breakpoint(pdbg, pmach->_pc)) {
+        return true;
+    }
+    switch (pdbg->_mode) {
+        case DEBUG_STEP:
+            return true;
+        case DEBUG_COUNT:
+            return --pdbg->_count == 0;
+        case DEBUG_RETURN:
+            return pmach->_text[addr].instr_generic._cop == RET && pmach->_sp > pdbg->_frame;
+        case DEBUG_BREAK:
+            return false;
+    }
+    return true;
+}
+
+//! Dialogue de mise au point interactive pour l'instruction courante.
+/*!
+ * Cette fonction gère le dialogue pour l'option \c -d (debug). Elle affiche
+ * le menu de mise au point et on exécute le choix de l'utilisateur :
+ * affichage de l'état de la machine, gestion des points d'arrêt, et reprise
+ * de l'exécution (pas à pas, pour un nombre donné d'instructions, jusqu'au
+ * retour du sous-programme courant ou jusqu'au prochain point d'arrêt ; voir
+ * \link Debug_Mode \endlink). Avec un historique, on peut aussi revenir en
+ * arrière d'une ou plusieurs instructions, ou jusqu'au point d'arrêt
+ * précédent, et afficher les dernières instructions exécutées. Si cette
+ * fonction retourne faux, on abandonne
+ * le mode de mise au point interactive pour les instructions suivantes et
+ * jusqu'à la fin du programme.
+ *
+ * \param pmach la machine/programme en cours de simulation
+ * \param pdbg l'état de la mise au point (NULL : ni points d'arrêt ni
+ * reprise autre que pas à pas)
+ * \return vrai si l'on doit continuer en mode debug, faux sinon
+ */
+bool debug_command(Machine *pmach, Debugger *pdbg);
 
 //! Dialogue de mise au point interactive pour l'instruction courante.
 /*!
@@ -16,7 +111,9 @@
  * menu de mise au point et on exécute le choix de l'utilisateur. Si cette
  * fonction retourne faux, on abandonne le mode de mise au point interactive
  * pour les instructions suivantes et jusqu'à la fin du programme.
- * 
+ *
+ * C'est debug_command() sans points d'arrêt.
+ *
  * \param mach la machine/programme en cours de simulation
  * \return vrai si l'on doit continuer en mode debug, faux sinon
  */
@@ -0,0 +1,107 @@
+/*!
+ * \file decode.c
+ * \brief Pré-décodage du segment de texte en micro-opérations.
+ */
+
+#include "decode.h"
+#include "machine.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+//! Codes condition satisfaisant chaque condition (un bit par Condition_Code)
+const uint8_t condition_masks[] = {
+    [NC] = 1 << CC_U | 1 << CC_Z | 1 << CC_P | 1 << CC_N,
+    [EQ] = 1 << CC_Z,
+    [NE] = 1 << CC_U | 1 << CC_P | 1 << CC_N,
+    [GT] = 1 << CC_P,
+    [GE] = 1 << CC_P | 1 << CC_Z,
+    [LT] = 1 << CC_N,
+    [LE] = 1 << CC_N | 1 << CC_Z,
+};
+
+//! Table de sélection des micro-opérations, indexée par UOP_KEY()
+/*!
+ * Les combinaisons absentes de \c UOP_LIST valent 0, c'est-à-dire \c UOP_FAULT.
+ */
+static const uint8_t uop_table[256] = {
+    UOP_LIST(UOP_ENTRY)
+};
+
+//! Micro-opérations du mode G, indexées par la micro-opération du mode X correspondante
+/*!
+ * Les autres valeurs sont nulles : l'accès indexé garde son contrôle.
+ */
+static const uint8_t guarded_uops[UOP_HALT + 1] = {
+#define UOP_GUARDED(name, cop, mode) UOP_GUARDED_##mode(UOP_##name, cop)
+#define UOP_GUARDED_G(uop, cop) [UOP_##cop##_X] = uop,
+#define UOP_GUARDED_I(uop, cop)
+#define UOP_GUARDED_A(uop, cop)
+#define UOP_GUARDED_X(uop, cop)
+#define UOP_GUARDED_N(uop, cop)
+    UOP_LIST(UOP_GUARDED)
+#undef UOP_GUARDED
+#undef UOP_GUARDED_G
+#undef UOP_GUARDED_I
+#undef UOP_GUARDED_A
+#undef UOP_GUARDED_X
+#undef UOP_GUARDED_N
+};
+
+//! Codes opération qui accèdent au segment de données par leur adresse
+static bool data_access(Code_Op cop) {
+    return cop == LOAD || cop == STORE || cop == ADD || cop == SUB || cop == PUSH || cop == POP
+            || cop == XADD || cop == XCHG;
+}
+
+//! Traduction d'une instruction en micro-opération.
+
+/*!
+ * \param instr instruction à traduire
+ * \param d micro-opération résultat
+ * \param datasize taille du segment de données
+ * \param guarded le segment de données est-il gardé ?
+ */
+static void decode_one(Instruction instr, Decoded *d, unsigned datasize, bool guarded) {
+    Code_Op cop = instr.instr_generic._cop;
+    unsigned key = UOP_KEY(cop, instr.instr_generic._immediate, instr.instr_generic._indexed);
+
+    d->_handler = uop_table[key & 0xFF];
+    d->_regcond = instr.instr_generic._regcond;
+    d->_rindex = 0;
+    d->_flags = 0;
+    d->_operand = 0;
+
+    if ((cop == BRANCH || cop == CALL) && instr.instr_generic._regcond > LAST_CONDITION)
+        d->_handler = UOP_FAULT;
+    if (data_access(cop) && !instr.instr_generic._immediate && !instr.instr_generic._indexed
+            && instr.instr_absolute._address > datasize)
+        d->_handler = UOP_FAULT; // Même contrôle que check_seg_data()
+    if (d->_handler == UOP_FAULT) // Confié à decode_execute()
+        return;
+    if (guarded && guarded_uops[d->_handler] != 0)
+        d->_handler = guarded_uops[d->_handler];
+
+    d->_flags = DECODED_VALID;
+    if (instr.instr_generic._immediate) { // l'immédiat l'emporte sur l'indexé
+        d->_flags |= DECODED_IMMEDIATE;
+        d->_operand = instr.instr_immediate._value;
+    } else if (instr.instr_generic._indexed) {
+        d->_flags |= DECODED_INDEXED;
+        d->_rindex = instr.instr_indexed._rindex;
+        d->_operand = instr.instr_indexed._offset;
+    } else {
+        d->_operand = instr.instr_absolute._address;
+    }
+}
+
+Decoded *predecode(unsigned textsize, Instruction text[textsize], unsigned datasize, bool guarded) {
+    Decoded *decoded = malloc(sizeof (Decoded) * (textsize > 0 ? textsize : 1));
+    if (decoded == NULL) {
+        perror("decode");
+        exit(1);
+    }
+    for (unsigned i = 0; i < textsize; i++) {
+        decode_one(text[i], &decoded[i], datasize, guarded);
+    }
+    return decoded;
+}
@@ -0,0 +1,74 @@
+#ifndef _DECODE_H_
+#define _DECODE_H_
+
+/*!
+ * \file decode.h
+ * \brief Pré-décodage du segment de texte en micro-opérations.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "instruction.h"
+#include "uops.h"
+
+//! Indicateurs d'une micro-opération
+typedef enum {
+    DECODED_IMMEDIATE = 0x1, //!< Adressage immédiat
+    DECODED_INDEXED = 0x2, //!< Adressage indexé
+    DECODED_VALID = 0x4, //!< Instruction vérifiée (code opération, mode, condition et adresse absolue légaux)
+} Decoded_Flag;
+
+//! Micro-opération pré-décodée
+/*!
+ * Chaque instruction du segment de texte est traduite une fois pour toutes,
+ * au chargement du programme, dans ce format compact (8 octets) dont tous les
+ * champs sont directement exploitables : plus de champs de bits à extraire à
+ * chaque exécution.
+ *
+ * Le numéro de traitant est la micro-opération spécialisée (voir \link Uop
+ * \endlink) choisie selon le code opération et le mode d'adressage. Les
+ * instructions invalides (code inconnu ou \c ILLOP, valeur immédiate
+ * interdite, condition illégale) reçoivent toutes le traitant \c UOP_FAULT
+ * et n'ont pas l'indicateur \c DECODED_VALID : leur exécution est confiée à
+ * decode_execute(), qui produit exactement la même erreur que l'interpréteur
+ * de référence. Il en va de même des instructions dont l'adresse absolue de
+ * données sort du segment, qui échoueraient à chaque exécution.
+ */
+typedef struct {
+    uint8_t _handler; //!< Numéro du traitant (micro-opération, voir \link Uop \endlink)
+    uint8_t _regcond; //!< Registre destination/source ou condition
+    uint8_t _rindex; //!< Registre d'index
+    uint8_t _flags; //!< Indicateurs (voir \link Decoded_Flag \endlink)
+    int32_t _operand; //!< Valeur immédiate, adresse absolue ou déplacement (étendus sur 32 bits)
+} Decoded;
+
+//! Codes condition satisfaisant chaque condition
+/*!
+ * Pour une condition \c c (voir \link Condition \endlink), le bit \c cc de
+ * \c condition_masks[c] vaut 1 si la condition est vraie lorsque le code
+ * condition vaut \c cc. Le test d'une condition se réduit ainsi à un décalage.
+ */
+extern const uint8_t condition_masks[];
+
+//! Pré-décodage et vérification d'un segment de texte
+/*!
+ * Le pré-décodage vérifie une fois pour toutes ce qui ne dépend pas de
+ * l'exécution : code opération, mode d'adressage, condition, et adresse des
+ * accès absolus au segment de données. Les micro-opérations choisies pour
+ * les instructions vérifiées ne refont pas ces contrôles (voir uops.h).
+ *
+ * Si le segment de données est suivi d'une zone de garde (voir guard.h), les
+ * accès indexés aux données reçoivent les micro-opérations du mode \c G :
+ * les moteurs qui le peuvent laissent alors le matériel détecter les
+ * adresses hors du segment.
+ *
+ * \param textsize taille utile du segment de texte
+ * \param text le contenu du segment de texte
+ * \param datasize taille du segment de données
+ * \param guarded le segment de données est-il gardé ?
+ * \return un tableau (alloué dynamiquement) de \c textsize micro-opérations
+ */
+Decoded *predecode(unsigned textsize, Instruction text[textsize], unsigned datasize, bool guarded);
+
+#endif
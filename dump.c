@@ -0,0 +1,116 @@
+/*!
+ * \file dump.c
+ * \brief Affichage de l'état d'une machine dans un format au choix.
+ */
+
+#include "dump.h"
+#include "output.h"
+#include <string.h>
+
+//! Noms des formats, dans l'ordre de l'énumération Dump_Format
+const char *dump_names[] = {"text", "json", "binary"};
+
+bool dump_from_name(const char *name, Dump_Format *pformat) {
+    for (unsigned f = 0; f <= LAST_DUMP; f++) {
+        if (strcmp(name, dump_names[f]) == 0) {
+            *pformat = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Rédaction d'un tableau JSON de mots (en décimal non signé)
+static void output_json_words(Output *pout, const Word *words, unsigned n) {
+    output_char(pout, '[');
+    for (unsigned i = 0; i < n; i++) {
+        if (i > 0) {
+            output_char(pout, ',');
+        }
+        output_unsigned(pout, words[i]);
+    }
+    output_char(pout, ']');
+}
+
+//! Rédaction d'un champ JSON entier
+static void output_json_field(Output *pout, const char *name, uint32_t value) {
+    output_string(pout, ",\"");
+    output_string(pout, name);
+    output_string(pout, "\":");
+    output_unsigned(pout, value);
+}
+
+//! Rédaction de l'état en JSON.
+
+/*!
+ * \param pout le tampon
+ * \param pmach la machine
+ * \param status l'issue de l'exécution
+ * \param first l'adresse du premier mot de données
+ * \param end l'adresse qui suit le dernier mot de données
+ */
+static void output_json(Output *pout, const Machine *pmach, Simul_Status status,
+        unsigned first, unsigned end) {
+    static const char cc_letters[] = "UZPN";
+    output_string(pout, "{\"status\":\"");
+    output_string(pout, status._err == ERR_NOERROR ? "halt"
+            : status._err <= LAST_ERROR ? error_names[status._err] : "?");
+    output_char(pout, '"');
+    output_json_field(pout, "address", status._addr);
+    output_json_field(pout, "pc", pmach->_pc);
+    output_string(pout, ",\"cc\":\"");
+    output_char(pout, current_cc(pmach) <= LAST_CC ? cc_letters[current_cc(pmach)] : '?');
+    output_string(pout, "\",\"registers\":");
+    output_json_words(pout, pmach->_registers, NREGISTERS);
+    output_json_field(pout, "datasize", pmach->_datasize);
+    output_json_field(pout, "dataend", pmach->_dataend);
+    output_json_field(pout, "first", first);
+    output_string(pout, ",\"data\":");
+    output_json_words(pout, pmach->_data + first, end - first);
+    output_string(pout, "}\n");
+}
+
+//! Rédaction de l'état en binaire (voir dump.h).
+
+/*!
+ * \param pout le tampon
+ * \param pmach la machine
+ * \param status l'issue de l'exécution
+ * \param first l'adresse du premier mot de données
+ * \param end l'adresse qui suit le dernier mot de données
+ */
+static void output_binary(Output *pout, const Machine *pmach, Simul_Status status,
+        unsigned first, unsigned end) {
+    uint32_t header[] = {
+        status._err, status._addr, pmach->_pc, current_cc(pmach),
+    };
+    uint32_t trailer[] = {
+        pmach->_datasize, pmach->_dataend, first, end - first,
+    };
+    output_bytes(pout, header, sizeof header);
+    output_bytes(pout, pmach->_registers, sizeof pmach->_registers);
+    output_bytes(pout, trailer, sizeof trailer);
+    output_bytes(pout, pmach->_data + first, sizeof (Word) * (end - first));
+}
+
+bool print_state(Machine *pmach, Simul_Status status, const Dump_Options *options) {
+    unsigned end = options->_end < pmach->_datasize ? options->_end : pmach->_datasize;
+    unsigned first = options->_first < end ? options->_first : end;
+
+    if (options->_format == DUMP_TEXT) {
+        print_cpu(pmach);
+        print_data_range(pmach, first, end);
+        return ferror(stdout) == 0;
+    }
+
+    Output out;
+    output_init(&out, 256 + 12 * (size_t) (end - first));
+    if (options->_format == DUMP_JSON) {
+        output_json(&out, pmach, status, first, end);
+    } else {
+        output_binary(&out, pmach, status, first, end);
+    }
+    bool ok = output_flush(&out, stdout) && fflush(stdout) == 0;
+    output_free(&out);
+    return ok;
+}
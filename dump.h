@@ -0,0 +1,72 @@
+#ifndef _DUMP_H_
+#define _DUMP_H_
+
+/*!
+ * \file dump.h
+ * \brief Affichage de l'état d'une machine dans un format au choix.
+ *
+ * Outre le texte habituel (print_cpu(), print_data()), l'état final d'une
+ * exécution peut être écrit pour être lu par un autre programme :
+ *
+ *   - en JSON, sur une ligne :
+ * \verbatim
+   {"status":"halt","address":8,"pc":9,"cc":"Z","registers":[50,0,...,19],"datasize":20,"dataend":5,"first":0,"data":[10,5,50,...]}
+   \endverbatim
+ *   (\c status vaut \c "halt" ou le nom de l'erreur, voir \c error_names ;
+ *   les mots sont en décimal non signé) ;
+ *
+ *   - en binaire : une suite de mots de 32 bits dans l'ordre de la machine
+ *   hôte, comme le format de read_program() : l'erreur (0 pour \c HALT),
+ *   l'adresse, \c _pc, \c _cc, les \c NREGISTERS registres, \c _datasize,
+ *   \c _dataend, l'adresse du premier mot de données écrit, le nombre de
+ *   mots écrits, puis ces mots.
+ *
+ * Dans tous les cas on peut n'écrire qu'une partie du segment de données.
+ * Le tout est rédigé dans un tampon (voir output.h) et écrit d'un seul coup.
+ */
+
+#include <stdbool.h>
+
+#include "simulator.h"
+
+//! Format d'affichage de l'état
+typedef enum {
+    DUMP_TEXT = 0, //!< Texte (print_cpu() puis print_data_range())
+    DUMP_JSON, //!< Objet JSON sur une ligne
+    DUMP_BINARY, //!< Mots de 32 bits bruts
+} Dump_Format;
+
+//! Dernière valeur possible du format
+static const unsigned LAST_DUMP = DUMP_BINARY;
+
+//! Forme imprimable des formats (pour l'option \c -O de test_simul)
+extern const char *dump_names[];
+
+//! Recherche d'un format par son nom
+/*!
+ * \param name nom du format (voir \c dump_names)
+ * \param pformat le format trouvé
+ * \return faux si le nom est inconnu
+ */
+bool dump_from_name(const char *name, Dump_Format *pformat);
+
+//! Options d'affichage de l'état
+typedef struct {
+    Dump_Format _format; //!< Format
+    unsigned _first; //!< Adresse du premier mot de données affiché
+    unsigned _end; //!< Adresse qui suit le dernier mot affiché (ramenée à \c _datasize)
+} Dump_Options;
+
+//! Affichage de l'état d'une machine après une exécution
+/*!
+ * En texte, l'issue de l'exécution n'est pas rappelée (le message d'erreur
+ * ou l'avertissement du \c HALT l'ont déjà donnée).
+ *
+ * \param pmach la machine
+ * \param status l'issue de l'exécution (voir simul_run())
+ * \param options le format et la partie du segment de données à écrire
+ * \return faux en cas d'erreur d'écriture sur la sortie standard
+ */
+bool print_state(Machine *pmach, Simul_Status status, const Dump_Options *options);
+
+#endif
@@ -0,0 +1,500 @@
+/*!
+ * \file engine.c
+ * \brief Choix du moteur d'exécution et interpréteur sur micro-opérations.
+ */
+
+#include "engine.h"
+#include "exec.h"
+#include "error.h"
+#include "debug.h"
+#include "smp.h"
+#include "guard.h"
+#include <string.h>
+
+//! Noms des moteurs, dans l'ordre de l'énumération Engine
+const char *engine_names[] = {"switch", "decoded", "threaded", "jit"};
+
+bool engine_from_name(const char *name, Engine *pengine) {
+    for (unsigned e = 0; e <= LAST_ENGINE; e++) {
+        if (strcmp(name, engine_names[e]) == 0) {
+            *pengine = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Traitant spécialisé d'une micro-opération
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param d micro-opération en cours
+ * \param addr adresse de l'instruction en cours
+ * \return faux après l'exécution de \c HALT ; vrai sinon
+ */
+typedef bool (*Uop_Handler)(Machine *pmach, const Decoded *d, unsigned addr);
+
+// Accès à l'état de la machine pour les macros UOP_DO_xxx (voir uops.h)
+#define CUR d
+#define REGS pmach->_registers
+#define CCODE pmach->_cc
+#define CCRESULT pmach->_ccresult
+#define DATA pmach->_data
+#define DATASIZE pmach->_datasize
+#define DATAEND pmach->_dataend
+// L'état est dans la machine : les accès indexés du mode G s'en remettent à
+// la zone de garde, une fois rangées en mémoire les écritures qui précèdent,
+// et signalent au traitant de SIGSEGV la machine qu'ils touchent
+#ifdef __GNUC__
+#define GUARDED 1
+#define GUARD_BARRIER() \
+    do { \
+        guard_access = pmach; \
+        __asm__ __volatile__("" ::: "memory"); \
+    } while (0)
+#define GUARD_END() \
+    do { \
+        __asm__ __volatile__("" ::: "memory"); \
+        guard_access = NULL; \
+    } while (0)
+#define GUARD_CLEAR() (guard_access = NULL)
+#else
+#define GUARDED 0
+#define GUARD_BARRIER()
+#define GUARD_END()
+#define GUARD_CLEAR() ((void) 0)
+#endif
+#define IADDR addr
+#define FAULT(err) \
+    do { \
+        GUARD_CLEAR(); \
+        settle_cc(pmach); \
+        error((err), addr); \
+    } while (0)
+#define JUMP(target) (pmach->_pc = (target))
+#define STOP_HALT() \
+    do { \
+        warning(WARN_HALT, addr); \
+        return false; \
+    } while (0)
+#define INVALID() \
+    do { \
+        settle_cc(pmach); \
+        return decode_execute(pmach, pmach->_text[addr]); \
+    } while (0)
+#define BARRIER_WAIT() smp_barrier(pmach)
+
+// Un traitant par micro-opération, sans aucun test du mode d'adressage
+#define UOP_HANDLER(name, cop, mode) \
+    static bool uop_##name(Machine *pmach, const Decoded *d, unsigned addr) { \
+        UOP_DO_##cop(mode); \
+        return true; \
+    }
+UOP_LIST(UOP_HANDLER)
+#undef UOP_HANDLER
+
+// Passage à l'instruction suivante à l'intérieur d'une superinstruction
+#define NEXT_IN_SEQUENCE() (++d, ++addr, pmach->_pc = addr + 1)
+
+// Un traitant par superinstruction (voir fusion.h)
+#define FUSION3_HANDLER(name, c1, m1, c2, m2, c3, m3) \
+    static bool fused_##name(Machine *pmach, const Decoded *d, unsigned addr) { \
+        pmach->_fusion->_executed[FUSION_INDEX(FUSED_##name)]++; \
+        UOP_DO_##c1(m1); \
+        NEXT_IN_SEQUENCE(); \
+        UOP_DO_##c2(m2); \
+        NEXT_IN_SEQUENCE(); \
+        UOP_DO_##c3(m3); \
+        return true; \
+    }
+#define FUSION2_HANDLER(name, same, c1, m1, c2, m2) \
+    static bool fused_##name(Machine *pmach, const Decoded *d, unsigned addr) { \
+        pmach->_fusion->_executed[FUSION_INDEX(FUSED_##name)]++; \
+        UOP_DO_##c1(m1); \
+        NEXT_IN_SEQUENCE(); \
+        UOP_DO_##c2(m2); \
+        return true; \
+    }
+FUSION3_LIST(FUSION3_HANDLER)
+FUSION2_LIST(FUSION2_HANDLER)
+#undef FUSION3_HANDLER
+#undef FUSION2_HANDLER
+#undef NEXT_IN_SEQUENCE
+
+#undef CUR
+#undef REGS
+#undef CCODE
+#undef CCRESULT
+#undef DATA
+#undef DATASIZE
+#undef DATAEND
+#undef GUARDED
+#undef GUARD_BARRIER
+#undef GUARD_END
+#undef GUARD_CLEAR
+#undef IADDR
+#undef FAULT
+#undef JUMP
+#undef STOP_HALT
+#undef INVALID
+#undef BARRIER_WAIT
+
+//! Table des traitants spécialisés, indexée par micro-opération ou superinstruction
+static const Uop_Handler uop_handlers[] = {
+#define UOP_POINTER(name, cop, mode) [UOP_##name] = uop_##name,
+#define FUSION_POINTER(name, ...) [FUSED_##name] = fused_##name,
+    UOP_LIST(UOP_POINTER)
+    FUSION3_LIST(FUSION_POINTER)
+    FUSION2_LIST(FUSION_POINTER)
+#undef UOP_POINTER
+#undef FUSION_POINTER
+};
+
+bool execute_decoded(Machine *pmach, const Decoded *d) {
+    return uop_handlers[d->_handler](pmach, d, pmach->_pc - 1);
+}
+
+//! Exécution d'une instruction avec trace.
+
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param options le moteur, le niveau de trace, et le profil, l'historique,
+ * le modèle de caches et la trace binaire à remplir (chacun peut être NULL)
+ * \return faux après l'exécution de \c HALT ; vrai sinon
+ */
+static bool step(Machine *pmach, const Simul_Options *options) {
+    Engine engine = options->_engine;
+    Trace_Level level = options->_trace;
+    Profile *pprof = options->_profile;
+    History *phist = options->_history;
+    Trace_Writer *ptw = options->_tracefile;
+    Word registers[NREGISTERS];
+    Condition_Code cc = current_cc(pmach);
+    bool execute;
+
+    if (pmach->_pc >= pmach->_textsize) {
+        error(ERR_SEGTEXT, pmach->_pc);
+    }
+    if (phist != NULL) {
+        record_instruction(phist, pmach, pmach->_pc);
+    }
+    if (options->_cache != NULL) {
+        cache_instruction(options->_cache, pmach, pmach->_pc);
+    }
+    if (ptw != NULL) {
+        begin_trace_record(ptw, pmach, pmach->_pc);
+    }
+    unsigned addr = pmach->_pc++;
+    if (level >= TRACE_REGS) {
+        memcpy(registers, pmach->_registers, sizeof registers);
+    }
+    trace_instruction(level, pmach, pmach->_text[addr], addr);
+    if (engine == ENGINE_SWITCH) {
+        execute = decode_execute(pmach, pmach->_text[addr]);
+    } else {
+        execute = execute_decoded(pmach, &pmach->_decoded[addr]);
+    }
+    if (level >= TRACE_REGS) {
+        trace_registers(pmach, registers, cc);
+    }
+    if (ptw != NULL) {
+        end_trace_record(ptw, pmach);
+    }
+    if (pprof != NULL) {
+        profile_instruction(pprof, addr, pmach->_pc);
+    }
+    return execute;
+}
+
+//! Boucle rapide de l'interpréteur de référence.
+
+/*!
+ * \param pmach la machine en cours d'exécution
+ */
+static void run_switch(Machine *pmach) {
+    do {
+        if (pmach->_pc >= pmach->_textsize) {
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
+        pmach->_pc = pmach->_pc + 1;
+    } while (decode_execute(pmach, pmach->_text[pmach->_pc - 1]));
+}
+
+//! Boucle rapide de l'interpréteur du cache de micro-opérations.
+
+/*!
+ * \param pmach la machine en cours d'exécution
+ */
+static void run_decoded(Machine *pmach) {
+    const Decoded *decoded = pmach->_fusion->_code;
+    do {
+        if (pmach->_pc >= pmach->_textsize) {
+            settle_cc(pmach);
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
+        pmach->_pc = pmach->_pc + 1;
+    } while (execute_decoded(pmach, &decoded[pmach->_pc - 1]));
+}
+
+//! Exécution bornée par l'interpréteur de référence (voir run_budget())
+static bool run_switch_budget(Machine *pmach, uint64_t *pbudget) {
+    for (;;) {
+        if (pmach->_pc >= pmach->_textsize) {
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
+        if (*pbudget == 0) {
+            return true;
+        }
+        --*pbudget;
+        pmach->_pc = pmach->_pc + 1;
+        if (!decode_execute(pmach, pmach->_text[pmach->_pc - 1])) {
+            return false;
+        }
+    }
+}
+
+//! Exécution bornée par l'interpréteur du cache de micro-opérations (voir run_budget())
+/*!
+ * Tant que le tronçon suivant tient dans le budget, il est décompté d'un coup
+ * (voir fuse()) ; les instructions qui restent sont décomptées une par une.
+ */
+static bool run_decoded_budget(Machine *pmach, uint64_t *pbudget) {
+    const Decoded *fused = pmach->_fusion->_code;
+    const unsigned *runs = pmach->_fusion->_runs;
+    for (;;) {
+        if (pmach->_pc >= pmach->_textsize) {
+            settle_cc(pmach);
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
+        unsigned run = runs[pmach->_pc];
+        if (run > *pbudget) {
+            break;
+        }
+        *pbudget -= run;
+        const Decoded *d = &fused[pmach->_pc];
+        const Decoded *end = d + run;
+        do {
+            pmach->_pc = pmach->_pc + 1;
+            if (!execute_decoded(pmach, d)) {
+                return false;
+            }
+            d += handler_length(d->_handler);
+        } while (d < end);
+    }
+    for (;;) {
+        if (pmach->_pc >= pmach->_textsize) {
+            settle_cc(pmach);
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
+        if (*pbudget == 0) {
+            return true;
+        }
+        const Decoded *d = &fused[pmach->_pc];
+        unsigned length = handler_length(d->_handler);
+        if (length > *pbudget) {
+            d = &pmach->_decoded[pmach->_pc];
+            length = 1;
+        }
+        *pbudget -= length;
+        pmach->_pc = pmach->_pc + 1;
+        if (!execute_decoded(pmach, d)) {
+            return false;
+        }
+    }
+}
+
+bool run_budget(Machine *pmach, Engine engine, uint64_t *pbudget) {
+    bool running;
+    switch (engine) {
+        case ENGINE_DECODED:
+            running = run_decoded_budget(pmach, pbudget);
+            break;
+        case ENGINE_THREADED:
+            running = run_threaded_budget(pmach, pbudget);
+            break;
+        case ENGINE_JIT:
+            running = run_jit_budget(pmach, pbudget);
+            break;
+        default:
+            return run_switch_budget(pmach, pbudget);
+    }
+    // Code condition à jour pour l'interpréteur de référence
+    settle_cc(pmach);
+    return running;
+}
+
+//! Exécution sans dialogue jusqu'au prochain arrêt de la mise au point.
+
+/*!
+ * Entre deux arrêts, chaque instruction ne coûte que son exécution et le
+ * test de debug_stop(). Pour \c DEBUG_COUNT sans point d'arrêt posé, rien
+ * n'est à tester entre deux instructions : on passe par run_budget() et le
+ * moteur choisi tourne à pleine vitesse.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param engine le moteur choisi
+ * \param pdbg l'état de la mise au point (mode autre que \c DEBUG_STEP)
+ * \return faux après l'exécution de \c HALT ; vrai sinon
+ */
+static bool run_debug(Machine *pmach, Engine engine, Debugger *pdbg) {
+    if (pdbg->_mode == DEBUG_COUNT && pdbg->_nbreakpoints == 0) {
+        return run_budget(pmach, engine, &pdbg->_count);
+    }
+    for (;;) {
+        if (pmach->_pc >= pmach->_textsize) {
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
+        unsigned addr = pmach->_pc++;
+        bool execute;
+        if (engine == ENGINE_SWITCH) {
+            execute = decode_execute(pmach, pmach->_text[addr]);
+        } else {
+            execute = execute_decoded(pmach, &pmach->_decoded[addr]);
+        }
+        if (!execute) {
+            return false;
+        }
+        if (debug_stop(pdbg, pmach, addr)) {
+            return true;
+        }
+    }
+}
+
+//! Exécution d'une instruction avec trace, sous un piège à erreurs.
+
+/*!
+ * Une erreur rend la main à l'appelant au lieu d'arrêter l'exécution : avec
+ * un historique, la mise au point peut alors revenir en arrière depuis
+ * l'instruction fautive.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param options les options de simulation
+ * \param ptrap le piège (renseigné en cas d'erreur)
+ * \param pexecute renseigné à faux après l'exécution de \c HALT
+ * \return faux en cas d'erreur
+ */
+static bool step_trapped(Machine *pmach, const Simul_Options *options, Error_Trap *ptrap,
+        bool *pexecute) {
+    Error_Trap *volatile previous = NULL;
+    bool completed = false;
+
+    if (setjmp(ptrap->_env) == 0) {
+        previous = set_error_trap(ptrap);
+        *pexecute = step(pmach, options);
+        completed = true;
+    }
+    set_error_trap(previous);
+    return completed;
+}
+
+//! Exécution échantillonnée par tranches, sous un piège à erreurs (voir sample.h).
+
+/*!
+ * Le piège ne sert qu'à désarmer le minuteur avant de signaler l'erreur.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param options les options de simulation (avec un échantillonnage)
+ * \param ptrap le piège (renseigné en cas d'erreur)
+ * \return faux en cas d'erreur
+ */
+static bool run_sampled(Machine *pmach, const Simul_Options *options, Error_Trap *ptrap) {
+    Error_Trap *volatile previous = NULL;
+    Sampler *psamp = options->_sampler;
+    bool completed = false;
+
+    start_sampler(psamp);
+    if (setjmp(ptrap->_env) == 0) {
+        previous = set_error_trap(ptrap);
+        for (;;) {
+            uint64_t budget = sampler_chunk(psamp);
+            if (!run_budget(pmach, options->_engine, &budget)) {
+                break;
+            }
+            sample_machine(psamp, pmach);
+        }
+        completed = true;
+    }
+    set_error_trap(previous);
+    stop_sampler(psamp);
+    return completed;
+}
+
+void simul_engine(Machine *pmach, const Simul_Options *options) {
+    bool debug = options->_debug;
+    History *phist = options->_history;
+    bool stepping = options->_trace != TRACE_OFF || options->_profile != NULL || phist != NULL
+            || options->_cache != NULL || options->_tracefile != NULL;
+    bool execute = true;
+    Debugger dbg;
+    // Sur la pile : pas de fuite si une erreur interrompt l'exécution
+    uint64_t breakpoints[debug ? BREAKPOINT_WORDS(pmach->_textsize) : 1];
+
+    init_debugger(&dbg, breakpoints, debug ? pmach->_textsize : 0);
+    dbg._history = phist;
+
+    // Exécution instruction par instruction tant qu'il faut tracer, dialoguer,
+    // profiler, enregistrer ou simuler les caches ; entre deux arrêts de la
+    // mise au point sans rien de tout cela, exécution sans dialogue
+    while (execute && (debug || stepping)) {
+        bool stop;
+        if (debug && dbg._mode != DEBUG_STEP && !stepping) {
+            execute = run_debug(pmach, options->_engine, &dbg);
+            stop = true;
+        } else if (debug && phist != NULL) {
+            unsigned addr = pmach->_pc;
+            Error_Trap trap = {._warnings = options->_warnings};
+            if (!step_trapped(pmach, options, &trap, &execute)) {
+                // Dialogue sur l'erreur, qui n'est signalée que si l'on ne
+                // revient pas en arrière
+                unsigned length = phist->_length;
+                print_error(trap._err, trap._addr);
+                debug = debug_command(pmach, &dbg);
+                if (phist->_length >= length) {
+                    error_reported(trap._err, trap._addr);
+                }
+                execute = true;
+                continue;
+            }
+            stop = !execute || debug_stop(&dbg, pmach, addr);
+        } else {
+            unsigned addr = pmach->_pc;
+            execute = step(pmach, options);
+            stop = debug && (!execute || debug_stop(&dbg, pmach, addr));
+        }
+        if (stop) {
+            unsigned length = phist != NULL ? phist->_length : 0;
+            debug = debug_command(pmach, &dbg);
+            // Retour en arrière après HALT : l'exécution reprend
+            if (phist != NULL && phist->_length < length) {
+                execute = true;
+            }
+        }
+    }
+    if (!execute) {
+        settle_cc(pmach);
+        return;
+    }
+
+    if (options->_sampler != NULL) {
+        Error_Trap trap = {._warnings = options->_warnings};
+        if (!run_sampled(pmach, options, &trap)) {
+            error(trap._err, trap._addr);
+        }
+        return;
+    }
+
+    switch (options->_engine) {
+        case ENGINE_SWITCH:
+            run_switch(pmach);
+            break;
+        case ENGINE_DECODED:
+            run_decoded(pmach);
+            break;
+        case ENGINE_THREADED:
+            run_threaded(pmach);
+            break;
+        case ENGINE_JIT:
+            run_jit(pmach);
+            break;
+    }
+    settle_cc(pmach);
+}
@@ -0,0 +1,160 @@
+#ifndef _ENGINE_H_
+#define _ENGINE_H_
+
+/*!
+ * \file engine.h
+ * \brief Choix du moteur d'exécution du simulateur.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+#include "exec.h"
+#include "profile.h"
+#include "history.h"
+#include "cache.h"
+#include "sample.h"
+#include "tracefile.h"
+
+//! Moteurs d'exécution
+/*!
+ * Tous les moteurs ont exactement le même comportement visible (état final,
+ * erreurs et adresses d'erreur, trace) ; seule leur vitesse diffère.
+ */
+typedef enum {
+    ENGINE_SWITCH = 0, //!< Interpréteur de référence (simul() et decode_execute())
+    ENGINE_DECODED, //!< Interpréteur sur le cache de micro-opérations pré-décodées
+    ENGINE_THREADED, //!< Interpréteur à enfilage direct (\e computed \e goto de GNU C)
+    ENGINE_JIT, //!< Traduction des blocs de base en code natif x86-64
+} Engine;
+
+//! Dernière valeur possible d'un moteur
+static const unsigned LAST_ENGINE = ENGINE_JIT;
+
+//! Options de simulation
+typedef struct {
+    Engine _engine; //!< Moteur d'exécution
+    Trace_Level _trace; //!< Niveau de trace
+    bool _debug; //!< Mode de mise au point (pas à pas) ?
+    bool _warnings; //!< Avertissements affichés par simul_run() ?
+    Profile *_profile; //!< Profil à remplir (NULL : pas de profilage)
+    History *_history; //!< Historique à remplir (NULL : pas d'enregistrement)
+    Cache_Model *_cache; //!< Modèle de caches à alimenter (NULL : pas de modèle)
+    Sampler *_sampler; //!< Échantillons à relever (NULL : pas d'échantillonnage)
+    Trace_Writer *_tracefile; //!< Trace binaire à remplir (NULL : pas de trace binaire)
+} Simul_Options;
+
+//! Forme imprimable des moteurs (pour l'option \c -e de test_simul)
+extern const char *engine_names[];
+
+//! Recherche d'un moteur par son nom
+/*!
+ * \param name nom du moteur (voir \c engine_names)
+ * \param pengine le moteur trouvé
+ * \return faux si le nom est inconnu
+ */
+bool engine_from_name(const char *name, Engine *pengine);
+
+//! Exécution d'une micro-opération pré-décodée
+/*!
+ * C'est l'équivalent de decode_execute() pour le cache de micro-opérations :
+ * le compteur ordinal a déjà été incrémenté. Si \c d est une superinstruction,
+ * toute la séquence est exécutée.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param d la micro-opération à exécuter (celle de l'adresse \c _pc - 1)
+ * \return faux après l'exécution de \c HALT ; vrai sinon
+ */
+bool execute_decoded(Machine *pmach, const Decoded *d);
+
+//! Exécution jusqu'à \c HALT par l'interpréteur à enfilage direct
+/*!
+ * Les registres, le code condition et le compteur ordinal sont conservés dans
+ * des variables locales pendant toute l'exécution et chaque traitant se
+ * branche directement sur le traitant de l'instruction suivante. L'état de la
+ * machine est recopié dans \c *pmach avant toute erreur et à la fin.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void run_threaded(Machine *pmach);
+
+//! Exécution bornée par l'interpréteur à enfilage direct (voir run_budget())
+bool run_threaded_budget(Machine *pmach, uint64_t *pbudget);
+
+//! Libération des tables de l'interpréteur à enfilage direct
+/*!
+ * Les tables sont construites à la première exécution et conservées dans
+ * \c Machine::_threaded pour les suivantes.
+ *
+ * \param pmach la machine
+ */
+void free_threaded(Machine *pmach);
+
+//! Exécution jusqu'à \c HALT par traduction en code natif
+/*!
+ * Chaque bloc de base est traduit en code x86-64 la première fois qu'il est
+ * exécuté, puis les blocs sont enchaînés directement (voir jit.c). Les
+ * instructions que le traducteur ne traite pas sont exécutées par
+ * execute_decoded() ; sur un autre processeur, c'est tout le programme.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void run_jit(Machine *pmach);
+
+//! Exécution bornée par traduction en code natif (voir run_budget())
+bool run_jit_budget(Machine *pmach, uint64_t *pbudget);
+
+//! Libération du code natif
+/*!
+ * Les blocs traduits et leurs enchaînements sont conservés dans
+ * \c Machine::_jit d'une exécution à l'autre.
+ *
+ * \param pmach la machine
+ */
+void free_jit(Machine *pmach);
+
+//! Exécution d'un nombre borné d'instructions par un moteur
+/*!
+ * Le moteur exécute le programme à partir de l'état courant de la machine,
+ * sans trace ni mise au point, jusqu'au \c HALT ou jusqu'à avoir exécuté
+ * \c *pbudget instructions. Hormis l'interpréteur de référence, les moteurs
+ * ne testent le budget qu'aux branchements : chaque tronçon sans transfert de
+ * contrôle (voir fuse()) ou chaque bloc natif est décompté d'un coup s'il
+ * tient entièrement dans le budget restant ; sinon les instructions restantes
+ * sont exécutées une par une. Les erreurs sont signalées comme par
+ * simul_engine() ; la sortie du segment de texte est signalée dès que le
+ * compteur ordinal y pointe, même si le budget est épuisé. Après une erreur,
+ * \c *pbudget peut compter comme exécuté tout le tronçon ou tout le bloc où
+ * elle s'est produite.
+ *
+ * Les tables de l'interpréteur à enfilage direct et les blocs natifs restent
+ * dans la machine d'un appel à l'autre : des appels répétés avec de petits
+ * budgets ne paient pas de préparation proportionnelle à la taille du texte.
+ *
+ * Les boucles rapides de simul_engine() ne sont pas concernées : elles ne
+ * comptent rien.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param engine le moteur d'exécution
+ * \param pbudget le nombre maximal d'instructions à exécuter, diminué du
+ * nombre d'instructions exécutées
+ * \return faux après l'exécution de \c HALT ; vrai si le budget est épuisé
+ */
+bool run_budget(Machine *pmach, Engine engine, uint64_t *pbudget);
+
+//! Simulation avec un moteur et des options donnés
+/*!
+ * Tant que la trace ou le mode de mise au point sont actifs, ou si un profil,
+ * un historique, un modèle de caches ou une trace binaire est demandé, les
+ * instructions sont exécutées une par une par le moteur choisi. Sinon le
+ * moteur exécute le programme dans sa boucle rapide, qui ne contient aucun
+ * code de trace, de mise au point, de profilage ni de modèle de caches ;
+ * avec un échantillonnage, il l'exécute par tranches (voir sample.h).
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param options le moteur, le niveau de trace et le mode de mise au point
+ */
+void simul_engine(Machine *pmach, const Simul_Options *options);
+
+#endif
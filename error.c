@@ -7,16 +7,36 @@
 #include <stdlib.h>
 #include <math.h>
 
-//! Affichage d'une erreur et fin du simulateur
+//! Piège à erreurs du thread courant (voir set_error_trap())
+#ifdef __GNUC__
+static __thread Error_Trap *current_trap = NULL;
+#else
+static Error_Trap *current_trap = NULL;
+#endif
+
+const char *error_names[] = {
+	[ERR_NOERROR] = "noerror",
+	[ERR_UNKNOWN] = "unknown",
+	[ERR_ILLEGAL] = "illegal",
+	[ERR_CONDITION] = "condition",
+	[ERR_IMMEDIATE] = "immediate",
+	[ERR_SEGTEXT] = "segtext",
+	[ERR_SEGDATA] = "segdata",
+	[ERR_SEGSTACK] = "segstack",
+};
+
+Error_Trap *set_error_trap(Error_Trap *ptrap) {
+	Error_Trap *previous = current_trap;
+	current_trap = ptrap;
+	return previous;
+}
+
+//! Affichage d'une erreur
 /*!
- * \note Toutes les erreurs étant fatales on ne revient jamais de cette
- * fonction. L'attribut \a noreturn est une extension (non standard) de GNU C
- * qui indique ce fait.
- * 
  * \param err code de l'erreur
  * \param addr adresse de l'erreur
  */
-void error(Error err, unsigned addr){
+void print_error(Error err, unsigned addr){
 		printf("ERROR: ");
 		switch (err) {
 		case ERR_NOERROR:
@@ -24,30 +44,58 @@ void error(Error err, unsigned addr){
 			break;
 		case ERR_UNKNOWN:
 			printf("Unknown instruction 0x%04x\n",addr);
-			exit(1);
+			break;
 		case ERR_ILLEGAL:
 			printf("Illegal instruction at address 0x%04x\n",addr);
-			exit(1);
+			break;
 		case ERR_CONDITION:
 			printf("Illegal condition at adress 0x%04x\n",addr);
-			exit(1);
+			break;
 		case ERR_IMMEDIATE:
 			printf("Immediate value forbidden at adress 0x%04x\n",addr);
-			exit(1);
+			break;
 		case ERR_SEGTEXT:
 			printf("Segmentation fault in text at address at 0x%04x\n",addr);
-			exit(1);
+			break;
 		case ERR_SEGDATA:
 			printf("Segmentation fault in Data at adress 0x%04x\n",addr);
-			exit(1);
+			break;
 		case ERR_SEGSTACK:
 			printf("Segmentation fault in stack at adress 0x%04x\n",addr);
-			exit(1);
+			break;
 		default:
-			exit(0);
+			break;
+		}
+}
+
+//! Affichage d'une erreur et fin du simulateur
+/*!
+ * \note Toutes les erreurs étant fatales on ne revient jamais de cette
+ * fonction. L'attribut \a noreturn est une extension (non standard) de GNU C
+ * qui indique ce fait.
+ * 
+ * \param err code de l'erreur
+ * \param addr adresse de l'erreur
+ */
+void error(Error err, unsigned addr){
+		if (current_trap != NULL) {
+			current_trap->_err = err;
+			current_trap->_addr = addr;
+			current_trap->_reported = false;
+			longjmp(current_trap->_env, 1);
 		}
-		exit(0);
-		
+		print_error(err, addr);
+		exit(err > ERR_NOERROR && err <= LAST_ERROR ? 1 : 0);
+}
+
+void error_reported(Error err, unsigned addr){
+		if (current_trap != NULL) {
+			current_trap->_err = err;
+			current_trap->_addr = addr;
+			current_trap->_reported = true;
+			longjmp(current_trap->_env, 1);
+		}
+		exit(err > ERR_NOERROR && err <= LAST_ERROR ? 1 : 0);
 }
 
 //! Affichage d'un avertissement
@@ -56,6 +104,17 @@ void error(Error err, unsigned addr){
  * \param addr adresse de l'erreur
  */
 void warning(Warning warn, unsigned addr){
+	if (current_trap == NULL || current_trap->_warnings) {
+		print_warning(warn, addr);
+	}
+}
+
+//! Affichage d'un avertissement, même si un piège est posé
+/*!
+ * \param warn code de l'avertissement
+ * \param addr adresse de l'erreur
+ */
+void print_warning(Warning warn, unsigned addr){
 	printf("WARNING: ");
 	if(warn ==  WARN_HALT){
 	printf("HALT reached at address at 0x%04x\n",addr);
@@ -2,6 +2,8 @@
 #define _ERROR_H_
 
 #include <stdlib.h>
+#include <setjmp.h>
+#include <stdbool.h>
 
 /*!
  * \file error.h
@@ -13,7 +15,7 @@
  * Ce sont les différentes sortes d'erreur rencontrées lors du décodage ou de
  * l'exécution des instructions. Elles sont toutes fatales et provoquent la
  * terminaison du programme (du programme simulé comme du simulateur lui-même
- * !).
+ * !), sauf si un piège est posé (voir \link Error_Trap \endlink).
  */
 typedef enum 
 {
@@ -30,6 +32,9 @@ typedef enum
 //! Dernière valeur possible du code d'erreur
 static const unsigned LAST_ERROR = ERR_SEGSTACK;
 
+//! Forme imprimable et brève des erreurs (pour les résultats lus par programme)
+extern const char *error_names[];
+
 //! Codes d'avertissement
 /*!
  * Ce sont de simples messages informatifs qui ne provoquent pas la terminaison
@@ -59,6 +64,68 @@ void error(Error err, unsigned addr);
 #endif
 
 
+//! Piège à erreurs d'exécution
+/*!
+ * Tant qu'un piège est posé par un thread (voir set_error_trap()), error()
+ * appelée par ce thread n'affiche rien et ne termine pas le simulateur : elle
+ * enregistre l'erreur dans le piège et reprend l'exécution au setjmp() du
+ * piège. warning() n'affiche rien non plus, sauf si \c _warnings est vrai :
+ * c'est à celui qui a posé le piège de rendre compte de la fin du programme.
+ * Le code qui appelle error() ne reprend donc pas la main : il ne doit tenir
+ * aucune ressource locale, et doit avoir rangé l'état de la machine (voir
+ * simulator.h).
+ *
+ * \code
+ * Error_Trap trap;
+ * if (setjmp(trap._env) == 0) {
+ *     set_error_trap(&trap);
+ *     simul_engine(&mach, &options);
+ * } else {
+ *     // Erreur trap._err à l'adresse trap._addr
+ * }
+ * set_error_trap(NULL);
+ * \endcode
+ */
+typedef struct {
+    jmp_buf _env; //!< Point de reprise (voir setjmp())
+    Error _err; //!< Erreur survenue
+    unsigned _addr; //!< Adresse de l'erreur
+    bool _warnings; //!< Avertissements affichés malgré le piège ?
+    bool _reported; //!< Erreur déjà affichée (voir error_reported()) ?
+} Error_Trap;
+
+//! Pose (ou retrait) du piège à erreurs du thread courant
+/*!
+ * \param ptrap le piège, ou NULL pour revenir au comportement par défaut
+ * (affichage et fin du simulateur)
+ * \return le piège précédent (à reposer ensuite si les pièges s'emboîtent)
+ */
+Error_Trap *set_error_trap(Error_Trap *ptrap);
+
+//! Erreur déjà affichée par print_error(), et fin du simulateur
+/*!
+ * Comme error(), mais le message n'est pas affiché une deuxième fois : sans
+ * piège, le simulateur se termine en silence ; avec un piège, l'erreur y est
+ * notée comme déjà affichée (\c _reported).
+ *
+ * \param err code de l'erreur
+ * \param addr adresse de l'erreur
+ */
+#ifdef __GNUC__
+void error_reported(Error err, unsigned addr) __attribute__((noreturn));
+#else
+void error_reported(Error err, unsigned addr);
+#endif
+
+//! Affichage d'une erreur, sans fin du simulateur
+/*!
+ * C'est le message qu'afficherait error() en l'absence de piège.
+ *
+ * \param err code de l'erreur
+ * \param addr adresse de l'erreur
+ */
+void print_error(Error err, unsigned addr);
+
 //! Affichage d'un avertissement
 /*!
  * \param warn code de l'avertissement
@@ -66,4 +133,11 @@ void error(Error err, unsigned addr);
  */
 void warning(Warning warn, unsigned addr);
 
+//! Affichage d'un avertissement, même si un piège est posé
+/*!
+ * \param warn code de l'avertissement
+ * \param addr adresse de l'erreur
+ */
+void print_warning(Warning warn, unsigned addr);
+
 #endif
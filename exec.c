@@ -5,7 +5,15 @@
 
 #include "exec.h"
 #include "error.h"
+#include "smp.h"
 #include <stdio.h>
+#include <string.h>
+
+//! Noms des niveaux de trace, dans l'ordre de l'énumération Trace_Level
+const char *trace_names[] = {"off", "branches", "all", "regs"};
+
+//! Forme imprimable du code condition
+static const char cc_names[] = {[CC_U] = 'U', [CC_Z] = 'Z', [CC_P] = 'P', [CC_N] = 'N'};
 
 //! retourne True si l'instruction est immédiate sinon false.
 
@@ -281,6 +289,44 @@ static bool pop(Machine *pmach, Instruction instr, unsigned addr) {
     return true;
 }
 
+//! Décodage et exécution de l'instruction XADD.
+//! Adressage absolu et indexé pour le mot de données.
+//! Le registre reçoit l'ancienne valeur du mot, qui reçoit la somme.
+
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param instr instruction en cours
+ * \param addr adresse de l'instruction en cours
+ */
+static bool xadd(Machine *pmach, Instruction instr, unsigned addr) {
+    check_immediate(instr, addr); // vérifie que l'on est pas en immédiat, sinon erreur
+    unsigned int address = get_address(pmach, instr);
+    check_seg_data(pmach, address, addr);
+    Word *preg = &pmach->_registers[instr.instr_generic._regcond];
+    *preg = fetch_add_word(&pmach->_data[address], *preg); // indivisible pour les autres cœurs
+    change_cc(pmach, *preg);
+    return true;
+}
+
+//! Décodage et exécution de l'instruction XCHG.
+//! Adressage absolu et indexé pour le mot de données.
+//! Le registre et le mot échangent leurs valeurs.
+
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param instr instruction en cours
+ * \param addr adresse de l'instruction en cours
+ */
+static bool xchg(Machine *pmach, Instruction instr, unsigned addr) {
+    check_immediate(instr, addr); // vérifie que l'on est pas en immédiat, sinon erreur
+    unsigned int address = get_address(pmach, instr);
+    check_seg_data(pmach, address, addr);
+    Word *preg = &pmach->_registers[instr.instr_generic._regcond];
+    *preg = exchange_word(&pmach->_data[address], *preg); // indivisible pour les autres cœurs
+    change_cc(pmach, *preg);
+    return true;
+}
+
 bool decode_execute(Machine *pmach, Instruction instr) {
     switch (instr.instr_generic._cop) {
         case ILLOP:
@@ -308,6 +354,13 @@ bool decode_execute(Machine *pmach, Instruction instr) {
         case HALT:
             warning(WARN_HALT, pmach->_pc - 1);
             return false;
+        case XADD:
+            return xadd(pmach, instr, pmach->_pc - 1);
+        case XCHG:
+            return xchg(pmach, instr, pmach->_pc - 1);
+        case BARRIER:
+            smp_barrier(pmach);
+            return true;
         default:
             error(ERR_UNKNOWN, pmach->_pc - 1);
     }
@@ -318,3 +371,38 @@ void trace(const char *msg, Machine *pmach, Instruction instr, unsigned addr) {
     print_instruction(instr, addr);
     printf("\n");
 }
+
+bool trace_from_name(const char *name, Trace_Level *plevel) {
+    for (unsigned l = 0; l <= LAST_TRACE; l++) {
+        if (strcmp(name, trace_names[l]) == 0) {
+            *plevel = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+void trace_instruction(Trace_Level level, Machine *pmach, Instruction instr, unsigned addr) {
+    switch (level) {
+        case TRACE_OFF:
+            return;
+        case TRACE_BRANCHES:
+            if (instr.instr_generic._cop != BRANCH && instr.instr_generic._cop != CALL && instr.instr_generic._cop != RET)
+                return;
+            break;
+        default:
+            break;
+    }
+    trace("TRACE: Executing:", pmach, instr, addr);
+}
+
+void trace_registers(Machine *pmach, const Word registers[NREGISTERS], Condition_Code cc) {
+    for (int i = 0; i < NREGISTERS; i++) {
+        if (registers[i] != pmach->_registers[i]) {
+            printf("TRACE:\tR%02d 0x%08X -> 0x%08X %d\n", i, registers[i], pmach->_registers[i], pmach->_registers[i]);
+        }
+    }
+    if (cc != current_cc(pmach)) {
+        printf("TRACE:\tCC %c -> %c\n", cc_names[cc], cc_names[current_cc(pmach)]);
+    }
+}
@@ -16,6 +16,60 @@
  */
 bool decode_execute(Machine *pmach, Instruction instr);
 
+//! Code condition correspondant au résultat d'une opération
+/*!
+ * Cette classification est celle de change_cc() et de sign_class(), par
+ * laquelle les moteurs rapides déduisent le code condition du dernier
+ * résultat ; le code C produit par aot l'utilise directement.
+ *
+ * \param value le résultat (contenu du registre destination)
+ * \return le code condition correspondant
+ */
+static inline Condition_Code cc_of(Word value) {
+    if (value < 0) {
+        return CC_N;
+    } else if (value > 0) {
+        return CC_P;
+    }
+    return CC_Z;
+}
+
+//! Échange-addition atomique d'un mot de données (instruction \c XADD)
+/*!
+ * Les cœurs d'un multiprocesseur (voir smp.h) partagent le segment de
+ * données : l'opération est indivisible pour tous les moteurs et le code C
+ * produit par aot.
+ *
+ * \param pword le mot
+ * \param value la valeur à lui ajouter
+ * \return la valeur du mot avant l'addition
+ */
+static inline Word fetch_add_word(Word *pword, Word value) {
+#ifdef __GNUC__
+    return __sync_fetch_and_add(pword, value);
+#else
+    Word old = *pword;
+    *pword = old + value;
+    return old;
+#endif
+}
+
+//! Échange atomique d'un mot de données (instruction \c XCHG)
+/*!
+ * \param pword le mot
+ * \param value sa nouvelle valeur
+ * \return la valeur du mot avant l'échange
+ */
+static inline Word exchange_word(Word *pword, Word value) {
+#ifdef __GNUC__
+    return __atomic_exchange_n(pword, value, __ATOMIC_SEQ_CST);
+#else
+    Word old = *pword;
+    *pword = value;
+    return old;
+#endif
+}
+
 //! Trace de l'exécution
 /*!
  * On écrit l'adresse et l'instruction sous forme lisible.
@@ -27,4 +81,47 @@ bool decode_execute(Machine *pmach, Instruction instr);
  */
 void trace(const char *msg, Machine *pmach, Instruction instr, unsigned addr);
 
+//! Niveaux de trace
+typedef enum {
+    TRACE_OFF = 0, //!< Aucune trace
+    TRACE_BRANCHES, //!< Seulement les ruptures de séquence (BRANCH, CALL, RET)
+    TRACE_ALL, //!< Toutes les instructions
+    TRACE_REGS, //!< Toutes les instructions et les registres modifiés
+} Trace_Level;
+
+//! Dernière valeur possible d'un niveau de trace
+static const unsigned LAST_TRACE = TRACE_REGS;
+
+//! Forme imprimable des niveaux de trace (pour l'option \c -t de test_simul)
+extern const char *trace_names[];
+
+//! Recherche d'un niveau de trace par son nom
+/*!
+ * \param name nom du niveau (voir \c trace_names)
+ * \param plevel le niveau trouvé
+ * \return faux si le nom est inconnu
+ */
+bool trace_from_name(const char *name, Trace_Level *plevel);
+
+//! Trace d'une instruction selon le niveau de trace
+/*!
+ * Appelée avant l'exécution de l'instruction.
+ *
+ * \param level le niveau de trace
+ * \param pmach la machine en cours d'exécution
+ * \param instr l'instruction à exécuter
+ * \param addr son adresse
+ */
+void trace_instruction(Trace_Level level, Machine *pmach, Instruction instr, unsigned addr);
+
+//! Trace des registres modifiés par une instruction
+/*!
+ * Appelée après l'exécution de l'instruction, au niveau \c TRACE_REGS.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param registers les registres avant l'exécution
+ * \param cc le code condition avant l'exécution
+ */
+void trace_registers(Machine *pmach, const Word registers[NREGISTERS], Condition_Code cc);
+
 #endif
@@ -0,0 +1,137 @@
+/*!
+ * \file fusion.c
+ * \brief Superinstructions : fusion de séquences fréquentes d'instructions.
+ */
+
+#include "fusion.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Noms des superinstructions
+const char *fusion_names[] = {
+#define FUSION_NAME(name, ...) #name,
+    FUSION3_LIST(FUSION_NAME)
+    FUSION2_LIST(FUSION_NAME)
+#undef FUSION_NAME
+};
+
+//! Longueur des superinstructions
+const unsigned fusion_lengths[] = {
+#define FUSION_LENGTH3(name, ...) 3,
+#define FUSION_LENGTH2(name, ...) 2,
+    FUSION3_LIST(FUSION_LENGTH3)
+    FUSION2_LIST(FUSION_LENGTH2)
+#undef FUSION_LENGTH3
+#undef FUSION_LENGTH2
+};
+
+//! Motif reconnu par une superinstruction
+typedef struct {
+    Fused _fused; //!< Superinstruction
+    bool _same_register; //!< Les instructions doivent porter sur le même registre ?
+    uint8_t _uops[3]; //!< Micro-opérations de la séquence
+} Pattern;
+
+//! Motifs, les plus longs d'abord
+static const Pattern patterns[] = {
+#define PATTERN3(name, c1, m1, c2, m2, c3, m3) \
+    {FUSED_##name, false, {UOP_##c1##_##m1, UOP_##c2##_##m2, UOP_##c3##_##m3}},
+#define PATTERN2(name, same, c1, m1, c2, m2) \
+    {FUSED_##name, same, {UOP_##c1##_##m1, UOP_##c2##_##m2}},
+    FUSION3_LIST(PATTERN3)
+    FUSION2_LIST(PATTERN2)
+#undef PATTERN3
+#undef PATTERN2
+};
+
+//! Vrai si la séquence commençant en \c decoded correspond au motif.
+
+/*!
+ * \param pattern le motif
+ * \param decoded les micro-opérations à partir de l'adresse examinée
+ * \param remaining nombre d'instructions restant dans le texte à partir de cette adresse
+ */
+static bool match(const Pattern *pattern, const Decoded decoded[], unsigned remaining) {
+    unsigned length = fusion_lengths[FUSION_INDEX(pattern->_fused)];
+    if (length > remaining) {
+        return false;
+    }
+    for (unsigned i = 0; i < length; i++) {
+        if (decoded[i]._handler != pattern->_uops[i]) {
+            return false;
+        }
+        if (pattern->_same_register && decoded[i]._regcond != decoded[0]._regcond) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Vrai si la micro-opération termine un tronçon (transfert de contrôle ou fin)
+static bool ends_run(unsigned uop) {
+    switch (uop) {
+        case UOP_BRANCH_A:
+        case UOP_BRANCH_X:
+        case UOP_CALL_A:
+        case UOP_CALL_X:
+        case UOP_RET:
+        case UOP_HALT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Fusion *fuse(unsigned textsize, const Decoded decoded[textsize]) {
+    Fusion *pfusion = calloc(1, sizeof (Fusion));
+    Decoded *code = malloc(sizeof (Decoded) * (textsize > 0 ? textsize : 1));
+    unsigned *runs = malloc(sizeof (unsigned) * (textsize + 1));
+    if (pfusion == NULL || code == NULL || runs == NULL) {
+        perror("fusion");
+        exit(1);
+    }
+    memcpy(code, decoded, sizeof (Decoded) * textsize);
+    pfusion->_code = code;
+
+    // Tronçons, de la fin du texte vers le début
+    runs[textsize] = 0;
+    for (unsigned addr = textsize; addr-- > 0;) {
+        runs[addr] = ends_run(decoded[addr]._handler) ? 1 : runs[addr + 1] + 1;
+    }
+    pfusion->_runs = runs;
+
+    // Les séquences reconnues ne se chevauchent pas
+    for (unsigned addr = 0; addr < textsize; addr++) {
+        for (unsigned p = 0; p < sizeof patterns / sizeof patterns[0]; p++) {
+            if (match(&patterns[p], &decoded[addr], textsize - addr)) {
+                unsigned index = FUSION_INDEX(patterns[p]._fused);
+                code[addr]._handler = patterns[p]._fused;
+                pfusion->_sites[index]++;
+                addr += fusion_lengths[index] - 1;
+                break;
+            }
+        }
+    }
+    return pfusion;
+}
+
+void free_fusion(Fusion *pfusion) {
+    if (pfusion != NULL) {
+        free(pfusion->_code);
+        free(pfusion->_runs);
+        free(pfusion);
+    }
+}
+
+void print_fusion(const Fusion *pfusion) {
+    printf("\n\n*** SUPERINSTRUCTIONS ***\n\n");
+    printf("%-24s %8s %12s %14s\n", "name", "sites", "executed", "instructions");
+    for (unsigned i = 0; i < NFUSIONS; i++) {
+        if (pfusion->_sites[i] > 0) {
+            printf("%-24s %8u %12llu %14llu\n", fusion_names[i], pfusion->_sites[i],
+                    (unsigned long long) pfusion->_executed[i],
+                    (unsigned long long) pfusion->_executed[i] * fusion_lengths[i]);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef _FUSION_H_
+#define _FUSION_H_
+
+/*!
+ * \file fusion.h
+ * \brief Superinstructions : fusion de séquences fréquentes d'instructions.
+ *
+ * Les programmes simulés sont pleins d'idiomes figés : \c SUB suivi d'un
+ * \c BRANCH en fin de boucle, \c LOAD puis \c ADD sur le même registre,
+ * \c PUSH, \c PUSH, \c CALL pour appeler un sous-programme... Au chargement,
+ * on repère ces séquences et, dans la représentation d'exécution des moteurs
+ * rapides, on remplace la micro-opération de la première instruction par une
+ * superinstruction qui exécute toute la séquence avec un seul traitant.
+ *
+ * Les instructions suivantes de la séquence gardent leur propre
+ * micro-opération : un branchement au milieu d'une séquence reste correct. À
+ * l'intérieur d'une superinstruction, chaque instruction est exécutée avec sa
+ * propre adresse : le compteur ordinal et l'adresse des erreurs sont ceux de
+ * l'exécution non fusionnée. Le pas à pas (trace, mise au point) utilise
+ * toujours les micro-opérations non fusionnées.
+ */
+
+#include <stdint.h>
+
+#include "decode.h"
+
+//! Superinstructions de deux instructions : DEF(nom, même registre ?, cop1, mode1, cop2, mode2)
+/*!
+ * Si le deuxième paramètre est vrai, les deux instructions doivent porter sur
+ * le même registre. Les modes sont ceux de \c UOP_LIST.
+ *
+ * Les modes \c X et \c G ne se mêlent pas : predecode() traduit tous les
+ * accès indexés d'un programme en mode \c G si son segment de données est
+ * gardé, aucun sinon. \c LOAD_X_ADD_G et \c LOAD_G_ADD_X ne pourraient donc
+ * jamais être reconnues ; elles ne sont pas définies.
+ */
+#define FUSION2_LIST(DEF) \
+    DEF(SUB_I_BRANCH_A, false, SUB, I, BRANCH, A) \
+    DEF(ADD_I_BRANCH_A, false, ADD, I, BRANCH, A) \
+    DEF(LOAD_A_ADD_I, true, LOAD, A, ADD, I) \
+    DEF(LOAD_A_ADD_A, true, LOAD, A, ADD, A) \
+    DEF(LOAD_A_ADD_X, true, LOAD, A, ADD, X) \
+    DEF(LOAD_X_ADD_I, true, LOAD, X, ADD, I) \
+    DEF(LOAD_X_ADD_A, true, LOAD, X, ADD, A) \
+    DEF(LOAD_X_ADD_X, true, LOAD, X, ADD, X) \
+    DEF(LOAD_A_ADD_G, true, LOAD, A, ADD, G) \
+    DEF(LOAD_G_ADD_I, true, LOAD, G, ADD, I) \
+    DEF(LOAD_G_ADD_A, true, LOAD, G, ADD, A) \
+    DEF(LOAD_G_ADD_G, true, LOAD, G, ADD, G)
+
+//! Superinstructions de trois instructions : DEF(nom, cop1, mode1, cop2, mode2, cop3, mode3)
+#define FUSION3_LIST(DEF) \
+    DEF(PUSH_I_PUSH_I_CALL_A, PUSH, I, PUSH, I, CALL, A) \
+    DEF(PUSH_A_PUSH_A_CALL_A, PUSH, A, PUSH, A, CALL, A) \
+    DEF(PUSH_X_PUSH_X_CALL_A, PUSH, X, PUSH, X, CALL, A) \
+    DEF(PUSH_G_PUSH_G_CALL_A, PUSH, G, PUSH, G, CALL, A)
+
+//! Superinstructions
+/*!
+ * Leurs numéros suivent ceux des micro-opérations (voir \link Uop \endlink) :
+ * un numéro de traitant (\c Decoded::_handler) désigne l'une ou l'autre.
+ */
+typedef enum {
+    FUSED_BASE = UOP_HALT, //!< Dernière micro-opération (ce n'est pas une superinstruction)
+#define FUSION_ENUM(name, ...) FUSED_##name,
+    FUSION3_LIST(FUSION_ENUM)
+    FUSION2_LIST(FUSION_ENUM)
+#undef FUSION_ENUM
+    FUSED_END, //!< Après la dernière superinstruction
+} Fused;
+
+//! Nombre de superinstructions
+#define NFUSIONS (FUSED_END - FUSED_BASE - 1)
+
+//! Indice d'une superinstruction dans les tableaux de Fusion
+#define FUSION_INDEX(fused) ((fused) - FUSED_BASE - 1)
+
+//! Superinstructions d'un programme
+typedef struct {
+    Decoded *_code; //!< Représentation d'exécution : micro-opérations et superinstructions
+    unsigned _sites[NFUSIONS]; //!< Nombre d'occurrences de chaque superinstruction dans le texte
+    uint64_t _executed[NFUSIONS]; //!< Nombre d'exécutions de chaque superinstruction
+    unsigned *_runs; //!< Instructions de chaque adresse jusqu'au prochain transfert de contrôle inclus (voir fuse())
+} Fusion;
+
+//! Forme imprimable des superinstructions (indexée par FUSION_INDEX())
+extern const char *fusion_names[];
+
+//! Longueur des superinstructions (indexée par FUSION_INDEX())
+extern const unsigned fusion_lengths[];
+
+//! Nombre d'instructions exécutées par un traitant
+/*!
+ * \param handler une micro-opération ou une superinstruction
+ * \return 1 pour une micro-opération, la longueur de la séquence pour une
+ * superinstruction
+ */
+static inline unsigned handler_length(unsigned handler) {
+    return handler > FUSED_BASE ? fusion_lengths[FUSION_INDEX(handler)] : 1;
+}
+
+//! Recherche des superinstructions d'un programme pré-décodé
+/*!
+ * Calcule aussi la longueur des tronçons sans transfert de contrôle :
+ * depuis chaque adresse, le nombre d'instructions jusqu'au premier
+ * \c BRANCH, \c CALL, \c RET ou \c HALT inclus, ou jusqu'à la fin du texte.
+ * Une fois entrée dans un tronçon, l'exécution en parcourt toutes les
+ * instructions (ou s'arrête sur une erreur) : l'exécution bornée (voir
+ * run_budget()) décompte le tronçon d'un coup et ne teste son budget qu'aux
+ * branchements.
+ *
+ * \param textsize taille utile du segment de texte
+ * \param decoded les micro-opérations du programme (voir predecode())
+ * \return les superinstructions (allouées dynamiquement, voir free_fusion())
+ */
+Fusion *fuse(unsigned textsize, const Decoded decoded[textsize]);
+
+//! Libération des superinstructions
+/*!
+ * \param pfusion les superinstructions à libérer (ou NULL)
+ */
+void free_fusion(Fusion *pfusion);
+
+//! Rapport sur les superinstructions
+/*!
+ * Pour chaque superinstruction présente dans le programme : nombre
+ * d'occurrences dans le texte, nombre d'exécutions et nombre d'instructions
+ * exécutées qu'elle a couvertes.
+ *
+ * \param pfusion les superinstructions du programme
+ */
+void print_fusion(const Fusion *pfusion);
+
+#endif
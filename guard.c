@@ -0,0 +1,145 @@
+/*!
+ * \file guard.c
+ * \brief Zone de garde du segment de données : accès indexés sans contrôle.
+ */
+
+#define _DEFAULT_SOURCE // Pour MAP_ANONYMOUS, sigaction() et SA_SIGINFO
+
+#include "guard.h"
+#include "error.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//! Nombre maximal de machines gardées simultanément
+#define MAX_GUARDED 256
+
+//! Inscription d'une machine gardée
+/*!
+ * Comme les suivis de snapshot.c, les inscriptions sont dans un tableau
+ * statique : le traitant de \c SIGSEGV les parcourt sans verrou. Une
+ * inscription est active quand \c _start n'est pas NULL ; ses autres champs
+ * sont remplis avant.
+ */
+struct Guard {
+    volatile int _busy; //!< Inscription attribuée ?
+    char *volatile _start; //!< Début de la zone de garde, NULL si inactive
+    size_t _size; //!< Taille de la zone de garde
+    Machine *_pmach; //!< La machine
+};
+
+//! Les inscriptions (voir struct Guard)
+static struct Guard guards[MAX_GUARDED];
+
+#ifdef __GNUC__
+__thread Machine *guard_access = NULL;
+#endif
+
+//! Action de \c SIGSEGV avant l'installation de notre traitant
+static struct sigaction previous_action;
+
+//! Installation du traitant (une seule fois)
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+//! Traitant de \c SIGSEGV : accès hors du segment de données d'une machine gardée.
+/*!
+ * Seule une faute dans la zone de garde de la machine à laquelle
+ * l'interpréteur accède (\c guard_access) est traduite : son compteur
+ * ordinal est alors à jour. L'erreur est déclenchée depuis le traitant (voir
+ * les limites dans guard.h) : \c SIGSEGV, bloqué pendant son exécution, est
+ * d'abord débloqué, car error() n'en revient pas.
+ */
+static void on_guard_fault(int sig, siginfo_t *info, void *context) {
+#ifdef __GNUC__
+    char *addr = info->si_addr;
+    Machine *pmach = guard_access;
+
+    for (unsigned i = 0; pmach != NULL && i < MAX_GUARDED; i++) {
+        char *start = guards[i]._start;
+        if (start != NULL && guards[i]._pmach == pmach
+                && addr >= start && addr < start + guards[i]._size) {
+            sigset_t set;
+            guard_access = NULL;
+            sigemptyset(&set);
+            sigaddset(&set, SIGSEGV);
+            pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+            error(ERR_SEGDATA, pmach->_pc - 1);
+        }
+    }
+#endif
+    // Faute étrangère : traitant précédent, ou action par défaut à la reprise
+    if ((previous_action.sa_flags & SA_SIGINFO) != 0) {
+        previous_action.sa_sigaction(sig, info, context);
+    } else if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN) {
+        previous_action.sa_handler(sig);
+    } else {
+        sigaction(SIGSEGV, &previous_action, NULL);
+    }
+}
+
+//! Installation du traitant de \c SIGSEGV
+static void init_guard(void) {
+    struct sigaction action;
+
+    memset(&action, 0, sizeof action);
+    action.sa_sigaction = on_guard_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous_action);
+}
+
+Word *map_guarded(size_t length, Mapping *pdatamap, Mapping *pguardmap) {
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    size_t lead = (pagesize - length % pagesize) % pagesize;
+    size_t size = lead + length;
+
+    if (GUARD_SIZE == 0) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // Tout est réservé inaccessible, puis le segment est ouvert
+    char *start = mmap(NULL, size + GUARD_SIZE, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED) {
+        return NULL;
+    }
+    if (mprotect(start, size, PROT_READ | PROT_WRITE) != 0) {
+        int saved = errno;
+        munmap(start, size + GUARD_SIZE);
+        errno = saved;
+        return NULL;
+    }
+    *pdatamap = (Mapping) {start, size};
+    *pguardmap = (Mapping) {start + size, GUARD_SIZE};
+    return (Word *) (start + lead);
+}
+
+bool guard_machine(Machine *pmach) {
+    pthread_once(&once, init_guard);
+    for (unsigned i = 0; i < MAX_GUARDED; i++) {
+        struct Guard *pguard = &guards[i];
+        if (!__sync_bool_compare_and_swap(&pguard->_busy, 0, 1)) {
+            continue;
+        }
+        pguard->_size = pmach->_guardmap._size;
+        pguard->_pmach = pmach;
+        __sync_synchronize();
+        pguard->_start = pmach->_guardmap._addr;
+        return true;
+    }
+    return false;
+}
+
+void unguard_machine(Machine *pmach) {
+    for (unsigned i = 0; i < MAX_GUARDED; i++) {
+        struct Guard *pguard = &guards[i];
+        if (pguard->_start != NULL && pguard->_pmach == pmach) {
+            pguard->_start = NULL;
+            __sync_synchronize();
+            pguard->_busy = 0;
+        }
+    }
+}
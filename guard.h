@@ -0,0 +1,101 @@
+#ifndef _GUARD_H_
+#define _GUARD_H_
+
+/*!
+ * \file guard.h
+ * \brief Zone de garde du segment de données : accès indexés sans contrôle.
+ *
+ * Une adresse indexée (registre plus déplacement) est un entier non signé de
+ * 32 bits : l'accès à un mot d'adresse quelconque tombe au plus 2^32 mots
+ * après le début du segment de données. Quand read_program() place le
+ * segment de façon qu'il finisse exactement sur une fin de page, et le fait
+ * suivre d'une zone réservée de cette taille, inaccessible, toute adresse qui
+ * dépasse le segment (voir check_seg_data()) provoque un \c SIGSEGV dans la
+ * zone de garde, et aucune autre n'en provoque.
+ *
+ * Le traitant de \c SIGSEGV installé par ce module reconnaît une faute
+ * dans la zone de garde d'une machine inscrite, survenue pendant un accès
+ * non contrôlé de l'interpréteur du cache de micro-opérations à cette même
+ * machine (voir \c guard_access), et déclenche l'erreur \c ERR_SEGDATA à
+ * l'adresse de l'instruction en cours, \c _pc - 1, comme le contrôle qu'il
+ * remplace. Les micro-opérations du mode \c G (voir uops.h) peuvent donc
+ * omettre ce contrôle, à condition que l'état de la machine soit en mémoire
+ * au moment de l'accès : c'est le cas de cet interpréteur, pas du moteur à
+ * enfilage, du JIT ni des voies SIMD, qui gardent leurs registres et leur
+ * compteur ordinal ailleurs et leurs contrôles. Une faute survenue hors d'un
+ * tel accès, même dans une zone de garde, est confiée au traitant installé
+ * auparavant.
+ *
+ * Le traitant est installé pour tout le processus à la première
+ * inscription, et seulement si une zone de garde est demandée (voir
+ * \c _guard dans \link Memory_Options \endlink) : test_simul et lockstep la
+ * demandent, une application qui embarque le simulateur ne l'a que si elle
+ * la demande aussi.
+ *
+ * Limites : error() n'est pas sûre dans un traitant de signal (\c printf,
+ * \c exit, \c longjmp vers le piège à erreurs du thread, voir
+ * set_error_trap()). Le traitant l'appelle néanmoins, comme le ferait le code
+ * fautif, parce que la faute est synchrone : elle vient d'une lecture ou
+ * d'une écriture de l'interpréteur, entre deux appels de bibliothèque, sans
+ * verrou tenu ni structure de la bibliothèque C à moitié modifiée. Cela ne
+ * vaut que pour ces fautes-là ; les autres ne sont pas touchées. Une zone de
+ * garde ne convient donc pas à un programme dont un autre traitant de
+ * \c SIGSEGV doit voir toutes les fautes, ni à un thread qui masque
+ * \c SIGSEGV.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Taille de la zone de garde : \c 2^32 mots (0 si l'espace d'adressage ne le permet pas)
+#if SIZE_MAX > 0xFFFFFFFFu
+#define GUARD_SIZE ((size_t) sizeof (Word) << 32)
+#else
+#define GUARD_SIZE ((size_t) 0)
+#endif
+
+#ifdef __GNUC__
+//! Machine à laquelle l'interpréteur du cache de micro-opérations fait, sur ce thread, un accès non contrôlé
+/*!
+ * NULL hors d'un tel accès : positionnée juste avant l'accès, remise à NULL
+ * juste après (voir \c GUARD_BARRIER() et \c GUARD_END() dans uops.h).
+ */
+extern __thread Machine *guard_access;
+#endif
+
+//! Réservation d'un segment de données suivi de sa zone de garde
+/*!
+ * La projection du segment est accessible en lecture et en écriture, et
+ * ses pages ne sont allouées qu'au premier accès. Le segment commence dans
+ * la première page de la projection, au décalage nécessaire pour qu'il
+ * finisse sur une fin de page ; la zone de garde suit immédiatement.
+ *
+ * \param length la taille du segment en octets
+ * \param pdatamap la projection qui contient le segment
+ * \param pguardmap la zone de garde
+ * \return le début du segment, ou NULL (et \c errno positionnée) si
+ * l'espace d'adressage manque ou si \c GUARD_SIZE est nulle
+ */
+Word *map_guarded(size_t length, Mapping *pdatamap, Mapping *pguardmap);
+
+//! Inscription d'une machine dont le segment de données est gardé
+/*!
+ * La zone de garde est \c _guardmap. La machine ne doit pas être déplacée
+ * en mémoire tant qu'elle est inscrite.
+ *
+ * \param pmach la machine
+ * \return faux si toutes les inscriptions sont prises : les accès indexés
+ * de la machine doivent alors rester contrôlés
+ */
+bool guard_machine(Machine *pmach);
+
+//! Retrait de l'inscription d'une machine (sans effet si elle n'est pas inscrite)
+/*!
+ * \param pmach la machine
+ */
+void unguard_machine(Machine *pmach);
+
+#endif
@@ -0,0 +1,138 @@
+/*!
+ * \file history.c
+ * \brief Historique d'exécution : journal d'annulation des dernières
+ * instructions, pour revenir en arrière dans la mise au point.
+ */
+
+#include "history.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+History *create_history(unsigned capacity) {
+    History *phist = malloc(sizeof (History));
+    if (phist == NULL
+            || (phist->_records = malloc(sizeof (Undo_Record) * (capacity > 0 ? capacity : 1))) == NULL) {
+        perror("create_history");
+        exit(1);
+    }
+    phist->_capacity = capacity > 0 ? capacity : 1;
+    phist->_next = 0;
+    phist->_length = 0;
+    return phist;
+}
+
+void free_history(History *phist) {
+    if (phist != NULL) {
+        free(phist->_records);
+        free(phist);
+    }
+}
+
+//! Adresse du mot de données qu'une instruction peut écraser
+/*!
+ * \param pmach la machine, avant l'instruction
+ * \param instr l'instruction
+ * \param paddress l'adresse du mot
+ * \return faux si l'instruction n'écrit aucun mot de données
+ */
+static bool written_data(const Machine *pmach, Instruction instr, unsigned *paddress) {
+    switch (instr.instr_generic._cop) {
+        case STORE:
+        case POP:
+        case XADD:
+        case XCHG:
+            if (instr.instr_generic._indexed) {
+                *paddress = pmach->_registers[instr.instr_indexed._rindex] + instr.instr_indexed._offset;
+            } else {
+                *paddress = instr.instr_absolute._address;
+            }
+            return true;
+        case CALL:
+        case PUSH:
+            *paddress = pmach->_sp;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void record_instruction(History *phist, const Machine *pmach, unsigned addr) {
+    Undo_Record *prec = &phist->_records[phist->_next];
+    Instruction instr = pmach->_text[addr];
+    unsigned address;
+
+    prec->_pc = addr;
+    prec->_cc = current_cc(pmach);
+    prec->_stack = pmach->_sp;
+    prec->_kind = UNDO_NONE;
+    switch (instr.instr_generic._cop) {
+        case LOAD:
+        case ADD:
+        case SUB:
+            prec->_kind = UNDO_REGISTER;
+            prec->_where = instr.instr_generic._regcond;
+            prec->_old = pmach->_registers[prec->_where];
+            break;
+        default:
+            // Une adresse hors du segment (extra mot compris, voir
+            // check_seg_data()) provoque une erreur avant toute écriture
+            if (written_data(pmach, instr, &address) && address <= pmach->_datasize) {
+                // XADD ou XCHG immédiat : erreur, rien n'est échangé
+                bool exchange = (instr.instr_generic._cop == XADD || instr.instr_generic._cop == XCHG)
+                        && !instr.instr_generic._immediate;
+                prec->_kind = exchange ? UNDO_EXCHANGE : UNDO_DATA;
+                prec->_where = address;
+                prec->_old = pmach->_data[address];
+            }
+            break;
+    }
+
+    phist->_next = phist->_next + 1 < phist->_capacity ? phist->_next + 1 : 0;
+    if (phist->_length < phist->_capacity) {
+        phist->_length++;
+    }
+}
+
+bool undo_instruction(History *phist, Machine *pmach) {
+    if (phist->_length == 0) {
+        return false;
+    }
+    phist->_next = phist->_next > 0 ? phist->_next - 1 : phist->_capacity - 1;
+    phist->_length--;
+
+    const Undo_Record *prec = &phist->_records[phist->_next];
+    pmach->_sp = prec->_stack;
+    if (prec->_kind == UNDO_REGISTER) {
+        pmach->_registers[prec->_where] = prec->_old;
+    } else if (prec->_kind == UNDO_DATA) {
+        pmach->_data[prec->_where] = prec->_old;
+    } else if (prec->_kind == UNDO_EXCHANGE) {
+        // Après XCHG, le mot contient l'ancien registre ; après XADD, la somme
+        Instruction instr = pmach->_text[prec->_pc];
+        Word *preg = &pmach->_registers[instr.instr_generic._regcond];
+        Word *pword = &pmach->_data[prec->_where];
+        *preg = instr.instr_generic._cop == XADD ? *pword - prec->_old : *pword;
+        *pword = prec->_old;
+    }
+    pmach->_cc = prec->_cc;
+    pmach->_ccresult = CC_SETTLED;
+    pmach->_pc = prec->_pc;
+    return true;
+}
+
+void print_history(const History *phist, const Machine *pmach, unsigned n) {
+    if (n > phist->_length) {
+        n = phist->_length;
+    }
+    if (n == 0) {
+        printf("No instruction recorded\n");
+        return;
+    }
+    for (unsigned i = n; i > 0; i--) {
+        unsigned r = (phist->_next + phist->_capacity - i) % phist->_capacity;
+        unsigned addr = phist->_records[r]._pc;
+        printf("%6d 0x%04X: ", -(int) i, addr);
+        print_instruction(pmach->_text[addr], addr);
+        printf("\n");
+    }
+}
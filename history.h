@@ -0,0 +1,96 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+/*!
+ * \file history.h
+ * \brief Historique d'exécution : journal d'annulation des dernières
+ * instructions, pour revenir en arrière dans la mise au point.
+ *
+ * Quand l'option \c _history est fournie à simul_engine(), chaque instruction
+ * ajoute avant son exécution un enregistrement de ce qu'elle va écraser :
+ * \c _pc, \c _cc, \c SP et le seul registre ou mot de données qu'elle peut
+ * modifier (\c XADD et \c XCHG modifient un registre et un mot, mais l'ancien
+ * registre se déduit de l'ancien mot et de l'état qui suit). Les enregistrements sont rangés dans un tampon circulaire de
+ * taille fixe : seules les dernières instructions peuvent être annulées, et
+ * la mémoire consommée ne dépend pas de la durée de l'exécution. Comme le
+ * profil, l'historique impose l'exécution instruction par instruction ; sans
+ * historique, les boucles rapides des moteurs n'enregistrent rien.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Ce qu'une instruction écrase, outre \c _pc, \c _cc et \c SP
+typedef enum {
+    UNDO_NONE = 0, //!< Rien
+    UNDO_REGISTER, //!< Un registre
+    UNDO_DATA, //!< Un mot du segment de données
+    UNDO_EXCHANGE, //!< Un mot du segment de données et le registre de \c XADD ou \c XCHG
+} Undo_Kind;
+
+//! Enregistrement d'annulation d'une instruction (16 octets)
+typedef struct {
+    unsigned _pc : 28; //!< Adresse de l'instruction
+    Condition_Code _cc : 2; //!< Code condition avant l'instruction
+    Undo_Kind _kind : 2; //!< Nature de la valeur écrasée
+    Word _stack; //!< \c SP avant l'instruction
+    unsigned _where; //!< Numéro du registre ou adresse du mot écrasé
+    Word _old; //!< Valeur écrasée
+} Undo_Record;
+
+//! Historique : tampon circulaire des derniers enregistrements
+typedef struct {
+    Undo_Record *_records; //!< Enregistrements
+    unsigned _capacity; //!< Nombre maximal d'enregistrements conservés
+    unsigned _next; //!< Indice du prochain enregistrement
+    unsigned _length; //!< Nombre d'enregistrements conservés
+} History;
+
+//! Création d'un historique vide
+/*!
+ * \param capacity le nombre d'instructions dont on garde la trace (non nul)
+ * \return l'historique (à libérer par free_history())
+ */
+History *create_history(unsigned capacity);
+
+//! Libération d'un historique
+/*!
+ * \param phist l'historique (ou NULL)
+ */
+void free_history(History *phist);
+
+//! Enregistrement d'une instruction avant son exécution
+/*!
+ * Si l'historique est plein, l'enregistrement le plus ancien est perdu.
+ *
+ * \param phist l'historique
+ * \param pmach la machine, dans l'état qui précède l'instruction
+ * \param addr l'adresse de l'instruction
+ */
+void record_instruction(History *phist, const Machine *pmach, unsigned addr);
+
+//! Annulation de la dernière instruction enregistrée
+/*!
+ * La machine revient dans l'état qui précédait l'instruction, y compris si
+ * celle-ci a provoqué une erreur après avoir modifié \c SP.
+ *
+ * \param phist l'historique
+ * \param pmach la machine
+ * \return faux si l'historique est vide
+ */
+bool undo_instruction(History *phist, Machine *pmach);
+
+//! Affichage des dernières instructions enregistrées
+/*!
+ * Des plus anciennes aux plus récentes, chacune numérotée par son rang en
+ * partant de la plus récente (-1).
+ *
+ * \param phist l'historique
+ * \param pmach la machine
+ * \param n le nombre maximal d'instructions à afficher
+ */
+void print_history(const History *phist, const Machine *pmach, unsigned n);
+
+#endif
@@ -10,11 +10,20 @@
 #include <string.h>
 
 //! tableau rassemblant les différentes operations possibles 
-const char* cop_names[]={"ILLOP","NOP","LOAD","STORE","ADD","SUB","BRANCH","CALL","RET","PUSH","POP","HALT"};
+const char* cop_names[]={"ILLOP","NOP","LOAD","STORE","ADD","SUB","BRANCH","CALL","RET","PUSH","POP","HALT","XADD","XCHG","BARRIER"};
 
 //! tableau rassemblant les conditions possibles poue BRANCH et CALL
 const char* condition_names[]={"NC","EQ","NE","GT","GE","LT","LE"};
 
+//! nom d'une condition, ou "??" si elle n'existe pas (erreur ERR_CONDITION a l'execution)
+/*!
+ *  \param regcond le champ condition de l'instruction
+ *  \return le nom a afficher
+ */
+static const char *condition_name(unsigned regcond){
+	return regcond <= LAST_CONDITION ? condition_names[regcond] : "??";
+}
+
 //! affiche le registre d'une instruction de façon lisible
 //! affiche R0x si x<=9 et Rx sinon
 /*!
@@ -31,19 +40,25 @@ static void affichage_registre(Instruction instr){
  */
 void print_instruction(Instruction instr, unsigned addr){
 	
+	//Code operation inexistant : pas de nom a afficher (erreur ERR_UNKNOWN a l'execution)
+	if(instr.instr_generic._cop > LAST_COP){
+		printf("UNKNOWN %d", (int) instr.instr_generic._cop);
+		return;
+	}
+
 	//On recupere la condition
 	char *cop_name=cop_names[instr.instr_generic._cop];
 
 	//On la compare afin de savoir quoi afficher
-	//Si l'operation est HALT, ILLOP, NOP ou RET, il suffit de l'afficher
-	if(strcmp(cop_name,"HALT")==0 || strcmp(cop_name,"ILLOP")==0 || strcmp(cop_name,"NOP")==0 || strcmp(cop_name,"RET")==0){
+	//Si l'operation est HALT, ILLOP, NOP, RET ou BARRIER, il suffit de l'afficher
+	if(strcmp(cop_name,"HALT")==0 || strcmp(cop_name,"ILLOP")==0 || strcmp(cop_name,"NOP")==0 || strcmp(cop_name,"RET")==0 || strcmp(cop_name,"BARRIER")==0){
 		printf("%s", cop_name);
 	}else if(!instr.instr_generic._immediate){	//si I=0 
 		//si X=0 : adressage direct
 		if(!instr.instr_generic._indexed){
 			//si l'operation est BRACH ou CALL, on affiche la condition, sinon on affiche le registre de façon lisible
 			if(strcmp(cop_name,"BRANCH")==0 || strcmp(cop_name,"CALL")==0){
-				printf("%s %s, @%04x", cop_name, condition_names[instr.instr_generic._regcond], (int) instr.instr_absolute._address);
+				printf("%s %s, @%04x", cop_name, condition_name(instr.instr_generic._regcond), (int) instr.instr_absolute._address);
 			}else{	
 				printf("%s ",cop_name);
 				affichage_registre(instr);
@@ -52,7 +67,7 @@ void print_instruction(Instruction instr, unsigned addr){
 		//si X=1 : adressage indexe
 		}else{
 			if(strcmp(cop_name,"BRANCH")==0 || strcmp(cop_name,"CALL")==0){
-				printf("%s %s", cop_name, condition_names[instr.instr_generic._regcond]);
+				printf("%s %s", cop_name, condition_name(instr.instr_generic._regcond));
 				//offset sous la forme +/-offset
 				printf(", %+d[", (int) instr.instr_indexed._offset);
 				//on affiche le registre pour l'affichage indirect
@@ -68,7 +83,7 @@ void print_instruction(Instruction instr, unsigned addr){
 	//si I=1 : immediat
 	}else{
 		if(strcmp(cop_name,"BRANCH")==0 || strcmp(cop_name,"CALL")==0){
-			printf("%s %s, #%d", cop_name, condition_names[instr.instr_generic._regcond], (int) instr.instr_immediate._value);
+			printf("%s %s, #%d", cop_name, condition_name(instr.instr_generic._regcond), (int) instr.instr_immediate._value);
 		}else{
 			printf("%s ", cop_name);
 			affichage_registre(instr);
@@ -24,10 +24,13 @@ typedef enum
     PUSH,	//!< Empilement sur la pile d'exécution 
     POP,	//!< Dépilement de la pile d'exécution
     HALT,	//!< Arrêt (normal) du programme
+    XADD,	//!< Échange-addition atomique d'un registre et d'un mot de données
+    XCHG,	//!< Échange atomique d'un registre et d'un mot de données
+    BARRIER,	//!< Rendez-vous de tous les cœurs (voir smp.h)
 } Code_Op;
 
 //! Dernière valeur possible du code opération
-const static unsigned LAST_COP = HALT;
+const static unsigned LAST_COP = BARRIER;
 
 
 //! Structure d'une instruction 
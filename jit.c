@@ -0,0 +1,789 @@
+/*!
+ * \file jit.c
+ * \brief Compilateur à la volée (JIT) vers le code natif x86-64.
+ *
+ * Le programme simulé est découpé en blocs de base à partir du cache de
+ * micro-opérations (\c Machine::_decoded) : un bloc commence à l'adresse où
+ * l'exécution arrive et se termine après le premier \c BRANCH, \c CALL,
+ * \c RET, \c BARRIER ou \c HALT. Chaque bloc est traduit, la première fois qu'on
+ * l'exécute, en code x86-64 écrit dans une zone de mémoire obtenue par
+ * mmap().
+ *
+ * Le code produit travaille directement sur la structure Machine, qui sert
+ * de cadre fixe : les registres généraux et le code condition y sont lus et
+ * écrits à des déplacements constants. Pendant l'exécution du code natif, les
+ * registres de l'hôte contiennent :
+ *
+ *   - \c rbx : l'adresse de la machine ;
+ *   - \c r12 : l'adresse du segment de données ;
+ *   - \c r13d : la taille du segment de données ;
+ *   - \c r14d : la fin des données statiques (base de la pile) ;
+ *   - \c r15 : le nombre d'instructions qui restent au budget.
+ *
+ * Le compteur ordinal n'est mis à jour qu'à la sortie d'un bloc. Un bloc se
+ * termine en rendant la main au répartiteur, run_jit(), avec un code de
+ * sortie (voir \link Jit_Exit \endlink). Lorsque l'adresse suivante est
+ * connue à la traduction (branchement absolu, instruction suivante), la
+ * sortie passe par un tremplin qui rend l'adresse du saut à corriger : le
+ * répartiteur y écrit alors l'adresse du bloc cible et les blocs s'enchaînent
+ * ensuite directement, sans repasser par lui.
+ *
+ * Chaque bloc commence par décompter ses instructions du budget (\c r15) ;
+ * s'il n'y tient pas, il rend la main au répartiteur sans rien exécuter et
+ * les dernières instructions du budget sont exécutées par l'interpréteur.
+ * Le budget n'est ainsi testé qu'une fois par bloc, enchaînements compris ;
+ * sans budget, le décompte part de \c UINT64_MAX et ne s'épuise pas.
+ *
+ * Les contrôles des segments de données et de pile sont les mêmes, dans le
+ * même ordre, que ceux de exec.c ; en cas d'erreur, le code natif rend la
+ * main avec le compteur ordinal qu'aurait l'interpréteur et le répartiteur
+ * signale l'erreur à la même adresse. Dès que l'exécution atteint une
+ * instruction que le traducteur ne sait pas traiter (instructions invalides,
+ * adresse absolue hors du segment), la suite est confiée à l'interpréteur du
+ * cache de micro-opérations, ce qui garantit des erreurs identiques.
+ *
+ * La zone de code et les blocs traduits sont conservés dans la machine
+ * (\c Machine::_jit) jusqu'à unload_program() : les exécutions bornées
+ * successives (échantillonnage, quanta du multiprocesseur, exécution en
+ * parallèle du vérificateur) reprennent les blocs et leurs enchaînements.
+ *
+ * La zone de code n'est jamais à la fois inscriptible et exécutable : elle
+ * passe en écriture le temps d'une traduction ou d'un enchaînement. Si elle
+ * est pleine, tous les blocs sont oubliés et retraduits à la demande. Sur un
+ * autre processeur que x86-64, ou si la zone ne peut pas être obtenue, on se
+ * rabat sur l'interpréteur du cache de micro-opérations.
+ */
+
+#define _DEFAULT_SOURCE // Pour MAP_ANONYMOUS
+
+#include "engine.h"
+#include "exec.h"
+#include "error.h"
+#include "smp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Exécution par l'interpréteur du cache de micro-opérations.
+
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param pbudget le nombre maximal d'instructions à exécuter (voir
+ * run_budget()), ou NULL pour aller jusqu'au \c HALT
+ * \return faux après l'exécution de \c HALT ; vrai si le budget est épuisé
+ */
+static bool run_interpreter(Machine *pmach, uint64_t *pbudget) {
+    for (;;) {
+        if (pmach->_pc >= pmach->_textsize) {
+            settle_cc(pmach);
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
+        if (pbudget != NULL) {
+            if (*pbudget == 0) {
+                return true;
+            }
+            --*pbudget;
+        }
+        pmach->_pc = pmach->_pc + 1;
+        if (!execute_decoded(pmach, &pmach->_decoded[pmach->_pc - 1])) {
+            return false;
+        }
+    }
+}
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+//! Taille de la zone de code natif
+#define JIT_CODE_SIZE (4u << 20)
+
+//! Nombre maximal d'instructions dans un bloc de base
+#define JIT_BLOCK_MAX 64
+
+//! Taille maximale du code natif d'un bloc (largement majorée)
+#define JIT_BLOCK_BYTES (JIT_BLOCK_MAX * 160 + 256)
+
+//! Codes de sortie du code natif
+/*!
+ * Toute autre valeur est l'adresse du déplacement d'un saut à corriger pour
+ * enchaîner directement sur le bloc du compteur ordinal.
+ */
+typedef enum {
+    JIT_EXIT_DISPATCH = 0, //!< Branchement calculé : recherche du bloc du compteur ordinal
+    JIT_EXIT_HALT, //!< Fin normale du programme (le compteur ordinal suit le \c HALT)
+    JIT_EXIT_BARRIER, //!< Rendez-vous des cœurs (le compteur ordinal suit le \c BARRIER)
+    JIT_EXIT_INTERPRET, //!< Instruction du compteur ordinal à confier à l'interpréteur
+    JIT_EXIT_BUDGET, //!< Bloc du compteur ordinal plus long que le budget restant
+    JIT_EXIT_SEGDATA, //!< Erreur ERR_SEGDATA (le compteur ordinal suit l'instruction fautive)
+    JIT_EXIT_SEGSTACK, //!< Erreur ERR_SEGSTACK (le compteur ordinal suit l'instruction fautive)
+} Jit_Exit;
+
+//! Dernière valeur possible d'un code de sortie
+static const unsigned LAST_JIT_EXIT = JIT_EXIT_SEGSTACK;
+
+//! Point d'entrée du code natif : exécution à partir d'un bloc
+/*!
+ * \c *pfuel est le budget en entrée, ce qu'il en reste en sortie.
+ */
+typedef uintptr_t (*Jit_Entry)(Machine *pmach, const uint8_t *block, uint64_t *pfuel);
+
+//! État du compilateur
+typedef struct Jit {
+    uint8_t *_code; //!< Zone de code natif
+    uint8_t *_first; //!< Premier octet disponible pour les blocs
+    uint8_t *_free; //!< Premier octet libre
+    const uint8_t *_epilogue; //!< Retour au répartiteur
+    Jit_Entry _entry; //!< Prologue : entrée dans le code natif
+    uint8_t **_blocks; //!< Bloc natif de chaque adresse (ou NULL)
+    uint8_t *_lengths; //!< Nombre d'instructions du bloc de chaque adresse
+    unsigned _generation; //!< Nombre de remises à zéro de la zone de code
+    const Machine *_pmach; //!< Machine dont on traduit le programme
+} Jit;
+
+// Registres de l'hôte (numéros d'encodage)
+enum { EAX = 0, ECX = 1, EDX = 2 };
+
+// Déplacements dans la structure Machine (adressée par rbx)
+#define PC offsetof(Machine, _pc)
+#define CC offsetof(Machine, _cc)
+#define REG(r) (offsetof(Machine, _registers) + sizeof (Word) * (r))
+#define SP REG(NREGISTERS - 1)
+
+// Sauts conditionnels courts : l'exécution continue si la condition est vraie
+#define JB 0x72
+#define JAE 0x73
+#define JBE 0x76
+
+//! Taille d'une sortie vers le répartiteur (voir exit_stub())
+#define JIT_STUB_SIZE 20
+
+static void byte(Jit *pjit, unsigned b) {
+    *pjit->_free++ = b;
+}
+
+static void dword(Jit *pjit, uint32_t v) {
+    memcpy(pjit->_free, &v, sizeof v);
+    pjit->_free += sizeof v;
+}
+
+static void qword(Jit *pjit, uint64_t v) {
+    memcpy(pjit->_free, &v, sizeof v);
+    pjit->_free += sizeof v;
+}
+
+//! Déplacement relatif d'un saut dont le déplacement (32 bits) est en \c at
+static void patch(uint8_t *at, const uint8_t *target) {
+    int32_t rel = target - (at + 4);
+    memcpy(at, &rel, sizeof rel);
+}
+
+//! Opération \c op entre le registre \c hreg et le mot en <tt>[rbx + disp]</tt>
+static void frame(Jit *pjit, unsigned op, unsigned hreg, unsigned disp) {
+    byte(pjit, op);
+    byte(pjit, 0x83 | hreg << 3);
+    dword(pjit, disp);
+}
+
+//! mov hreg, [rbx + disp]
+static void load(Jit *pjit, unsigned hreg, unsigned disp) {
+    frame(pjit, 0x8B, hreg, disp);
+}
+
+//! mov [rbx + disp], hreg
+static void store(Jit *pjit, unsigned hreg, unsigned disp) {
+    frame(pjit, 0x89, hreg, disp);
+}
+
+//! mov dword [rbx + disp], imm
+static void store_imm(Jit *pjit, unsigned disp, uint32_t imm) {
+    frame(pjit, 0xC7, 0, disp);
+    dword(pjit, imm);
+}
+
+//! jmp rel32 vers \c target
+static void jump(Jit *pjit, const uint8_t *target) {
+    byte(pjit, 0xE9);
+    pjit->_free += 4;
+    patch(pjit->_free - 4, target);
+}
+
+//! Sortie vers le répartiteur avec un compteur ordinal et un code de sortie fixes
+/*!
+ * Fait toujours exactement \c JIT_STUB_SIZE octets.
+ */
+static void exit_stub(Jit *pjit, unsigned pc, Jit_Exit status) {
+    store_imm(pjit, PC, pc);
+    byte(pjit, 0xB8); // mov eax, status
+    dword(pjit, status);
+    jump(pjit, pjit->_epilogue);
+}
+
+//! Sortie vers le répartiteur, le compteur ordinal étant dans \c eax
+static void exit_dispatch(Jit *pjit) {
+    store(pjit, EAX, PC);
+    byte(pjit, 0x31); // xor eax, eax
+    byte(pjit, 0xC0);
+    jump(pjit, pjit->_epilogue);
+}
+
+//! Sortie vers l'adresse \c pc, enchaînable
+/*!
+ * Le saut initial mène au tremplin qui le suit ; le répartiteur le corrigera
+ * pour qu'il mène directement au bloc de \c pc.
+ */
+static void exit_chain(Jit *pjit, unsigned pc) {
+    jump(pjit, pjit->_free + 5);
+    uint8_t *at = pjit->_free - 4;
+    store_imm(pjit, PC, pc);
+    byte(pjit, 0x48); // mov rax, at
+    byte(pjit, 0xB8);
+    qword(pjit, (uintptr_t) at);
+    jump(pjit, pjit->_epilogue);
+}
+
+//! Décompte des instructions du bloc de \c pc, qui sort si le budget est insuffisant
+/*!
+ * Les deux octets \c length (<tt>block + 3</tt> et <tt>block + 9</tt>) sont
+ * corrigés une fois le bloc traduit (voir translate()).
+ */
+static void charge(Jit *pjit, unsigned pc) {
+    byte(pjit, 0x49); // sub r15, length
+    byte(pjit, 0x83);
+    byte(pjit, 0xEF);
+    byte(pjit, 0);
+    byte(pjit, JAE);
+    byte(pjit, 4 + JIT_STUB_SIZE);
+    byte(pjit, 0x49); // add r15, length
+    byte(pjit, 0x83);
+    byte(pjit, 0xC7);
+    byte(pjit, 0);
+    exit_stub(pjit, pc, JIT_EXIT_BUDGET);
+}
+
+//! Contrôle : si le saut court \c ok n'est pas pris, erreur \c fault à l'adresse \c addr
+static void check(Jit *pjit, unsigned ok, unsigned addr, Jit_Exit fault) {
+    byte(pjit, ok);
+    byte(pjit, JIT_STUB_SIZE);
+    exit_stub(pjit, addr + 1, fault);
+}
+
+//! Contrôle de l'adresse de données dans \c eax (comme check_seg_data())
+static void check_data(Jit *pjit, unsigned addr) {
+    byte(pjit, 0x44); // cmp eax, r13d
+    byte(pjit, 0x39);
+    byte(pjit, 0xE8);
+    check(pjit, JBE, addr, JIT_EXIT_SEGDATA);
+}
+
+//! Contrôle du pointeur de pile, chargé dans \c eax (comme check_stack())
+static void check_stack(Jit *pjit, unsigned addr) {
+    load(pjit, EAX, SP);
+    byte(pjit, 0x44); // cmp eax, r14d
+    byte(pjit, 0x39);
+    byte(pjit, 0xF0);
+    check(pjit, JAE, addr, JIT_EXIT_SEGSTACK);
+    byte(pjit, 0x44); // cmp eax, r13d
+    byte(pjit, 0x39);
+    byte(pjit, 0xE8);
+    check(pjit, JB, addr, JIT_EXIT_SEGSTACK);
+}
+
+//! mov eax, [r12 + 4 * rax]
+static void read_data(Jit *pjit) {
+    byte(pjit, 0x41);
+    byte(pjit, 0x8B);
+    byte(pjit, 0x04);
+    byte(pjit, 0x84);
+}
+
+//! Adresse indexée dans \c eax
+static void address_indexed(Jit *pjit, const Decoded *d) {
+    load(pjit, EAX, REG(d->_rindex));
+    byte(pjit, 0x05); // add eax, offset
+    dword(pjit, d->_operand);
+}
+
+//! Adresse de données contrôlée dans \c eax
+/*!
+ * Une adresse absolue a été vérifiée au chargement (voir predecode()) : seule
+ * une adresse indexée est contrôlée à l'exécution.
+ */
+static void address(Jit *pjit, const Decoded *d, unsigned addr) {
+    if (d->_flags & DECODED_INDEXED) {
+        address_indexed(pjit, d);
+        check_data(pjit, addr);
+    } else {
+        byte(pjit, 0xB8); // mov eax, address
+        dword(pjit, d->_operand);
+    }
+}
+
+//! Valeur de l'opérande (immédiate ou en mémoire) dans \c eax
+static void fetch(Jit *pjit, const Decoded *d, unsigned addr) {
+    if (d->_flags & DECODED_IMMEDIATE) {
+        byte(pjit, 0xB8); // mov eax, value
+        dword(pjit, d->_operand);
+        return;
+    }
+    address(pjit, d, addr);
+    read_data(pjit);
+}
+
+//! Code condition (voir cc_of()) calculé d'après \c eax
+/*!
+ * Les mots étant non signés, le résultat est \c CC_Z ou \c CC_P, c'est-à-dire
+ * <tt>CC_Z + (eax != 0)</tt>.
+ */
+static void set_cc(Jit *pjit) {
+    byte(pjit, 0x85); // test eax, eax
+    byte(pjit, 0xC0);
+    byte(pjit, 0x0F); // setnz dl
+    byte(pjit, 0x95);
+    byte(pjit, 0xC2);
+    byte(pjit, 0x0F); // movzx edx, dl
+    byte(pjit, 0xB6);
+    byte(pjit, 0xD2);
+    byte(pjit, 0x83); // add edx, CC_Z
+    byte(pjit, 0xC2);
+    byte(pjit, CC_Z);
+    store(pjit, EDX, CC);
+}
+
+//! Test de la condition d'un branchement
+/*!
+ * \return l'adresse du déplacement du saut vers le cas « non pris », ou NULL
+ * si la condition est toujours vraie
+ */
+static uint8_t *condition(Jit *pjit, const Decoded *d) {
+    unsigned mask = condition_masks[d->_regcond];
+    if (mask == (1u << (LAST_CC + 1)) - 1) {
+        return NULL;
+    }
+    load(pjit, ECX, CC);
+    byte(pjit, 0xB8); // mov eax, mask
+    dword(pjit, mask);
+    byte(pjit, 0x0F); // bt eax, ecx
+    byte(pjit, 0xA3);
+    byte(pjit, 0xC8);
+    byte(pjit, 0x0F); // jnc rel32
+    byte(pjit, 0x83);
+    pjit->_free += 4;
+    return pjit->_free - 4;
+}
+
+//! Fin d'un branchement conditionnel : le cas « non pris » continue en \c addr + 1
+static void not_taken(Jit *pjit, uint8_t *skip, unsigned addr) {
+    if (skip != NULL) {
+        patch(skip, pjit->_free);
+        exit_chain(pjit, addr + 1);
+    }
+}
+
+//! Traduction d'une instruction ordinaire (sans effet sur le compteur ordinal)
+/*!
+ * \return faux si l'instruction doit être confiée à l'interpréteur
+ */
+static bool translate_simple(Jit *pjit, const Decoded *d, unsigned addr) {
+    switch (d->_handler) {
+        case UOP_NOP:
+            return true;
+        case UOP_LOAD_I:
+            store_imm(pjit, REG(d->_regcond), d->_operand);
+            store_imm(pjit, CC, cc_of(d->_operand));
+            return true;
+        case UOP_LOAD_A:
+        case UOP_LOAD_X:
+        case UOP_LOAD_G:
+            fetch(pjit, d, addr);
+            store(pjit, EAX, REG(d->_regcond));
+            set_cc(pjit);
+            return true;
+        case UOP_STORE_A:
+        case UOP_STORE_X:
+        case UOP_STORE_G:
+            address(pjit, d, addr);
+            load(pjit, ECX, REG(d->_regcond));
+            byte(pjit, 0x41); // mov [r12 + 4 * rax], ecx
+            byte(pjit, 0x89);
+            byte(pjit, 0x0C);
+            byte(pjit, 0x84);
+            return true;
+        case UOP_ADD_I:
+        case UOP_ADD_A:
+        case UOP_ADD_X:
+        case UOP_ADD_G:
+            fetch(pjit, d, addr);
+            frame(pjit, 0x03, EAX, REG(d->_regcond)); // add eax, reg
+            store(pjit, EAX, REG(d->_regcond));
+            set_cc(pjit);
+            return true;
+        case UOP_SUB_I:
+        case UOP_SUB_A:
+        case UOP_SUB_X:
+        case UOP_SUB_G:
+            fetch(pjit, d, addr);
+            byte(pjit, 0x89); // mov ecx, eax
+            byte(pjit, 0xC1);
+            load(pjit, EAX, REG(d->_regcond));
+            byte(pjit, 0x29); // sub eax, ecx
+            byte(pjit, 0xC8);
+            store(pjit, EAX, REG(d->_regcond));
+            set_cc(pjit);
+            return true;
+        case UOP_PUSH_I:
+        case UOP_PUSH_A:
+        case UOP_PUSH_X:
+        case UOP_PUSH_G:
+            check_stack(pjit, addr);
+            fetch(pjit, d, addr);
+            load(pjit, ECX, SP);
+            byte(pjit, 0x41); // mov [r12 + 4 * rcx], eax
+            byte(pjit, 0x89);
+            byte(pjit, 0x04);
+            byte(pjit, 0x8C);
+            frame(pjit, 0xFF, 1, SP); // dec dword [sp]
+            return true;
+        case UOP_POP_A:
+        case UOP_POP_X:
+            address(pjit, d, addr);
+            byte(pjit, 0x89); // mov edx, eax
+            byte(pjit, 0xC2);
+            frame(pjit, 0xFF, 0, SP); // inc dword [sp]
+            check_stack(pjit, addr);
+            read_data(pjit);
+            byte(pjit, 0x41); // mov [r12 + 4 * rdx], eax
+            byte(pjit, 0x89);
+            byte(pjit, 0x04);
+            byte(pjit, 0x94);
+            return true;
+        case UOP_XADD_A:
+        case UOP_XADD_X:
+        case UOP_XCHG_A:
+        case UOP_XCHG_X:
+            address(pjit, d, addr);
+            load(pjit, ECX, REG(d->_regcond));
+            if (d->_handler == UOP_XADD_A || d->_handler == UOP_XADD_X) {
+                byte(pjit, 0xF0); // lock xadd [r12 + 4 * rax], ecx
+                byte(pjit, 0x41);
+                byte(pjit, 0x0F);
+                byte(pjit, 0xC1);
+            } else {
+                byte(pjit, 0x41); // xchg [r12 + 4 * rax], ecx (indivisible)
+                byte(pjit, 0x87);
+            }
+            byte(pjit, 0x0C);
+            byte(pjit, 0x84);
+            byte(pjit, 0x89); // mov eax, ecx
+            byte(pjit, 0xC8);
+            store(pjit, EAX, REG(d->_regcond));
+            set_cc(pjit);
+            return true;
+        default:
+            return false;
+    }
+}
+
+//! Traduction d'une instruction de fin de bloc
+/*!
+ * \return faux si l'instruction n'est pas une fin de bloc
+ */
+static bool translate_control(Jit *pjit, const Decoded *d, unsigned addr) {
+    uint8_t *skip;
+
+    switch (d->_handler) {
+        case UOP_BRANCH_A:
+            skip = condition(pjit, d);
+            exit_chain(pjit, d->_operand);
+            not_taken(pjit, skip, addr);
+            return true;
+        case UOP_BRANCH_X:
+            skip = condition(pjit, d);
+            address_indexed(pjit, d);
+            exit_dispatch(pjit);
+            not_taken(pjit, skip, addr);
+            return true;
+        case UOP_CALL_A:
+        case UOP_CALL_X:
+            check_stack(pjit, addr);
+            skip = condition(pjit, d);
+            load(pjit, EAX, SP);
+            byte(pjit, 0x41); // mov dword [r12 + 4 * rax], addr + 1
+            byte(pjit, 0xC7);
+            byte(pjit, 0x04);
+            byte(pjit, 0x84);
+            dword(pjit, addr + 1);
+            frame(pjit, 0xFF, 1, SP); // dec dword [sp]
+            if (d->_handler == UOP_CALL_A) {
+                exit_chain(pjit, d->_operand);
+            } else {
+                address_indexed(pjit, d);
+                exit_dispatch(pjit);
+            }
+            not_taken(pjit, skip, addr);
+            return true;
+        case UOP_RET:
+            frame(pjit, 0xFF, 0, SP); // inc dword [sp]
+            check_stack(pjit, addr);
+            read_data(pjit);
+            exit_dispatch(pjit);
+            return true;
+        case UOP_BARRIER:
+            exit_stub(pjit, addr + 1, JIT_EXIT_BARRIER);
+            return true;
+        case UOP_HALT:
+            exit_stub(pjit, addr + 1, JIT_EXIT_HALT);
+            return true;
+        default:
+            return false;
+    }
+}
+
+//! Traduction du bloc de base commençant à l'adresse \c pc
+/*!
+ * \return l'adresse du code natif du bloc
+ */
+static uint8_t *translate(Jit *pjit, unsigned pc) {
+    const Machine *pmach = pjit->_pmach;
+    uint8_t *block = pjit->_free;
+
+    charge(pjit, pc);
+    for (unsigned addr = pc;; addr++) {
+        pjit->_lengths[pc] = addr - pc;
+        if (addr >= pmach->_textsize || addr - pc == JIT_BLOCK_MAX) {
+            exit_chain(pjit, addr);
+            break;
+        }
+        const Decoded *d = &pmach->_decoded[addr];
+        uint8_t *start = pjit->_free;
+        if (translate_control(pjit, d, addr)) {
+            pjit->_lengths[pc]++;
+            break;
+        }
+        if (!translate_simple(pjit, d, addr)) {
+            pjit->_free = start;
+            if (addr == pc) {
+                exit_stub(pjit, addr, JIT_EXIT_INTERPRET);
+            } else {
+                exit_chain(pjit, addr);
+            }
+            break;
+        }
+    }
+    block[3] = block[9] = pjit->_lengths[pc];
+    pjit->_blocks[pc] = block;
+    return block;
+}
+
+//! Passage de la zone de code en écriture ou en exécution
+static void set_writable(Jit *pjit, bool writable) {
+    if (mprotect(pjit->_code, JIT_CODE_SIZE,
+            PROT_READ | (writable ? PROT_WRITE : PROT_EXEC)) != 0) {
+        perror("jit");
+        exit(1);
+    }
+}
+
+//! Oubli de tous les blocs traduits
+static void flush(Jit *pjit) {
+    memset(pjit->_blocks, 0, sizeof (uint8_t *) * pjit->_pmach->_textsize);
+    pjit->_free = pjit->_first;
+    pjit->_generation++;
+}
+
+//! Préparation du compilateur : zone de code, prologue et épilogue
+/*!
+ * \return le compilateur (à libérer par free_jit()), ou NULL si la zone de
+ * code n'a pas pu être obtenue
+ */
+static Jit *jit_open(const Machine *pmach) {
+    uint8_t *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        return NULL;
+    }
+    Jit *pjit = malloc(sizeof (Jit));
+    if (pjit == NULL) {
+        perror("jit");
+        exit(1);
+    }
+    pjit->_code = code;
+    pjit->_blocks = calloc(pmach->_textsize + 1, sizeof (uint8_t *));
+    pjit->_lengths = calloc(pmach->_textsize + 1, sizeof (uint8_t));
+    if (pjit->_blocks == NULL || pjit->_lengths == NULL) {
+        perror("jit");
+        exit(1);
+    }
+    pjit->_pmach = pmach;
+    pjit->_generation = 0;
+    pjit->_free = pjit->_code;
+
+    // Prologue : sauvegarde des registres préservés, chargement du contexte
+    pjit->_entry = (Jit_Entry) (void *) pjit->_free;
+    byte(pjit, 0x53); // push rbx
+    byte(pjit, 0x41); // push r12
+    byte(pjit, 0x54);
+    byte(pjit, 0x41); // push r13
+    byte(pjit, 0x55);
+    byte(pjit, 0x41); // push r14
+    byte(pjit, 0x56);
+    byte(pjit, 0x41); // push r15
+    byte(pjit, 0x57);
+    byte(pjit, 0x52); // push rdx
+    byte(pjit, 0x48); // mov rbx, rdi
+    byte(pjit, 0x89);
+    byte(pjit, 0xFB);
+    byte(pjit, 0x4C); // mov r12, [rbx + _data]
+    frame(pjit, 0x8B, 4, offsetof(Machine, _data));
+    byte(pjit, 0x44); // mov r13d, [rbx + _datasize]
+    frame(pjit, 0x8B, 5, offsetof(Machine, _datasize));
+    byte(pjit, 0x44); // mov r14d, [rbx + _dataend]
+    frame(pjit, 0x8B, 6, offsetof(Machine, _dataend));
+    byte(pjit, 0x4C); // mov r15, [rdx]
+    byte(pjit, 0x8B);
+    byte(pjit, 0x3A);
+    byte(pjit, 0xFF); // jmp rsi
+    byte(pjit, 0xE6);
+
+    // Épilogue : le code de sortie est dans rax
+    pjit->_epilogue = pjit->_free;
+    byte(pjit, 0x5A); // pop rdx
+    byte(pjit, 0x4C); // mov [rdx], r15
+    byte(pjit, 0x89);
+    byte(pjit, 0x3A);
+    byte(pjit, 0x41); // pop r15
+    byte(pjit, 0x5F);
+    byte(pjit, 0x41); // pop r14
+    byte(pjit, 0x5E);
+    byte(pjit, 0x41); // pop r13
+    byte(pjit, 0x5D);
+    byte(pjit, 0x41); // pop r12
+    byte(pjit, 0x5C);
+    byte(pjit, 0x5B); // pop rbx
+    byte(pjit, 0xC3); // ret
+
+    pjit->_first = pjit->_free;
+    set_writable(pjit, false);
+    return pjit;
+}
+
+//! Exécution par traduction en code natif, éventuellement bornée
+/*!
+ * Le premier bloc qui ne tient pas dans le budget restant est exécuté par
+ * l'interpréteur, jusqu'à épuisement du budget.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param pbudget le nombre maximal d'instructions à exécuter (voir
+ * run_budget()), ou NULL pour aller jusqu'au \c HALT
+ * \return faux après l'exécution de \c HALT ; vrai si le budget est épuisé
+ */
+static bool jit_run(Machine *pmach, uint64_t *pbudget) {
+    uintptr_t status = JIT_EXIT_DISPATCH;
+    uint64_t fuel = pbudget != NULL ? *pbudget : UINT64_MAX;
+
+    // Le code produit suppose des registres et un code condition de 32 bits
+    if (sizeof (Condition_Code) != sizeof (Word)) {
+        return run_interpreter(pmach, pbudget);
+    }
+    Jit *pjit = pmach->_jit;
+    if (pjit == NULL) {
+        pjit = jit_open(pmach);
+        if (pjit == NULL) {
+            return run_interpreter(pmach, pbudget);
+        }
+        pmach->_jit = pjit;
+    }
+    // Le code natif lit et écrit directement _cc
+    settle_cc(pmach);
+
+    for (;;) {
+        unsigned pc = pmach->_pc;
+        if (pc >= pmach->_textsize) {
+            error(ERR_SEGTEXT, pc);
+        }
+
+        // Recherche ou traduction du bloc, puis enchaînement éventuel
+        uint8_t *block = pjit->_blocks[pc];
+        bool chain = status > LAST_JIT_EXIT;
+        if (block == NULL || chain) {
+            set_writable(pjit, true);
+            if (block == NULL) {
+                unsigned generation = pjit->_generation;
+                if (pjit->_code + JIT_CODE_SIZE - pjit->_free < JIT_BLOCK_BYTES) {
+                    flush(pjit);
+                }
+                block = translate(pjit, pc);
+                chain = chain && generation == pjit->_generation;
+            }
+            if (chain) {
+                patch((uint8_t *) status, block);
+            }
+            set_writable(pjit, false);
+        }
+
+        status = pjit->_entry(pmach, block, &fuel);
+        if (pbudget != NULL) {
+            *pbudget = fuel;
+        }
+
+        switch (status) {
+            case JIT_EXIT_HALT:
+                warning(WARN_HALT, pmach->_pc - 1);
+                return false;
+            case JIT_EXIT_BARRIER:
+                smp_barrier(pmach);
+                break;
+            case JIT_EXIT_INTERPRET: // Instruction non traduite (toujours fautive)
+            case JIT_EXIT_BUDGET: // Bloc plus long que le budget restant
+                // On termine dans l'interpréteur
+                return run_interpreter(pmach, pbudget);
+            case JIT_EXIT_SEGDATA:
+                error(ERR_SEGDATA, pmach->_pc - 1);
+            case JIT_EXIT_SEGSTACK:
+                error(ERR_SEGSTACK, pmach->_pc - 1);
+            default:
+                break;
+        }
+    }
+}
+
+void run_jit(Machine *pmach) {
+    jit_run(pmach, NULL);
+}
+
+bool run_jit_budget(Machine *pmach, uint64_t *pbudget) {
+    return jit_run(pmach, pbudget);
+}
+
+void free_jit(Machine *pmach) {
+    Jit *pjit = pmach->_jit;
+    if (pjit != NULL) {
+        munmap(pjit->_code, JIT_CODE_SIZE);
+        free(pjit->_blocks);
+        free(pjit->_lengths);
+        free(pjit);
+        pmach->_jit = NULL;
+    }
+}
+
+#else
+
+void run_jit(Machine *pmach) {
+    run_interpreter(pmach, NULL);
+}
+
+bool run_jit_budget(Machine *pmach, uint64_t *pbudget) {
+    return run_interpreter(pmach, pbudget);
+}
+
+void free_jit(Machine *pmach) {
+    (void) pmach; // Aucun code natif
+}
+
+#endif
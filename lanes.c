@@ -0,0 +1,537 @@
+/*!
+ * \file lanes.c
+ * \brief Exécution en voies parallèles (SIMD) d'un même programme sur plusieurs machines.
+ */
+
+#define _POSIX_C_SOURCE 200112L // Pour posix_memalign()
+
+#include "lanes.h"
+#include "decode.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool lanes_compatible(const Machine *pa, const Machine *pb) {
+    return pa->_textsize == pb->_textsize && pa->_datasize == pb->_datasize
+            && pa->_dataend == pb->_dataend
+            && memcmp(pa->_text, pb->_text, sizeof (Instruction) * pa->_textsize) == 0;
+}
+
+//! Exécution d'une machine seule jusqu'à son arrêt, sans avertissement
+static Simul_Status run_alone(Machine *pmach, Engine engine) {
+    Simul_Options options = {
+        ._engine = engine,
+        ._trace = TRACE_OFF,
+        ._debug = false,
+        ._warnings = false,
+        ._profile = NULL,
+        ._history = NULL,
+        ._cache = NULL,
+        ._sampler = NULL,
+        ._tracefile = NULL,
+    };
+    return simul_run(pmach, &options);
+}
+
+#ifdef __GNUC__
+
+//! Vecteur d'un mot par voie
+typedef Word Lane_Vector __attribute__((vector_size(LANE_WIDTH * sizeof (Word))));
+
+//! Vecteur dont toutes les voies valent \c x
+#define LANE_BROADCAST(x) ((Lane_Vector) {0} + (Word) (x))
+
+//! Choix voie par voie : \c a là où le masque \c m est à 1, \c b ailleurs
+#define LANE_SELECT(m, a, b) (((m) & (a)) | (~(m) & (b)))
+
+//! Adresse qui ne désigne aucune voie dans les recherches de minimum
+#define LANE_NONE (~(Word) 0)
+
+//! Petites fonctions appelées pour chaque vecteur : intégrées même sans optimisation
+#define LANE_INLINE static inline __attribute__((always_inline))
+
+//! Voies en cours d'exécution
+/*!
+ * Le mot \c i de la voie \c n est l'élément <tt>n % LANE_WIDTH</tt> du
+ * vecteur <tt>i * _nvec + n / LANE_WIDTH</tt> : les voies d'un même mot sont
+ * contiguës. Une voie est dans le groupe courant, en attente, ou arrêtée
+ * (comme les voies de remplissage du dernier vecteur) si elle n'est dans
+ * aucun des deux masques.
+ */
+typedef struct {
+    Machine **_machines; //!< Machine de chaque voie
+    Simul_Status *_status; //!< Issue de chaque voie
+    Engine _engine; //!< Moteur des voies qui quittent le groupe
+    unsigned _nvec; //!< Nombre de vecteurs par mot
+    unsigned _textsize; //!< Taille du segment de texte
+    unsigned _datasize; //!< Taille du segment de données
+    unsigned _dataend; //!< Fin des données statiques
+    Decoded *_decoded; //!< Micro-opérations du segment de texte
+    Lane_Vector *_regs; //!< Registres généraux
+    Lane_Vector *_cc; //!< Code condition, en un bit (<tt>1 << cc</tt>)
+    Lane_Vector *_data; //!< Segment de données
+    Lane_Vector *_group; //!< Masque des voies du groupe courant
+    Lane_Vector *_waiting; //!< Masque des voies en attente
+    Lane_Vector *_pcs; //!< Compteur ordinal des voies en attente
+    Lane_Vector *_next; //!< Compteur ordinal de chaque voie après un branchement
+    unsigned _pc; //!< Compteur ordinal du groupe courant
+    unsigned _ngroup; //!< Nombre de voies du groupe courant
+    bool _any_waiting; //!< Des voies sont-elles en attente ?
+    Word _waiting_pc; //!< Plus petit compteur ordinal en attente
+} Lanes;
+
+//! Code condition en un bit d'un vecteur de résultats
+/*!
+ * Même classification que sign_class() : \c Word n'étant pas signé, un
+ * résultat non nul donne \c CC_P.
+ */
+LANE_INLINE Lane_Vector cc_bits(Lane_Vector value) {
+    Lane_Vector zero = (Lane_Vector) (value == 0);
+    return LANE_SELECT(zero, LANE_BROADCAST(1u << CC_Z), LANE_BROADCAST(1u << CC_P));
+}
+
+//! Une voie au moins est-elle à 1 dans le masque ?
+LANE_INLINE bool lane_any(Lane_Vector m) {
+    Word any = 0;
+    for (unsigned l = 0; l < LANE_WIDTH; l++) {
+        any |= m[l];
+    }
+    return any != 0;
+}
+
+//! Minimum voie par voie
+LANE_INLINE Lane_Vector lane_min(Lane_Vector a, Lane_Vector b) {
+    return LANE_SELECT((Lane_Vector) (a < b), a, b);
+}
+
+//! Plus petit élément d'un vecteur
+LANE_INLINE Word lane_hmin(Lane_Vector a) {
+    Word x = a[0];
+    for (unsigned l = 1; l < LANE_WIDTH; l++) {
+        x = a[l] < x ? a[l] : x;
+    }
+    return x;
+}
+
+//! Allocation d'un tableau de vecteurs alignés, mis à zéro
+static Lane_Vector *alloc_vectors(size_t n) {
+    void *p = NULL;
+    if (posix_memalign(&p, sizeof (Lane_Vector), sizeof (Lane_Vector) * (n > 0 ? n : 1)) != 0) {
+        perror("lanes");
+        exit(1);
+    }
+    memset(p, 0, sizeof (Lane_Vector) * (n > 0 ? n : 1));
+    return p;
+}
+
+//! Recopie de l'état d'une machine dans sa voie, mise en attente
+static void load_lane(Lanes *L, unsigned lane) {
+    const Machine *pmach = L->_machines[lane];
+    unsigned v = lane / LANE_WIDTH, l = lane % LANE_WIDTH;
+
+    for (unsigned r = 0; r < NREGISTERS; r++) {
+        L->_regs[r * L->_nvec + v][l] = pmach->_registers[r];
+    }
+    L->_cc[v][l] = 1u << current_cc(pmach);
+    for (unsigned a = 0; a < L->_datasize; a++) {
+        L->_data[a * L->_nvec + v][l] = pmach->_data[a];
+    }
+    L->_pcs[v][l] = pmach->_pc;
+    L->_waiting[v][l] = LANE_NONE;
+}
+
+//! Recopie de l'état d'une voie dans sa machine
+/*!
+ * \param L les voies
+ * \param lane la voie
+ * \param pc le compteur ordinal de la machine
+ */
+static void store_lane(Lanes *L, unsigned lane, unsigned pc) {
+    Machine *pmach = L->_machines[lane];
+    unsigned v = lane / LANE_WIDTH, l = lane % LANE_WIDTH;
+
+    for (unsigned r = 0; r < NREGISTERS; r++) {
+        pmach->_registers[r] = L->_regs[r * L->_nvec + v][l];
+    }
+    Condition_Code cc = CC_U;
+    while ((1u << cc) != L->_cc[v][l]) {
+        cc++;
+    }
+    pmach->_cc = cc;
+    pmach->_ccresult = CC_SETTLED;
+    pmach->_pc = pc;
+    for (unsigned a = 0; a < L->_datasize; a++) {
+        pmach->_data[a] = L->_data[a * L->_nvec + v][l];
+    }
+}
+
+//! Sortie d'une voie du groupe : sa machine reprend seule l'instruction en cours
+static void leave(Lanes *L, unsigned lane) {
+    store_lane(L, lane, L->_pc);
+    L->_status[lane] = run_alone(L->_machines[lane], L->_engine);
+    L->_group[lane / LANE_WIDTH][lane % LANE_WIDTH] = 0;
+    L->_ngroup--;
+}
+
+//! Sortie des voies du groupe désignées par un masque, dans un vecteur
+/*!
+ * Les voies qui feraient une erreur quittent le groupe avant toute
+ * modification de leur état : leur machine reproduit l'erreur seule.
+ */
+LANE_INLINE void leave_masked(Lanes *L, unsigned v, Lane_Vector m) {
+    m &= L->_group[v];
+    if (lane_any(m)) {
+        for (unsigned l = 0; l < LANE_WIDTH; l++) {
+            if (m[l] != 0) {
+                leave(L, v * LANE_WIDTH + l);
+            }
+        }
+    }
+}
+
+//! Sortie de tout le groupe (instruction rare ou hors du segment de texte)
+static void leave_group(Lanes *L) {
+    for (unsigned v = 0; v < L->_nvec; v++) {
+        leave_masked(L, v, L->_group[v]);
+    }
+}
+
+//! Arrêt de tout le groupe sur \c HALT
+static void halt_group(Lanes *L) {
+    for (unsigned lane = 0; lane < L->_nvec * LANE_WIDTH; lane++) {
+        if (L->_group[lane / LANE_WIDTH][lane % LANE_WIDTH] != 0) {
+            store_lane(L, lane, L->_pc + 1);
+            L->_status[lane] = (Simul_Status) {._err = ERR_NOERROR, ._addr = L->_pc, ._stopped = false};
+        }
+    }
+    memset(L->_group, 0, sizeof (Lane_Vector) * L->_nvec);
+    L->_ngroup = 0;
+}
+
+//! Nombre de voies du groupe courant
+static unsigned count_group(const Lanes *L) {
+    Lane_Vector n = {0};
+    for (unsigned v = 0; v < L->_nvec; v++) {
+        n -= L->_group[v]; // Une voie du masque vaut -1
+    }
+    unsigned count = 0;
+    for (unsigned l = 0; l < LANE_WIDTH; l++) {
+        count += n[l];
+    }
+    return count;
+}
+
+//! Mise à jour de la plus petite adresse des voies en attente
+static void update_waiting(Lanes *L) {
+    Lane_Vector lo = LANE_BROADCAST(LANE_NONE), any = {0};
+    for (unsigned v = 0; v < L->_nvec; v++) {
+        lo = lane_min(lo, LANE_SELECT(L->_waiting[v], L->_pcs[v], LANE_BROADCAST(LANE_NONE)));
+        any |= L->_waiting[v];
+    }
+    L->_any_waiting = lane_any(any);
+    L->_waiting_pc = lane_hmin(lo);
+}
+
+//! Choix du groupe suivant : les voies de plus petit compteur ordinal
+/*!
+ * Le groupe courant est d'abord mis en attente : s'il a rejoint des voies en
+ * attente, il repart avec elles.
+ *
+ * \return faux si toutes les voies sont arrêtées
+ */
+static bool regroup(Lanes *L) {
+    const unsigned nvec = L->_nvec;
+    for (unsigned v = 0; v < nvec; v++) {
+        L->_pcs[v] = LANE_SELECT(L->_group[v], LANE_BROADCAST(L->_pc), L->_pcs[v]);
+        L->_waiting[v] |= L->_group[v];
+    }
+    update_waiting(L);
+    if (!L->_any_waiting) {
+        return false;
+    }
+    Word pc = L->_waiting_pc;
+    for (unsigned v = 0; v < nvec; v++) {
+        L->_group[v] = L->_waiting[v] & (Lane_Vector) (L->_pcs[v] == pc);
+        L->_waiting[v] &= ~L->_group[v];
+    }
+    L->_pc = pc;
+    L->_ngroup = count_group(L);
+    update_waiting(L);
+    return true;
+}
+
+//! Suite du groupe après un branchement, d'après \c _next
+/*!
+ * Le groupe continue avec les voies qui vont à la plus petite adresse ; les
+ * autres sont mises en attente, chacune à son adresse.
+ */
+static void jump(Lanes *L) {
+    const unsigned nvec = L->_nvec;
+    Lane_Vector lo = LANE_BROADCAST(LANE_NONE);
+    for (unsigned v = 0; v < nvec; v++) {
+        lo = lane_min(lo, LANE_SELECT(L->_group[v], L->_next[v], LANE_BROADCAST(LANE_NONE)));
+    }
+    Word target = lane_hmin(lo);
+
+    Lane_Vector split = {0};
+    for (unsigned v = 0; v < nvec; v++) {
+        Lane_Vector wait = L->_group[v] & (Lane_Vector) (L->_next[v] != target);
+        L->_pcs[v] = LANE_SELECT(wait, L->_next[v], L->_pcs[v]);
+        L->_waiting[v] |= wait;
+        L->_group[v] &= ~wait;
+        split |= wait;
+    }
+    L->_pc = target;
+    if (lane_any(split)) {
+        L->_ngroup = count_group(L);
+        update_waiting(L);
+    }
+}
+
+//! Lecture d'un mot de données par voie, aux adresses \c a, pour les voies du masque \c m
+LANE_INLINE Lane_Vector gather(const Lanes *L, unsigned v, Lane_Vector a, Lane_Vector m) {
+    Lane_Vector x = {0};
+    for (unsigned l = 0; l < LANE_WIDTH; l++) {
+        if (m[l] != 0) {
+            x[l] = L->_data[a[l] * L->_nvec + v][l];
+        }
+    }
+    return x;
+}
+
+//! Écriture d'un mot de données par voie, aux adresses \c a, pour les voies du masque \c m
+LANE_INLINE void scatter(Lanes *L, unsigned v, Lane_Vector a, Lane_Vector x, Lane_Vector m) {
+    for (unsigned l = 0; l < LANE_WIDTH; l++) {
+        if (m[l] != 0) {
+            L->_data[a[l] * L->_nvec + v][l] = x[l];
+        }
+    }
+}
+
+//! Adresses d'un accès indexé ; les voies hors du segment quittent le groupe
+/*!
+ * L'adresse \c _datasize, acceptée par check_seg_data(), n'a pas de place
+ * dans les voies : la machine termine seule, comme pour une erreur.
+ */
+LANE_INLINE Lane_Vector indexed(Lanes *L, const Decoded *d, unsigned v) {
+    Lane_Vector a = L->_regs[d->_rindex * L->_nvec + v] + (Word) d->_operand;
+    leave_masked(L, v, (Lane_Vector) (a >= L->_datasize));
+    return a;
+}
+
+//! Opérande d'une instruction selon son mode d'adressage
+LANE_INLINE Lane_Vector fetch(Lanes *L, const Decoded *d, unsigned v) {
+    if (d->_flags & DECODED_IMMEDIATE) {
+        return LANE_BROADCAST(d->_operand);
+    }
+    if (d->_flags & DECODED_INDEXED) {
+        Lane_Vector a = indexed(L, d, v);
+        return gather(L, v, a, L->_group[v]);
+    }
+    return L->_data[(unsigned) d->_operand * L->_nvec + v];
+}
+
+//! Voies dont le pointeur de pile \c sp sort de la zone de pile (comme check_seg_stack())
+LANE_INLINE Lane_Vector stack_fault(const Lanes *L, Lane_Vector sp) {
+    return (Lane_Vector) (sp < L->_dataend) | (Lane_Vector) (sp >= L->_datasize);
+}
+
+//! Voies dont la condition de l'instruction est vraie
+LANE_INLINE Lane_Vector condition(const Lanes *L, const Decoded *d, unsigned v) {
+    return (Lane_Vector) ((L->_cc[v] & condition_masks[d->_regcond]) != 0);
+}
+
+//! Micro-opérations qui accèdent au segment de données par une adresse absolue
+static bool absolute_data(uint8_t uop) {
+    return uop == UOP_LOAD_A || uop == UOP_STORE_A || uop == UOP_ADD_A || uop == UOP_SUB_A
+            || uop == UOP_PUSH_A || uop == UOP_POP_A;
+}
+
+//! Exécution des voies jusqu'à l'arrêt de toutes
+/*!
+ * Chaque micro-opération a la sémantique de uops.h, appliquée aux voies du
+ * groupe courant ; les autres gardent leur état.
+ */
+static void execute(Lanes *L) {
+    const unsigned nvec = L->_nvec;
+    Lane_Vector *const data = L->_data;
+    Lane_Vector *const cc = L->_cc;
+    Lane_Vector *const group = L->_group;
+    Lane_Vector *const next = L->_next;
+    Lane_Vector *const sp = &L->_regs[(NREGISTERS - 1) * nvec];
+
+    for (;;) {
+        if ((L->_ngroup == 0 || (L->_any_waiting && L->_pc >= L->_waiting_pc)) && !regroup(L)) {
+            return;
+        }
+        const unsigned addr = L->_pc;
+        if (addr >= L->_textsize) {
+            leave_group(L); // La machine signale la sortie du segment de texte
+            continue;
+        }
+        const Decoded *d = &L->_decoded[addr];
+        Lane_Vector *const rd = &L->_regs[d->_regcond * nvec];
+        Lane_Vector *const ri = &L->_regs[d->_rindex * nvec];
+        const unsigned operand = (unsigned) d->_operand;
+
+        switch (d->_handler) {
+            case UOP_NOP:
+                break;
+            case UOP_LOAD_I:
+            case UOP_LOAD_A:
+            case UOP_LOAD_X:
+                for (unsigned v = 0; v < nvec; v++) {
+                    Lane_Vector x = fetch(L, d, v);
+                    rd[v] = LANE_SELECT(group[v], x, rd[v]);
+                    cc[v] = LANE_SELECT(group[v], cc_bits(x), cc[v]);
+                }
+                break;
+            case UOP_STORE_A:
+                for (unsigned v = 0; v < nvec; v++) {
+                    data[operand * nvec + v] = LANE_SELECT(group[v], rd[v], data[operand * nvec + v]);
+                }
+                break;
+            case UOP_STORE_X:
+                for (unsigned v = 0; v < nvec; v++) {
+                    Lane_Vector a = indexed(L, d, v);
+                    scatter(L, v, a, rd[v], group[v]);
+                }
+                break;
+            case UOP_ADD_I:
+            case UOP_ADD_A:
+            case UOP_ADD_X:
+                for (unsigned v = 0; v < nvec; v++) {
+                    Lane_Vector x = rd[v] + fetch(L, d, v);
+                    rd[v] = LANE_SELECT(group[v], x, rd[v]);
+                    cc[v] = LANE_SELECT(group[v], cc_bits(x), cc[v]);
+                }
+                break;
+            case UOP_SUB_I:
+            case UOP_SUB_A:
+            case UOP_SUB_X:
+                for (unsigned v = 0; v < nvec; v++) {
+                    Lane_Vector x = rd[v] - fetch(L, d, v);
+                    rd[v] = LANE_SELECT(group[v], x, rd[v]);
+                    cc[v] = LANE_SELECT(group[v], cc_bits(x), cc[v]);
+                }
+                break;
+            case UOP_BRANCH_A:
+            case UOP_BRANCH_X:
+                for (unsigned v = 0; v < nvec; v++) {
+                    Lane_Vector target = d->_handler == UOP_BRANCH_X ? ri[v] + operand : LANE_BROADCAST(operand);
+                    next[v] = LANE_SELECT(condition(L, d, v), target, LANE_BROADCAST(addr + 1));
+                }
+                jump(L);
+                continue;
+            case UOP_CALL_A:
+            case UOP_CALL_X:
+                for (unsigned v = 0; v < nvec; v++) {
+                    leave_masked(L, v, stack_fault(L, sp[v]));
+                    Lane_Vector m = group[v] & condition(L, d, v);
+                    scatter(L, v, sp[v], LANE_BROADCAST(addr + 1), m);
+                    sp[v] += m; // -1 pour les voies qui appellent
+                    Lane_Vector target = d->_handler == UOP_CALL_X ? ri[v] + operand : LANE_BROADCAST(operand);
+                    next[v] = LANE_SELECT(m, target, LANE_BROADCAST(addr + 1));
+                }
+                jump(L);
+                continue;
+            case UOP_RET:
+                for (unsigned v = 0; v < nvec; v++) {
+                    Lane_Vector up = sp[v] + 1;
+                    leave_masked(L, v, stack_fault(L, up));
+                    sp[v] = LANE_SELECT(group[v], up, sp[v]);
+                    next[v] = gather(L, v, sp[v], group[v]);
+                }
+                jump(L);
+                continue;
+            case UOP_PUSH_I:
+            case UOP_PUSH_A:
+            case UOP_PUSH_X:
+                for (unsigned v = 0; v < nvec; v++) {
+                    leave_masked(L, v, stack_fault(L, sp[v]));
+                    Lane_Vector x = fetch(L, d, v);
+                    scatter(L, v, sp[v], x, group[v]);
+                    sp[v] += group[v];
+                }
+                break;
+            case UOP_POP_A:
+            case UOP_POP_X:
+                for (unsigned v = 0; v < nvec; v++) {
+                    Lane_Vector a = d->_handler == UOP_POP_X ? indexed(L, d, v) : LANE_BROADCAST(operand);
+                    Lane_Vector up = sp[v] + 1;
+                    leave_masked(L, v, stack_fault(L, up));
+                    sp[v] = LANE_SELECT(group[v], up, sp[v]);
+                    scatter(L, v, a, gather(L, v, sp[v], group[v]), group[v]);
+                }
+                break;
+            case UOP_HALT:
+                halt_group(L);
+                continue;
+            default:
+                leave_group(L); // Instruction rare ou invalide
+                continue;
+        }
+        L->_pc = addr + 1;
+    }
+}
+
+void run_lanes(unsigned nlanes, Machine *machines[nlanes], Engine engine,
+        Simul_Status status[nlanes]) {
+    if (nlanes == 0) {
+        return;
+    }
+    const Machine *pfirst = machines[0];
+    unsigned nvec = (nlanes + LANE_WIDTH - 1) / LANE_WIDTH;
+    Lanes lanes = {
+        ._machines = machines,
+        ._status = status,
+        ._engine = engine,
+        ._nvec = nvec,
+        ._textsize = pfirst->_textsize,
+        ._datasize = pfirst->_datasize,
+        ._dataend = pfirst->_dataend,
+        ._decoded = predecode(pfirst->_textsize, pfirst->_text, pfirst->_datasize, false),
+        ._regs = alloc_vectors((size_t) NREGISTERS * nvec),
+        ._cc = alloc_vectors(nvec),
+        ._data = alloc_vectors((size_t) pfirst->_datasize * nvec),
+        ._group = alloc_vectors(nvec),
+        ._waiting = alloc_vectors(nvec),
+        ._pcs = alloc_vectors(nvec),
+        ._next = alloc_vectors(nvec),
+        ._ngroup = 0,
+        ._any_waiting = false,
+    };
+    for (unsigned i = 0; i < lanes._textsize; i++) {
+        if (absolute_data(lanes._decoded[i]._handler) && (unsigned) lanes._decoded[i]._operand >= lanes._datasize) {
+            lanes._decoded[i]._handler = UOP_FAULT; // Adresse _datasize : voir indexed()
+        }
+    }
+    for (unsigned lane = 0; lane < nlanes; lane++) {
+        load_lane(&lanes, lane);
+    }
+
+    execute(&lanes);
+
+    free(lanes._decoded);
+    free(lanes._regs);
+    free(lanes._cc);
+    free(lanes._data);
+    free(lanes._group);
+    free(lanes._waiting);
+    free(lanes._pcs);
+    free(lanes._next);
+}
+
+#else
+
+// Sans l'extension vector_size : chaque machine s'exécute seule
+
+void run_lanes(unsigned nlanes, Machine *machines[nlanes], Engine engine,
+        Simul_Status status[nlanes]) {
+    for (unsigned i = 0; i < nlanes; i++) {
+        status[i] = run_alone(machines[i], engine);
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _LANES_H_
+#define _LANES_H_
+
+/*!
+ * \file lanes.h
+ * \brief Exécution en voies parallèles (SIMD) d'un même programme sur plusieurs machines.
+ *
+ * Beaucoup de lots exécutent le même segment de texte sur des segments de
+ * données initiaux différents. Plutôt que d'interpréter chaque machine à son
+ * tour, on les fait avancer ensemble, une instruction pour toutes : chaque
+ * machine est une \e voie, et l'état des voies est rangé « en colonnes » (un
+ * vecteur de \c LANE_WIDTH mots par registre, par mot de données et par code
+ * condition), si bien que \c LOAD, \c STORE, \c ADD et \c SUB deviennent des
+ * opérations vectorielles de l'hôte (extension \c vector_size de GNU C).
+ *
+ * Les voies qui exécutent la même instruction forment le \e groupe courant,
+ * désigné par un masque. Un branchement dont les voies ne prennent pas toutes
+ * la même direction sépare le groupe : les voies sont mises en attente avec
+ * leur propre compteur ordinal, et c'est toujours le groupe de plus petit
+ * compteur ordinal qui s'exécute. Un groupe qui atteint l'adresse où d'autres
+ * voies attendent les reprend : les voies se rejoignent dès qu'elles
+ * reconvergent, par exemple en sortie de boucle.
+ *
+ * Les voies sont indépendantes : chacune a exactement le comportement
+ * qu'aurait sa machine exécutée seule. Une voie qui ferait une erreur, ou
+ * qui atteint une instruction rare (\c XADD, \c XCHG, \c BARRIER,
+ * instruction invalide), quitte les voies avant de l'exécuter : son état est
+ * recopié dans sa machine, qui termine seule avec le moteur choisi (voir
+ * simul_run()). Les compilateurs sans l'extension de GNU C exécutent toutes
+ * les machines ainsi.
+ */
+
+#include <stdbool.h>
+
+#include "simulator.h"
+
+//! Nombre de voies d'un vecteur
+/*!
+ * 4 mots de 32 bits : un registre SSE2 (ou NEON), disponible sur tout
+ * processeur 64 bits sans option de compilation. Une exécution compte autant
+ * de vecteurs par mot qu'il faut pour ses voies.
+ */
+#define LANE_WIDTH 4
+
+//! Les deux machines peuvent-elles s'exécuter en voies parallèles ?
+/*!
+ * Il faut le même segment de texte, la même taille de segment de données et
+ * la même fin des données statiques ; le contenu des données et l'état du
+ * processeur peuvent différer.
+ *
+ * \param pa une machine chargée
+ * \param pb une autre machine chargée
+ * \return vrai si les programmes sont compatibles
+ */
+bool lanes_compatible(const Machine *pa, const Machine *pb);
+
+//! Exécution en voies parallèles de machines compatibles jusqu'à leur arrêt
+/*!
+ * Chaque machine s'exécute, sans trace ni avertissement, jusqu'au \c HALT ou
+ * jusqu'à sa première erreur, qui est rangée dans son \c status sans arrêter
+ * les autres. L'état final de chaque machine (registres, code condition,
+ * compteur ordinal, segment de données) est celui qu'aurait donné
+ * simul_run().
+ *
+ * \note Comme avec run_batch(), une voie qui ne s'arrête jamais bloque
+ * l'exécution.
+ *
+ * \param nlanes le nombre de machines
+ * \param machines les machines, chargées et deux à deux compatibles (voir lanes_compatible())
+ * \param engine le moteur des machines qui quittent les voies
+ * \param status l'issue de l'exécution de chaque machine
+ */
+void run_lanes(unsigned nlanes, Machine *machines[nlanes], Engine engine,
+        Simul_Status status[nlanes]);
+
+#endif
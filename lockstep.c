@@ -0,0 +1,184 @@
+/*!
+ * \file lockstep.c
+ * \brief Vérification d'un moteur d'exécution contre l'interpréteur de référence.
+ *
+ * lockstep exécute chaque programme à la fois avec le moteur choisi et avec
+ * l'interpréteur de référence (\c switch), en comparant les deux machines
+ * toutes les \c n instructions (voir check_lockstep()). Les programmes sont
+ * soit des fichiers binaires donnés en argument, soit des programmes
+ * aléatoires (voir write_random_program()) écrits dans un répertoire de
+ * travail ; les programmes aléatoires sur lesquels les moteurs divergent y
+ * sont conservés pour être rejoués, les autres sont effacés.
+ *
+ * Pour chaque programme en argument, une ligne de la forme suivante est
+ * écrite :
+ *
+ * \verbatim
+   lockstep: Examples/prog_simple.bin: ok (22 instructions, halt at 0x0008)
+   \endverbatim
+ *
+ * Chaque divergence (programme en argument ou aléatoire) donne le rapport de
+ * check_lockstep() suivi d'une ligne \c DIVERGED.
+ *
+ * Le code de retour est non nul si une divergence a été trouvée.
+ */
+
+#define _DEFAULT_SOURCE // Pour getopt()
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checker.h"
+
+//! Help message.
+static void usage(void) {
+    printf("Usage: lockstep [options] [binfile...]\n");
+    printf("where options are:\n"
+           "\t-e\tEngine to check against the reference (switch) interpreter:\n"
+           "\t\tdecoded, threaded or jit (default: jit)\n"
+           "\t-n\tCompare both machines every n instructions (default: 1000)\n"
+           "\t-l\tStop each program after this many instructions\n"
+           "\t\t(default: 1000000, 0 for no limit)\n"
+           "\t-r\tAlso check this many random programs (default: 0)\n"
+           "\t-s\tSeed of the first random program (default: 1)\n"
+           "\t-d\tDirectory where random programs are written (default: .);\n"
+           "\t\tthose on which the engines diverge are kept\n"
+           "\t-h\tprint this help message\n"
+           "binfiles must contain valid programs in binary format (see test_simul -b).\n");
+}
+
+//! Vérification d'un programme.
+
+/*!
+ * \param file le fichier binaire
+ * \param options les options de la vérification
+ * \param verbose résultat affiché même en l'absence de divergence ?
+ * \return 0 si les moteurs concordent, 1 s'ils divergent, -1 si le fichier
+ * est illisible
+ */
+static int check_file(const char *file, const Check_Options *options, bool verbose) {
+    Machine *pref = simul_create();
+    Machine *pfast = simul_create();
+    if (pref == NULL || pfast == NULL) {
+        perror("lockstep");
+        exit(EXIT_FAILURE);
+    }
+    // Zone de garde pour le moteur vérifié : ses erreurs de segment de
+    // données passent alors par le traitant de SIGSEGV (voir guard.h)
+    Memory_Options memory = {._datasize = 0, ._hugepages = false, ._guard = true};
+    if (!simul_load(pref, file) || !simul_load_with(pfast, file, &memory)) {
+        perror(file);
+        simul_destroy(pref);
+        simul_destroy(pfast);
+        return -1;
+    }
+
+    Check_Result result = check_lockstep(pref, pfast, options);
+    if (result._diverged) {
+        printf("lockstep: %s: DIVERGED after %" PRIu64 " identical instructions\n",
+               file, result._executed);
+    } else if (verbose) {
+        printf("lockstep: %s: ok (%" PRIu64 " instructions, ", file, result._executed);
+        if (result._status._stopped) {
+            printf("limit reached at 0x%04x)\n", result._status._addr);
+        } else if (result._status._err == ERR_NOERROR) {
+            printf("halt at 0x%04x)\n", result._status._addr);
+        } else {
+            printf("error)\n");
+            print_error(result._status._err, result._status._addr);
+        }
+    }
+    simul_destroy(pref);
+    simul_destroy(pfast);
+    return result._diverged ? 1 : 0;
+}
+
+//! Programme de vérification
+int main(int argc, char *argv[]) {
+    Check_Options options = {
+        ._engine = ENGINE_JIT,
+        ._interval = 1000,
+        ._limit = 1000000,
+    };
+    unsigned count = 0, seed = 1;
+    const char *dir = ".";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:n:l:r:s:d:h")) != -1) {
+        switch (opt) {
+            case 'e':
+                if (!engine_from_name(optarg, &options._engine)) {
+                    fprintf(stderr, "Unknown engine: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n':
+                options._interval = strtoull(optarg, NULL, 10);
+                if (options._interval == 0) {
+                    fprintf(stderr, "Invalid interval: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                options._limit = strtoull(optarg, NULL, 10);
+                break;
+            case 'r':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc && count == 0) {
+        fprintf(stderr, "Missing binary file or random program count\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = optind; i < argc; i++) {
+        if (check_file(argv[i], &options, true) != 0) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    unsigned diverged = 0;
+    char file[4096];
+    for (unsigned i = 0; i < count; i++) {
+        snprintf(file, sizeof file, "%s/random_%u.bin", dir, seed + i);
+        if (!write_random_program(seed + i, file)) {
+            perror(file);
+            return EXIT_FAILURE;
+        }
+        int checked = check_file(file, &options, false);
+        if (checked == 0) {
+            remove(file);
+        } else if (checked > 0) {
+            diverged++;
+        }
+        if (checked != 0) {
+            status = EXIT_FAILURE;
+        }
+    }
+    if (count > 0) {
+        fprintf(stderr, "lockstep: %u random programs checked against %s (seeds %u to %u),"
+                " %u divergent\n", count, engine_names[options._engine], seed,
+                seed + count - 1, diverged);
+    }
+    return status;
+}
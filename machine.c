@@ -1,27 +1,25 @@
+#define _DEFAULT_SOURCE // Pour MAP_ANONYMOUS
+
 #include "machine.h"
 #include "exec.h"
 #include "instruction.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "debug.h"
+#include "engine.h"
+#include "error.h"
+#include "guard.h"
+#include "output.h"
 
-Instruction* instructionToFree;
-Word * dataToFree;
-static int needFree = 0;
-//! Chargement d'un programme
-
-/*!
- * La machine est réinitialisée et ses segments de texte et de données sont
- * remplacés par ceux fournis en paramètre.
- *
- * \param pmach la machine en cours d'exécution
- * \param textsize taille utile du segment de texte
- * \param text le contenu du segment de texte
- * \param datasize taille utile du segment de données
- * \param data le contenu initial du segment de texte
- */
-void load_program(Machine *pmach, unsigned textsize, Instruction text[textsize], unsigned datasize, Word data[datasize], unsigned dataend) {
+//! Mise en place des segments et remise à zéro des registres, sans pré-décodage
+static void set_program(Machine *pmach, unsigned textsize, Instruction text[textsize], unsigned datasize, Word data[datasize], unsigned dataend) {
 
     pmach->_textsize = textsize;
     pmach->_text = text;
@@ -30,7 +28,14 @@ void load_program(Machine *pmach, unsigned textsize, Instruction text[textsize],
     pmach->_dataend = dataend;
     pmach->_pc = 0;
     pmach->_cc = CC_U;
-
+    pmach->_ccresult = CC_SETTLED;
+    pmach->_textmap = (Mapping) {NULL, 0};
+    pmach->_datamap = (Mapping) {NULL, 0};
+    pmach->_guardmap = (Mapping) {NULL, 0};
+    pmach->_threaded = NULL;
+    pmach->_jit = NULL;
+    pmach->_smp = NULL;
+    pmach->_core = 0;
 
     for (int i = 0; i < NREGISTERS - 1; i++) {
         pmach->_registers[i] = 0x0;
@@ -38,17 +43,67 @@ void load_program(Machine *pmach, unsigned textsize, Instruction text[textsize],
     pmach->_registers[15] = datasize - 1;
 }
 
-//! Lecture d'un programme depuis un fichier binaire
+//! Pré-décodage et vérification du segment de texte, puis repérage des superinstructions
+/*!
+ * \param pmach la machine dont les segments sont en place
+ * \param guarded le segment de données est-il gardé (voir guard.h) ?
+ */
+static void decode_program(Machine *pmach, bool guarded) {
+    pmach->_decoded = predecode(pmach->_textsize, pmach->_text, pmach->_datasize, guarded);
+    pmach->_fusion = fuse(pmach->_textsize, pmach->_decoded);
+}
 
-static void free_memory() {
+//! Chargement d'un programme
 
-    if (needFree == 1) {
-        free(instructionToFree);
-        free(dataToFree);
-    }
+/*!
+ * La machine est réinitialisée et ses segments de texte et de données sont
+ * remplacés par ceux fournis en paramètre. Le segment de texte est pré-décodé
+ * et vérifié une fois pour toutes (voir predecode()) et ses superinstructions
+ * sont repérées (voir fuse()).
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param textsize taille utile du segment de texte
+ * \param text le contenu du segment de texte
+ * \param datasize taille utile du segment de données
+ * \param data le contenu initial du segment de texte
+ */
+void load_program(Machine *pmach, unsigned textsize, Instruction text[textsize], unsigned datasize, Word data[datasize], unsigned dataend) {
+    set_program(pmach, textsize, text, datasize, data, dataend);
+    decode_program(pmach, false);
+}
+
+//! Libération des ressources allouées par load_program()
 
+/*!
+ * Les segments projetés par read_program() sont libérés eux aussi, ainsi que
+ * la zone de garde du segment de données.
+ *
+ * \param pmach la machine dont le programme est déchargé
+ */
+void unload_program(Machine *pmach) {
+    if (pmach->_guardmap._addr != NULL) {
+        unguard_machine(pmach);
+        munmap(pmach->_guardmap._addr, pmach->_guardmap._size);
+        pmach->_guardmap = (Mapping) {NULL, 0};
+    }
+    if (pmach->_textmap._addr != NULL) {
+        munmap(pmach->_textmap._addr, pmach->_textmap._size);
+        pmach->_textmap = (Mapping) {NULL, 0};
+    }
+    if (pmach->_datamap._addr != NULL) {
+        munmap(pmach->_datamap._addr, pmach->_datamap._size);
+        pmach->_datamap = (Mapping) {NULL, 0};
+    }
+    free(pmach->_decoded);
+    pmach->_decoded = NULL;
+    free_fusion(pmach->_fusion);
+    pmach->_fusion = NULL;
+    free_threaded(pmach);
+    free_jit(pmach);
 }
 
+//! Lecture d'un programme depuis un fichier binaire
+
 /*!
  * Le fichier binaire a le format suivant :
  *
@@ -70,37 +125,204 @@ static void free_memory() {
  *
  */
 void read_program(Machine *mach, const char *programfile) {
-    FILE * program = fopen(programfile, "r");
-    if (program == NULL) {
-        perror("machine.c");
+    if (!try_read_program(mach, programfile)) {
+        perror(programfile);
         exit(1);
     }
-    unsigned int textsize;
-    unsigned int datasize;
-    unsigned int dataend;
+}
 
-    fread(&textsize, sizeof (unsigned int), 1, program);
-    fread(&datasize, sizeof (unsigned int), 1, program);
-    fread(&dataend, sizeof (unsigned int), 1, program);
+//! Lecture d'un programme depuis un fichier binaire, sans arrêt en cas d'échec
 
-    Instruction* text = malloc(sizeof (Instruction) * textsize);
-    Word *data = malloc(sizeof (Word) * datasize);
+/*!
+ * \param pmach la machine à simuler
+ * \param programfile le nom du fichier binaire
+ * \return faux (et \c errno positionnée) si le fichier n'a pas pu être lu
+ */
+bool try_read_program(Machine *mach, const char *programfile) {
+    Memory_Options options = {._datasize = 0, ._hugepages = false, ._guard = false};
+    return try_map_program(mach, programfile, &options);
+}
 
-    fread(text, sizeof (Instruction), textsize, program);
-    fread(data, sizeof (Word), datasize, program);
-    if (ferror(program) != 0) {
-        perror("machine");
-        exit(1);
+//! Réservation du segment de données en grandes pages
+
+/*!
+ * On essaie d'abord des pages géantes explicites (\c MAP_HUGETLB), qui
+ * n'existent que si l'administrateur en a réservé (la projection les
+ * réserve toutes : sans cela, le manque de pages se traduirait par un
+ * \c SIGBUS en cours d'exécution) ; à défaut, des pages ordinaires que le
+ * noyau peut regrouper en grandes pages transparentes.
+ *
+ * \param pmap la projection (\c _size est arrondie au besoin)
+ * \return faux (et \c errno positionnée) si la mémoire manque
+ */
+static bool map_hugepages(Mapping *pmap) {
+#ifdef MAP_HUGETLB
+    size_t hugesize = (size_t) 2 << 20;
+    size_t size = (pmap->_size + hugesize - 1) / hugesize * hugesize;
+    pmap->_addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (pmap->_addr != MAP_FAILED) {
+        pmap->_size = size;
+        return true;
     }
-    fclose(program);
+#endif
+    pmap->_addr = mmap(NULL, pmap->_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pmap->_addr == MAP_FAILED) {
+        pmap->_addr = NULL;
+        return false;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(pmap->_addr, pmap->_size, MADV_HUGEPAGE); // Simple conseil : échec sans gravité
+#endif
+    return true;
+}
 
-    instructionToFree = text;
-    dataToFree = data;
-    needFree = 1;
-    atexit(free_memory);
+//! Lecture d'un programme avec un segment de données de taille choisie
 
-    load_program(mach, textsize, text, datasize, data, dataend);
+/*!
+ * \param pmach la machine à simuler
+ * \param programfile le nom du fichier binaire
+ * \param options la taille déclarée du segment de données et le choix des
+ * grandes pages
+ * \return faux (et \c errno positionnée) si le fichier n'a pas pu être lu
+ */
+bool try_map_program(Machine *mach, const char *programfile, const Memory_Options *options) {
+    int fd = open(programfile, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    Mapping textmap = {NULL, 0};
+    Mapping datamap = {NULL, 0};
+    Mapping guardmap = {NULL, 0};
+    uint32_t *header;
+
+    if (fstat(fd, &st) != 0) {
+        goto failed;
+    }
+    if (!S_ISREG(st.st_mode) || (uint64_t) st.st_size < 3 * sizeof (uint32_t)
+            || (uint64_t) st.st_size > SIZE_MAX) {
+        errno = EINVAL;
+        goto failed;
+    }
+
+    // Le fichier entier, partagé avec le cache des pages : en-tête et texte
+    textmap._size = st.st_size;
+    textmap._addr = mmap(NULL, textmap._size, PROT_READ, MAP_SHARED, fd, 0);
+    if (textmap._addr == MAP_FAILED) {
+        textmap._addr = NULL;
+        goto failed;
+    }
+    header = textmap._addr;
+    unsigned textsize = header[0];
+    unsigned datasize = header[1];
+    unsigned dataend = header[2];
+    uint64_t dataoffset = 3 * sizeof (uint32_t) + (uint64_t) textsize * sizeof (Instruction);
+    if (dataoffset + (uint64_t) datasize * sizeof (Word) > (uint64_t) st.st_size
+            || (options->_datasize != 0 && options->_datasize < datasize)) {
+        errno = EINVAL; // Fichier plus court que ne l'annonce l'en-tête, ou taille déclarée trop petite
+        goto failed;
+    }
+    unsigned declared = options->_datasize != 0 ? options->_datasize : datasize;
+
+    // Segment de données : les données du fichier, complétées par des zéros
+    // jusqu'à la taille déclarée, plus un mot nul (check_seg_data() autorise
+    // l'adresse declared). On réserve d'abord des pages anonymes (donc nulles,
+    // et allouées seulement quand le programme les touche) pour le tout.
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    size_t datalength = (size_t) datasize * sizeof (Word);
+    size_t skip = 0;
+    Word *data;
+    if (options->_hugepages) {
+        // Les grandes pages sont anonymes : les données sont lues, pas projetées
+        datamap._size = ((size_t) declared + 1) * sizeof (Word);
+        if (!map_hugepages(&datamap)) {
+            goto failed;
+        }
+        data = datamap._addr;
+        if (datalength > 0) {
+            memcpy(data, (char *) textmap._addr + dataoffset, datalength);
+        }
+    } else {
+        // Segment suivi d'une zone de garde si elle est demandée et s'il se
+        // peut : il finit alors sur une fin de page, et commence où il peut
+        // dans la première
+        size_t length = ((size_t) declared + 1) * sizeof (Word);
+        data = options->_guard ? map_guarded(length, &datamap, &guardmap) : NULL;
+        if (data == NULL) {
+            skip = dataoffset % pagesize;
+            datamap._size = (skip + length + pagesize - 1) / pagesize * pagesize;
+            datamap._addr = mmap(NULL, datamap._size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (datamap._addr == MAP_FAILED) {
+                datamap._addr = NULL;
+                goto failed;
+            }
+            data = (Word *) ((char *) datamap._addr + skip);
+        }
+        skip = (char *) data - (char *) datamap._addr;
+        if (skip != dataoffset % pagesize) {
+            // Décalages incompatibles : les données sont recopiées
+            if (datalength > 0) {
+                memcpy(data, (char *) textmap._addr + dataoffset, datalength);
+            }
+        } else {
+            // Copie privée sur écriture des pages du fichier, projetées à
+            // partir de la page qui contient le début des données
+            off_t fileoffset = dataoffset - skip;
+            size_t filesize = skip + datalength;
+            if (filesize > skip && mmap(datamap._addr, filesize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_FIXED, fd, fileoffset) == MAP_FAILED) {
+                goto failed;
+            }
+            // La dernière page projetée peut contenir la suite du fichier
+            size_t tail = (filesize + pagesize - 1) / pagesize * pagesize;
+            if (tail > datamap._size) {
+                tail = datamap._size;
+            }
+            if (tail > filesize) {
+                memset((char *) datamap._addr + filesize, 0, tail - filesize);
+            }
+        }
+    }
+    close(fd);
+
+    set_program(mach, textsize, (Instruction *) (header + 3), declared, data, dataend);
+    mach->_textmap = textmap;
+    mach->_datamap = datamap;
+    mach->_guardmap = guardmap;
+    decode_program(mach, guardmap._addr != NULL && guard_machine(mach));
+    return true;
+
+failed:
+    {
+        int saved = errno;
+        if (textmap._addr != NULL) {
+            munmap(textmap._addr, textmap._size);
+        }
+        if (datamap._addr != NULL) {
+            munmap(datamap._addr, datamap._size);
+        }
+        if (guardmap._addr != NULL) {
+            munmap(guardmap._addr, guardmap._size);
+        }
+        close(fd);
+        errno = saved;
+    }
+    return false;
+}
 
+//! Rédaction d'un tableau C de mots en hexadécimal (4 par ligne)
+static void output_words(Output *pout, const uint32_t *words, unsigned n) {
+    for (unsigned i = 0; i < n; i++) {
+        if (i % 4 == 0) {
+            output_string(pout, "\n\t");
+        }
+        output_string(pout, "0x");
+        output_hex(pout, words[i], 8);
+        output_char(pout, ',');
+    }
 }
 
 //! Affichage du programme et des données
@@ -109,9 +331,34 @@ void read_program(Machine *mach, const char *programfile) {
  * On affiche les instruction et les données en format hexadécimal, sous une
  * forme prête à être coupée-collée dans le simulateur.
  *
- * Pendant qu'on y est, on produit aussi un dump binaire dans le fichier
- * dump.prog. Le format de ce fichier est compatible avec l'option -b de
- * test_simul.
+ * \param pmach la machine en cours d'exécution
+ */
+void print_memory(Machine *pmach) {
+    Output out;
+    output_init(&out, 64 + 12 * ((size_t) pmach->_textsize + pmach->_datasize));
+
+    output_string(&out, "Instruction text[] = {\n\t");
+    output_words(&out, &pmach->_text[0]._raw, pmach->_textsize);
+    output_string(&out, "\n};\nunsigned textsize = ");
+    output_unsigned(&out, pmach->_textsize);
+    output_string(&out, ";\n\nWord data[] = {\n\t");
+    output_words(&out, pmach->_data, pmach->_datasize);
+    output_string(&out, "\n};\nunsigned datasize = ");
+    output_unsigned(&out, pmach->_datasize);
+    output_string(&out, ";\nunsigned dataend = ");
+    output_unsigned(&out, pmach->_dataend);
+    output_string(&out, ";\n");
+
+    output_flush(&out, stdout);
+    output_free(&out);
+}
+
+//! Affichage du programme et des données, et sauvegarde binaire
+
+/*!
+ * Comme print_memory(), mais pendant qu'on y est, on produit aussi un dump
+ * binaire dans le fichier dump.prog. Le format de ce fichier est compatible
+ * avec l'option -b de test_simul.
  *
  * \param pmach la machine en cours d'exécution
  */
@@ -133,29 +380,7 @@ void dump_memory(Machine *pmach) {
     }
     fclose(dump);
 
-    printf("Instruction text[] = {\n\t");
-    for (int i = 0; i < pmach->_textsize; i++) {
-        if (i % 4 == 0) {
-            printf("\n\t");
-        }
-        printf("0x%08X,", pmach->_text[i]);
-
-    }
-    printf("\n");
-    printf("};\n");
-    printf("unsigned textsize = %d;\n", pmach->_textsize);
-    printf("\nWord data[] = {\n\t");
-    for (int i = 0; i < pmach->_datasize; i++) {
-        if (i % 4 == 0) {
-            printf("\n\t");
-        }
-        printf("0x%08X,", pmach->_data[i]);
-    }
-    printf("\n");
-    printf("};\n");
-    printf("unsigned datasize = %d;\n", pmach->_datasize);
-    printf("unsigned dataend = %d;\n", pmach->_dataend);
-
+    print_memory(pmach);
 }
 
 //! Affichage des instructions du programme
@@ -183,16 +408,50 @@ void print_program(Machine *pmach) {
  * \param pmach la machine en cours d'exécution
  */
 void print_data(Machine *pmach) {
+    print_data_range(pmach, 0, pmach->_datasize);
+}
 
-    printf("\n\n*** DATA (size: %d, end = %08X (%d)) ***\n", pmach->_datasize, pmach->_dataend, pmach->_dataend);
-    for (int i = 0; i < pmach->_datasize; i++) {
-        if (i % 3 == 0) {
-            printf("\n");
+//! Affichage d'une partie des données du programme
+
+/*!
+ * Comme print_data(), mais seuls les mots d'adresses \c first à \c end - 1
+ * sont affichés.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param first l'adresse du premier mot affiché
+ * \param end l'adresse qui suit le dernier mot affiché (ramenée à
+ * \c _datasize si elle le dépasse)
+ */
+void print_data_range(Machine *pmach, unsigned first, unsigned end) {
+    if (end > pmach->_datasize) {
+        end = pmach->_datasize;
+    }
+    Output out;
+    output_init(&out, 96 + 32 * (size_t) (first < end ? end - first : 0));
+
+    output_string(&out, "\n\n*** DATA (size: ");
+    output_unsigned(&out, pmach->_datasize);
+    output_string(&out, ", end = ");
+    output_hex(&out, pmach->_dataend, 8);
+    output_string(&out, " (");
+    output_signed(&out, pmach->_dataend);
+    output_string(&out, ")) ***\n");
+    for (unsigned i = first; i < end; i++) {
+        if ((i - first) % 3 == 0) {
+            output_char(&out, '\n');
         }
-        printf("0x%04X: %08X %d\t", i, pmach->_data[i], pmach->_data[i]);
+        output_string(&out, "0x");
+        output_hex(&out, i, 4);
+        output_string(&out, ": ");
+        output_hex(&out, pmach->_data[i], 8);
+        output_char(&out, ' ');
+        output_signed(&out, pmach->_data[i]);
+        output_char(&out, '\t');
     }
-    printf("\n");
+    output_char(&out, '\n');
 
+    output_flush(&out, stdout);
+    output_free(&out);
 }
 
 //! Affichage des registres du CPU
@@ -203,36 +462,35 @@ void print_data(Machine *pmach) {
  * \param pmach la machine en cours d'exécution
  */
 void print_cpu(Machine *pmach) {
-    printf("\n\n*** CPU ***\n");
-    printf("PC: %08X\t CC: ", pmach->_pc);
-    switch (pmach->_cc) {
-        case CC_U:
-            printf("U");
-            break;
-        case CC_Z:
-            printf("Z");
-            break;
-        case CC_N:
-            printf("N");
-            break;
-        case CC_P:
-            printf("P");
-            break;
+    static const char cc_letters[] = "UZPN";
+    Output out;
+    output_init(&out, 512);
+    settle_cc(pmach);
+
+    output_string(&out, "\n\n*** CPU ***\nPC: ");
+    output_hex(&out, pmach->_pc, 8);
+    output_string(&out, "\t CC: ");
+    if (pmach->_cc <= LAST_CC) {
+        output_char(&out, cc_letters[pmach->_cc]);
     }
-    printf("\n");
-    for (int i = 0; i < NREGISTERS; i++) {
+    output_char(&out, '\n');
+    for (unsigned i = 0; i < NREGISTERS; i++) {
         if (i % 3 == 0) {
-            printf("\n");
+            output_char(&out, '\n');
         }
-        if (i < 10) {
-            printf("R0%d ", i);
-        } else {
-            printf("R%d ", i);
-        }
-        printf("0x%08X %d\t", pmach->_registers[i], pmach->_registers[i]);
+        output_char(&out, 'R');
+        output_char(&out, '0' + i / 10);
+        output_char(&out, '0' + i % 10);
+        output_string(&out, " 0x");
+        output_hex(&out, pmach->_registers[i], 8);
+        output_char(&out, ' ');
+        output_signed(&out, pmach->_registers[i]);
+        output_char(&out, '\t');
     }
-    printf("\n");
+    output_char(&out, '\n');
 
+    output_flush(&out, stdout);
+    output_free(&out);
 }
 
 
@@ -249,6 +507,9 @@ void print_cpu(Machine *pmach) {
 void simul(Machine *pmach, bool debug) {
     int execute = 1;
     while (execute) {
+        if (pmach->_pc >= pmach->_textsize) {
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
         pmach->_pc = pmach->_pc + 1;
         trace("TRACE: Executing:", pmach, pmach->_text[pmach->_pc - 1], pmach->_pc - 1);
         execute = decode_execute(pmach, pmach->_text[pmach->_pc - 1]);
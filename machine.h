@@ -7,8 +7,12 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "instruction.h"
+#include "decode.h"
+#include "fusion.h"
 
 //! Nombre de resitres généraux
 #define NREGISTERS 16
@@ -34,9 +38,28 @@ typedef enum {
 //! Dernière valeur possible du code condition
 static const unsigned LAST_CC = CC_N;
 
+//! Valeur de \c _ccresult quand \c _cc est à jour (voir \link Machine \endlink)
+#define CC_SETTLED INT64_MIN
+
 //! Taille minimale de la pile d'exécution
 static const unsigned MINSTACKSIZE = 10;
 
+//! Taille de l'espace d'adressage des données (adresses absolues de 20 bits)
+static const unsigned MAX_DATASIZE = 1u << 20;
+
+//! Options de mise en place du segment de données (voir try_map_program())
+typedef struct {
+    unsigned _datasize; //!< Taille déclarée du segment (0 : celle du fichier)
+    bool _hugepages; //!< Segment en grandes pages ?
+    bool _guard; //!< Segment suivi d'une zone de garde, traitant de \c SIGSEGV compris (voir guard.h) ?
+} Memory_Options;
+
+//! Projection en mémoire d'une partie d'un fichier (voir mmap())
+typedef struct {
+    void *_addr; //!< Début de la projection, ou NULL
+    size_t _size; //!< Taille de la projection en octets
+} Mapping;
+
 //! Structure générale de la machine.
 
 /*!
@@ -60,6 +83,12 @@ static const unsigned MINSTACKSIZE = 10;
  *   instruction à exécuter ;
  *
  *   - un registre contenant le code condition (voir \link Condition_Code \endlink) ;
+ *   l'interpréteur de référence (exec.c) le met à jour à chaque instruction.
+ *   Par souci d'efficacité, dans les moteurs rapides (voir uops.h), \c LOAD,
+ *   \c ADD et \c SUB ne font que ranger leur résultat dans \c _ccresult, et
+ *   le code condition n'en est déduit qu'à la demande (voir current_cc() et
+ *   settle_cc()). Ces moteurs le déduisent avant de confier une instruction
+ *   à l'interpréteur de référence et en rendant la main ;
  *
  *   - un ensemble de 16 <b>registres généraux</b> servant d'accumulateurs
  *   (registres de calcul). Tous ces registres sont identiques et
@@ -81,16 +110,63 @@ typedef struct {
     // Registres de l'unité centrale
     unsigned _pc; //!< Compteur ordinal
     Condition_Code _cc; //!< Code condition : signe de la dernière opération
+    int64_t _ccresult; //!< Résultat dont \c _cc n'est pas encore déduit, ou \c CC_SETTLED
     Word _registers[NREGISTERS]; //!< Registres généraux (accumulateurs)
 
+    // État propre au simulateur
+    Decoded *_decoded; //!< Cache des instructions pré-décodées (voir predecode())
+    Fusion *_fusion; //!< Superinstructions des moteurs rapides (voir fuse())
+    struct Threaded_Tables *_threaded; //!< Tables de l'interpréteur à enfilage direct, ou NULL (voir threaded.c)
+    struct Jit *_jit; //!< Blocs traduits en code natif, ou NULL (voir jit.c)
+    Mapping _textmap; //!< Projection partagée du fichier lu par read_program()
+    Mapping _datamap; //!< Projection privée du segment de données lu par read_program()
+    Mapping _guardmap; //!< Zone de garde qui suit ce segment (voir guard.h)
+    struct Smp *_smp; //!< Multiprocesseur dont la machine est un cœur, ou NULL (voir smp.h)
+    unsigned _core; //!< Numéro du cœur dans \c _smp
+
     //! Définition de _sp comme synonyme du registre R15
 #define _sp _registers[NREGISTERS - 1]
 } Machine;
 
+//! Code condition correspondant au signe d'un résultat
+/*!
+ * Même classification que cc_of(), sans test : \c CC_Z, \c CC_P et \c CC_N
+ * se suivent dans l'énumération.
+ *
+ * \param value le résultat
+ * \return le code condition correspondant
+ */
+static inline Condition_Code sign_class(Word value) {
+    return (Condition_Code) (CC_Z + (value > 0) + 2 * (value < 0));
+}
+
+//! Code condition courant
+/*!
+ * \param pmach la machine
+ * \return \c _cc, ou le signe du dernier résultat s'il n'a pas encore été
+ * classé
+ */
+static inline Condition_Code current_cc(const Machine *pmach) {
+    return pmach->_ccresult == CC_SETTLED ? pmach->_cc : sign_class((Word) pmach->_ccresult);
+}
+
+//! Mise à jour de \c _cc d'après le dernier résultat
+/*!
+ * À appeler avant de lire ou d'écrire directement \c _cc.
+ *
+ * \param pmach la machine
+ */
+static inline void settle_cc(Machine *pmach) {
+    pmach->_cc = current_cc(pmach);
+    pmach->_ccresult = CC_SETTLED;
+}
+
 //! Chargement d'un programme
 /*!
  * La machine est réinitialisée et ses segments de texte et de données sont
- * remplacés par ceux fournis en paramètre.
+ * remplacés par ceux fournis en paramètre. Le segment de texte est pré-décodé
+ * une fois pour toutes (voir predecode()) et ses superinstructions sont
+ * repérées (voir fuse()).
  *
  * \param pmach la machine en cours d'exécution
  * \param textsize taille utile du segment de texte
@@ -102,6 +178,14 @@ void load_program(Machine *pmach,
         unsigned textsize, Instruction text[textsize],
         unsigned datasize, Word data[datasize], unsigned dataend);
 
+//! Libération des ressources allouées par load_program()
+/*!
+ * Les segments projetés par read_program() sont libérés eux aussi.
+ *
+ * \param pmach la machine dont le programme est déchargé
+ */
+void unload_program(Machine *pmach);
+
 //! Lecture d'un programme depuis un fichier binaire
 /*!
  * Le fichier binaire a le format suivant :
@@ -117,7 +201,15 @@ void load_program(Machine *pmach,
  *    segment de données.
  *
  * Tous les entiers font 32 bits et les adresses de chaque segment commencent à
- * 0. La fonction initialise complétement la machine.
+ * 0. La fonction initialise complétement la machine. Le fichier n'est pas
+ * recopié : il est projeté en mémoire (voir mmap()), en lecture seule et
+ * partagé pour le segment de texte, en copie privée sur écriture pour le
+ * segment de données ; les tailles de l'en-tête sont vérifiées par rapport à
+ * la longueur du fichier avant tout accès aux segments. Le segment de
+ * données n'a pas de zone de garde (voir try_map_program()) : aucun
+ * traitant de signal n'est installé. Les projections appartiennent à la
+ * machine (voir unload_program()). En cas d'échec de lecture, le simulateur
+ * s'arrête.
  *
  * \param pmach la machine à simuler
  * \param programfile le nom du fichier binaire
@@ -125,14 +217,66 @@ void load_program(Machine *pmach,
  */
 void read_program(Machine *mach, const char *programfile);
 
+//! Lecture d'un programme depuis un fichier binaire, sans arrêt en cas d'échec
+/*!
+ * Comme read_program(), mais un fichier illisible ou tronqué ne termine pas
+ * le simulateur.
+ *
+ * \param pmach la machine à simuler
+ * \param programfile le nom du fichier binaire
+ * \return faux (et \c errno positionnée) si le fichier n'a pas pu être lu ou
+ * projeté, ou s'il est plus court que ne l'annonce son en-tête (\c EINVAL) ;
+ * la machine n'est alors pas initialisée
+ */
+bool try_read_program(Machine *mach, const char *programfile);
+
+//! Lecture d'un programme avec un segment de données de taille choisie
+/*!
+ * Comme try_read_program(), mais le segment de données peut être déclaré
+ * plus grand que dans le fichier, jusqu'à \c MAX_DATASIZE mots (tout
+ * l'espace adressable) ou au-delà : les mots qui suivent les données du
+ * fichier sont nuls, et la pile commence en haut du segment déclaré. Le
+ * segment est réservé par une projection anonyme dont les pages ne sont
+ * allouées qu'au premier accès : un programme au tas clairsemé et à la pile
+ * haute ne paie pas l'intervalle. Les contrôles d'accès (voir
+ * check_seg_data() et check_stack()) portent sur la taille déclarée.
+ *
+ * Avec \c _hugepages, le segment est réservé en pages géantes si le système
+ * en a (\c MAP_HUGETLB), en grandes pages transparentes sinon ; les données
+ * du fichier y sont alors recopiées au lieu d'être projetées, et le segment
+ * n'a pas de zone de garde.
+ *
+ * Avec \c _guard, le segment est suivi, quand l'espace d'adressage le
+ * permet, d'une zone de garde (voir guard.h) qui dispense le moteur
+ * \c decoded de contrôler les accès indexés ; il n'est alors projeté que si
+ * le décalage des données dans leur page s'y prête, recopié sinon. La zone
+ * de garde installe un traitant de \c SIGSEGV pour tout le processus : une
+ * application qui a les siens, ou qui embarque le simulateur comme
+ * bibliothèque, la laisse de côté.
+ *
+ * \param pmach la machine à simuler
+ * \param programfile le nom du fichier binaire
+ * \param options la taille déclarée du segment de données, le choix des
+ * grandes pages et de la zone de garde
+ * \return faux (et \c errno positionnée) comme try_read_program(), ou
+ * \c EINVAL si la taille déclarée est plus petite que celle du fichier
+ */
+bool try_map_program(Machine *mach, const char *programfile, const Memory_Options *options);
+
 //! Affichage du programme et des données
 /*!
  * On affiche les instruction et les données en format hexadécimal, sous une
  * forme prête à être coupée-collée dans le simulateur.
  *
- * Pendant qu'on y est, on produit aussi un dump binaire dans le fichier
- * dump.prog. Le format de ce fichier est compatible avec l'option -b de
- * test_simul.
+ * \param pmach la machine en cours d'exécution
+ */
+void print_memory(Machine *pmach);
+
+//! Affichage du programme et des données, et sauvegarde binaire
+/*!
+ * Comme print_memory(), mais pendant qu'on y est, on produit aussi un dump
+ * binaire dans le fichier dump.prog. Le format de ce fichier est compatible
+ * avec l'option -b de test_simul.
  *
  * \param pmach la machine en cours d'exécution
  */
@@ -154,6 +298,18 @@ void print_program(Machine *pmach);
  */
 void print_data(Machine *pmach);
 
+//! Affichage d'une partie des données du programme
+/*!
+ * Comme print_data(), mais seuls les mots d'adresses \c first à \c end - 1
+ * sont affichés.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param first l'adresse du premier mot affiché
+ * \param end l'adresse qui suit le dernier mot affiché (ramenée à
+ * \c _datasize si elle le dépasse)
+ */
+void print_data_range(Machine *pmach, unsigned first, unsigned end);
+
 //! Affichage des registres du CPU
 /*!
  * Les registres généraux sont affichées en format hexadécimal et décimal.
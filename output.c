@@ -0,0 +1,99 @@
+/*!
+ * \file output.c
+ * \brief Tampon de sortie pour les affichages volumineux.
+ */
+
+#include "output.h"
+#include <stdlib.h>
+#include <string.h>
+
+//! Chiffres hexadécimaux (majuscules, comme \c "%X")
+static const char hex_digits[] = "0123456789ABCDEF";
+
+void output_init(Output *pout, size_t capacity) {
+    pout->_buffer = NULL;
+    pout->_length = 0;
+    pout->_capacity = 0;
+    if (capacity > 0) {
+        output_reserve(pout, capacity);
+        pout->_length = 0;
+    }
+}
+
+char *output_reserve(Output *pout, size_t size) {
+    if (pout->_length + size > pout->_capacity) {
+        size_t capacity = pout->_capacity > 0 ? 2 * pout->_capacity : 4096;
+        while (capacity < pout->_length + size) {
+            capacity *= 2;
+        }
+        char *buffer = realloc(pout->_buffer, capacity);
+        if (buffer == NULL) {
+            perror("output");
+            exit(1);
+        }
+        pout->_buffer = buffer;
+        pout->_capacity = capacity;
+    }
+    char *p = pout->_buffer + pout->_length;
+    pout->_length += size;
+    return p;
+}
+
+void output_string(Output *pout, const char *s) {
+    output_bytes(pout, s, strlen(s));
+}
+
+void output_bytes(Output *pout, const void *bytes, size_t size) {
+    memcpy(output_reserve(pout, size), bytes, size);
+}
+
+void output_hex(Output *pout, uint32_t value, unsigned digits) {
+    unsigned n = 1;
+    while (n < 8 && (value >> (4 * n)) != 0) {
+        n++;
+    }
+    if (n < digits) {
+        n = digits;
+    }
+    char *p = output_reserve(pout, n);
+    for (unsigned i = n; i-- > 0; value >>= 4) {
+        p[i] = hex_digits[value & 0xF];
+    }
+}
+
+void output_unsigned(Output *pout, uint32_t value) {
+    char digits[10];
+    unsigned n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    char *p = output_reserve(pout, n);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+}
+
+void output_signed(Output *pout, int32_t value) {
+    if (value < 0) {
+        output_char(pout, '-');
+        output_unsigned(pout, -(uint32_t) value);
+    } else {
+        output_unsigned(pout, value);
+    }
+}
+
+bool output_flush(Output *pout, FILE *file) {
+    if (pout->_length == 0) {
+        return true;
+    }
+    bool ok = fwrite(pout->_buffer, 1, pout->_length, file) == pout->_length;
+    pout->_length = 0;
+    return ok;
+}
+
+void output_free(Output *pout) {
+    free(pout->_buffer);
+    pout->_buffer = NULL;
+    pout->_length = pout->_capacity = 0;
+}
@@ -0,0 +1,93 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+/*!
+ * \file output.h
+ * \brief Tampon de sortie pour les affichages volumineux.
+ *
+ * Les affichages de la machine (voir print_data(), print_cpu(),
+ * dump_memory()) sont d'abord rédigés dans un tampon, avec des conversions
+ * hexadécimales et décimales écrites à la main, puis écrits d'un seul coup :
+ * un appel à \c printf par mot coûte plus cher que la simulation elle-même
+ * dès que le segment de données est grand.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//! Tampon de sortie
+typedef struct {
+    char *_buffer; //!< Contenu (alloué dynamiquement, agrandi au besoin)
+    size_t _length; //!< Nombre d'octets rédigés
+    size_t _capacity; //!< Taille allouée
+} Output;
+
+//! Initialisation d'un tampon vide
+/*!
+ * \param pout le tampon
+ * \param capacity la taille prévue (le tampon s'agrandit au besoin)
+ */
+void output_init(Output *pout, size_t capacity);
+
+//! Réservation de place dans le tampon
+/*!
+ * Le simulateur s'arrête si la mémoire manque.
+ *
+ * \param pout le tampon
+ * \param size le nombre d'octets à ajouter
+ * \return l'adresse où écrire les \c size octets (déjà comptés dans \c _length)
+ */
+char *output_reserve(Output *pout, size_t size);
+
+//! Ajout d'une chaîne
+/*!
+ * \param pout le tampon
+ * \param s la chaîne
+ */
+void output_string(Output *pout, const char *s);
+
+//! Ajout d'octets quelconques
+/*!
+ * \param pout le tampon
+ * \param bytes les octets
+ * \param size leur nombre
+ */
+void output_bytes(Output *pout, const void *bytes, size_t size);
+
+//! Ajout d'un caractère
+static inline void output_char(Output *pout, char c) {
+    *output_reserve(pout, 1) = c;
+}
+
+//! Ajout d'un entier en hexadécimal (comme \c "%0*X")
+/*!
+ * \param pout le tampon
+ * \param value la valeur
+ * \param digits le nombre minimal de chiffres (complété par des zéros)
+ */
+void output_hex(Output *pout, uint32_t value, unsigned digits);
+
+//! Ajout d'un entier non signé en décimal (comme \c "%u")
+void output_unsigned(Output *pout, uint32_t value);
+
+//! Ajout d'un entier signé en décimal (comme \c "%d")
+void output_signed(Output *pout, int32_t value);
+
+//! Écriture du tampon puis remise à vide
+/*!
+ * Le contenu est écrit par un seul appel à \c fwrite, qui passe
+ * directement au système si le tampon dépasse celui du fichier, tout en
+ * respectant l'ordre des écritures précédentes faites par \c printf.
+ *
+ * \param pout le tampon
+ * \param file le fichier de sortie
+ * \return faux en cas d'erreur d'écriture
+ */
+bool output_flush(Output *pout, FILE *file);
+
+//! Libération du tampon
+void output_free(Output *pout);
+
+#endif
@@ -0,0 +1,144 @@
+/*!
+ * \file profile.c
+ * \brief Profil d'exécution : nombre d'exécutions par adresse et par code
+ * opération, branchements pris et non pris.
+ */
+
+#include "profile.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+//! Nombre d'exécutions d'une adresse ou d'un code opération (pour le tri)
+typedef struct {
+    unsigned _key; //!< Adresse ou code opération
+    uint64_t _count; //!< Nombre d'exécutions
+} Count;
+
+//! Comparaison pour qsort() : les plus exécutés d'abord, puis par clé
+static int by_count(const void *a, const void *b) {
+    const Count *ca = a;
+    const Count *cb = b;
+    if (ca->_count != cb->_count) {
+        return ca->_count > cb->_count ? -1 : 1;
+    }
+    return ca->_key < cb->_key ? -1 : ca->_key > cb->_key;
+}
+
+//! Nombre d'exécutions de chaque code opération (les codes invalides en \c LAST_COP + 1)
+static void count_opcodes(const Profile *pprof, const Machine *pmach, uint64_t opcodes[LAST_COP + 2]) {
+    for (unsigned cop = 0; cop <= LAST_COP + 1; cop++) {
+        opcodes[cop] = 0;
+    }
+    for (unsigned addr = 0; addr < pprof->_textsize; addr++) {
+        unsigned cop = pmach->_text[addr].instr_generic._cop;
+        opcodes[cop <= LAST_COP ? cop : LAST_COP + 1] += pprof->_executed[addr];
+    }
+}
+
+//! Forme imprimable d'un code opération, valide ou non
+static const char *cop_name(unsigned cop) {
+    return cop <= LAST_COP ? cop_names[cop] : "INVALID";
+}
+
+Profile *create_profile(unsigned textsize) {
+    Profile *pprof = malloc(sizeof (Profile));
+    if (pprof == NULL
+            || (pprof->_executed = calloc(textsize > 0 ? textsize : 1, sizeof (uint64_t))) == NULL
+            || (pprof->_taken = calloc(textsize > 0 ? textsize : 1, sizeof (uint64_t))) == NULL) {
+        perror("create_profile");
+        exit(1);
+    }
+    pprof->_textsize = textsize;
+    return pprof;
+}
+
+void free_profile(Profile *pprof) {
+    if (pprof != NULL) {
+        free(pprof->_executed);
+        free(pprof->_taken);
+        free(pprof);
+    }
+}
+
+void print_profile(const Profile *pprof, const Machine *pmach) {
+    uint64_t opcodes[LAST_COP + 2];
+    uint64_t total = 0;
+    unsigned n = 0;
+
+    Count *counts = malloc(sizeof (Count) * (pprof->_textsize > 0 ? pprof->_textsize : 1));
+    if (counts == NULL) {
+        perror("print_profile");
+        exit(1);
+    }
+    for (unsigned addr = 0; addr < pprof->_textsize; addr++) {
+        if (pprof->_executed[addr] > 0) {
+            counts[n++] = (Count) {addr, pprof->_executed[addr]};
+            total += pprof->_executed[addr];
+        }
+    }
+    qsort(counts, n, sizeof (Count), by_count);
+
+    printf("\n*** Profile (%" PRIu64 " instructions executed) ***\n\n", total);
+    for (unsigned i = 0; i < n; i++) {
+        unsigned addr = counts[i]._key;
+        Instruction instr = pmach->_text[addr];
+        unsigned cop = instr.instr_generic._cop;
+        printf("%12" PRIu64 " %6.2f%%  0x%04X: ", counts[i]._count, 100.0 * counts[i]._count / total, addr);
+        if (cop > LAST_COP || ((cop == BRANCH || cop == CALL) && instr.instr_generic._regcond > LAST_CONDITION)) {
+            printf("0x%08X", instr._raw);
+        } else {
+            print_instruction(instr, addr);
+        }
+        if (cop == BRANCH || cop == CALL) {
+            printf("  [taken %" PRIu64 ", not taken %" PRIu64 "]",
+                    pprof->_taken[addr], counts[i]._count - pprof->_taken[addr]);
+        }
+        printf("\n");
+    }
+    free(counts);
+
+    count_opcodes(pprof, pmach, opcodes);
+    Count ops[LAST_COP + 2];
+    n = 0;
+    for (unsigned cop = 0; cop <= LAST_COP + 1; cop++) {
+        if (opcodes[cop] > 0) {
+            ops[n++] = (Count) {cop, opcodes[cop]};
+        }
+    }
+    qsort(ops, n, sizeof (Count), by_count);
+    printf("\n*** Profile by operation code ***\n\n");
+    for (unsigned i = 0; i < n; i++) {
+        printf("%12" PRIu64 " %6.2f%%  %s\n", ops[i]._count, 100.0 * ops[i]._count / total, cop_name(ops[i]._key));
+    }
+}
+
+bool write_profile(const Profile *pprof, const Machine *pmach, const char *file) {
+    uint64_t opcodes[LAST_COP + 2];
+    uint64_t total = 0;
+
+    FILE *out = fopen(file, "w");
+    if (out == NULL) {
+        return false;
+    }
+    count_opcodes(pprof, pmach, opcodes);
+    for (unsigned cop = 0; cop <= LAST_COP + 1; cop++) {
+        total += opcodes[cop];
+    }
+    fprintf(out, "total %" PRIu64 "\n", total);
+    for (unsigned addr = 0; addr < pprof->_textsize; addr++) {
+        uint64_t executed = pprof->_executed[addr];
+        if (executed > 0) {
+            fprintf(out, "pc 0x%04X %s %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", addr,
+                    cop_name(pmach->_text[addr].instr_generic._cop),
+                    executed, pprof->_taken[addr], executed - pprof->_taken[addr]);
+        }
+    }
+    for (unsigned cop = 0; cop <= LAST_COP + 1; cop++) {
+        if (opcodes[cop] > 0) {
+            fprintf(out, "op %s %" PRIu64 "\n", cop_name(cop), opcodes[cop]);
+        }
+    }
+    bool ok = ferror(out) == 0;
+    return fclose(out) == 0 && ok;
+}
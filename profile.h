@@ -0,0 +1,87 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+/*!
+ * \file profile.h
+ * \brief Profil d'exécution : nombre d'exécutions par adresse et par code
+ * opération, branchements pris et non pris.
+ *
+ * Le profil est rempli par simul_engine() quand l'option \c _profile est
+ * fournie : le programme s'exécute alors instruction par instruction (comme
+ * pour la trace), sans superinstructions ni code natif. Sans profil, les
+ * boucles rapides des moteurs ne comptent rien.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Compteurs d'un programme
+typedef struct {
+    unsigned _textsize; //!< Taille du segment de texte profilé
+    uint64_t *_executed; //!< Nombre d'exécutions de chaque adresse
+    uint64_t *_taken; //!< Nombre de transferts de contrôle effectués à chaque adresse
+} Profile;
+
+//! Création d'un profil vierge
+/*!
+ * \param textsize la taille du segment de texte du programme
+ * \return le profil (à libérer par free_profile())
+ */
+Profile *create_profile(unsigned textsize);
+
+//! Libération d'un profil
+/*!
+ * \param pprof le profil (ou NULL)
+ */
+void free_profile(Profile *pprof);
+
+//! Compte d'une instruction exécutée
+/*!
+ * \param pprof le profil
+ * \param addr l'adresse de l'instruction
+ * \param pc le compteur ordinal après son exécution
+ */
+static inline void profile_instruction(Profile *pprof, unsigned addr, unsigned pc) {
+    pprof->_executed[addr]++;
+    if (pc != addr + 1) {
+        pprof->_taken[addr]++;
+    }
+}
+
+//! Rapport de profil
+/*!
+ * Les instructions exécutées sont affichées par nombre d'exécutions
+ * décroissant, avec leur désassemblage (voir print_instruction()) ; pour
+ * \c BRANCH et \c CALL, on indique aussi combien de fois le branchement a
+ * été pris ou non. Suit le nombre d'exécutions de chaque code opération.
+ *
+ * \param pprof le profil
+ * \param pmach la machine profilée
+ */
+void print_profile(const Profile *pprof, const Machine *pmach);
+
+//! Écriture du profil dans un fichier, sous une forme facile à analyser
+/*!
+ * Une ligne par instruction exécutée, dans l'ordre des adresses, puis une
+ * ligne par code opération exécuté :
+ *
+ * \verbatim
+   total 42
+   pc 0x0003 BRANCH 10 9 1
+   op BRANCH 10
+   \endverbatim
+ *
+ * Les colonnes d'une ligne \c pc sont l'adresse, le code opération, le
+ * nombre d'exécutions, le nombre de transferts de contrôle effectués (pris)
+ * et non effectués (non pris).
+ *
+ * \param pprof le profil
+ * \param pmach la machine profilée
+ * \param file le nom du fichier
+ * \return faux (et \c errno positionnée) en cas d'échec d'écriture
+ */
+bool write_profile(const Profile *pprof, const Machine *pmach, const char *file);
+
+#endif
@@ -0,0 +1,292 @@
+/*!
+ * \file sample.c
+ * \brief Profil par échantillonnage, pour les longues exécutions.
+ */
+
+#define _DEFAULT_SOURCE // Pour sigaction(), SA_RESTART et setitimer()
+
+#include "sample.h"
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+//! Tranche d'exécution entre deux tests du minuteur
+#define SAMPLE_TIMER_CHUNK (1u << 16)
+
+//! Germe du tirage des tranches
+#define SAMPLE_SEED 0x9E3779B97F4A7C15ull
+
+//! Nombre maximal de mots de pile examinés par relevé
+#define SAMPLE_SCAN_WORDS 256
+
+//! Nombre de lignes de chaque partie de print_samples()
+#define SAMPLE_REPORT_LINES 20
+
+//! Échéance du minuteur depuis le dernier relevé ?
+static volatile sig_atomic_t ticks;
+
+//! Traitant de \c SIGPROF
+static void on_tick(int sig) {
+    (void) sig;
+    ticks = 1;
+}
+
+//! Allocation d'une table de hachage vide
+static Sample *alloc_table(unsigned capacity) {
+    Sample *table = calloc(capacity, sizeof (Sample));
+    if (table == NULL) {
+        perror("sampler");
+        exit(1);
+    }
+    return table;
+}
+
+Sampler *create_sampler(const Sampler_Options *poptions) {
+    Sampler *psamp = malloc(sizeof (Sampler));
+    if (psamp == NULL) {
+        perror("create_sampler");
+        exit(1);
+    }
+    psamp->_options = *poptions;
+    if (psamp->_options._depth > SAMPLE_MAX_DEPTH) {
+        psamp->_options._depth = SAMPLE_MAX_DEPTH;
+    }
+    psamp->_samples = 0;
+    psamp->_capacity = 256;
+    psamp->_used = 0;
+    psamp->_table = alloc_table(psamp->_capacity);
+    psamp->_random = SAMPLE_SEED;
+    return psamp;
+}
+
+void free_sampler(Sampler *psamp) {
+    if (psamp != NULL) {
+        free(psamp->_table);
+        free(psamp);
+    }
+}
+
+uint64_t sampler_chunk(Sampler *psamp) {
+    uint64_t mean = psamp->_options._interval_us != 0 ? SAMPLE_TIMER_CHUNK : psamp->_options._period;
+    if (mean < 2) {
+        return 1;
+    }
+    uint64_t x = psamp->_random;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    psamp->_random = x;
+    // Uniforme dans [mean / 2, mean / 2 + mean] (le biais du modulo est négligeable)
+    return mean / 2 + x % (mean + 1);
+}
+
+//! Programmation du minuteur \c ITIMER_PROF
+static void set_timer(unsigned interval_us) {
+    struct itimerval timer = {
+        .it_interval = {.tv_sec = interval_us / 1000000, .tv_usec = interval_us % 1000000},
+        .it_value = {.tv_sec = interval_us / 1000000, .tv_usec = interval_us % 1000000},
+    };
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void start_sampler(Sampler *psamp) {
+    if (psamp->_options._interval_us == 0) {
+        return;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = on_tick;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+    ticks = 0;
+    set_timer(psamp->_options._interval_us);
+}
+
+void stop_sampler(Sampler *psamp) {
+    if (psamp->_options._interval_us != 0) {
+        set_timer(0);
+    }
+}
+
+//! Hachage d'une pile d'appels (FNV-1a)
+static unsigned hash_stack(const unsigned stack[SAMPLE_MAX_DEPTH + 1]) {
+    uint32_t h = 2166136261u;
+    for (unsigned i = 0; i <= SAMPLE_MAX_DEPTH; i++) {
+        h = (h ^ stack[i]) * 16777619u;
+    }
+    return h;
+}
+
+//! Case de la table qui contient la pile, ou case libre où la ranger
+static Sample *find_slot(Sample *table, unsigned capacity, const unsigned stack[SAMPLE_MAX_DEPTH + 1]) {
+    unsigned i = hash_stack(stack) & (capacity - 1);
+    while (table[i]._count != 0
+            && memcmp(table[i]._stack, stack, sizeof table[i]._stack) != 0) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &table[i];
+}
+
+//! Doublement de la table de hachage
+static void grow(Sampler *psamp) {
+    unsigned capacity = 2 * psamp->_capacity;
+    Sample *table = alloc_table(capacity);
+    for (unsigned i = 0; i < psamp->_capacity; i++) {
+        if (psamp->_table[i]._count != 0) {
+            *find_slot(table, capacity, psamp->_table[i]._stack) = psamp->_table[i];
+        }
+    }
+    free(psamp->_table);
+    psamp->_table = table;
+    psamp->_capacity = capacity;
+}
+
+void sample_machine(Sampler *psamp, const Machine *pmach) {
+    unsigned stack[SAMPLE_MAX_DEPTH + 1];
+    unsigned depth = 0;
+
+    if (psamp->_options._interval_us != 0) {
+        if (!ticks) {
+            return;
+        }
+        ticks = 0;
+    }
+
+    stack[0] = pmach->_pc;
+    // Un mot de la pile est une adresse de retour s'il suit un CALL
+    unsigned top = (unsigned) pmach->_sp + 1;
+    for (unsigned a = top; depth < psamp->_options._depth && a - top < SAMPLE_SCAN_WORDS
+            && a >= pmach->_dataend && a < pmach->_datasize; a++) {
+        unsigned ret = pmach->_data[a];
+        if (ret > 0 && ret <= pmach->_textsize && pmach->_text[ret - 1].instr_generic._cop == CALL) {
+            stack[++depth] = ret;
+        }
+    }
+    for (unsigned i = depth + 1; i <= SAMPLE_MAX_DEPTH; i++) {
+        stack[i] = UINT32_MAX;
+    }
+
+    if (4 * (psamp->_used + 1) > 3 * psamp->_capacity) {
+        grow(psamp);
+    }
+    Sample *ps = find_slot(psamp->_table, psamp->_capacity, stack);
+    if (ps->_count == 0) {
+        memcpy(ps->_stack, stack, sizeof stack);
+        psamp->_used++;
+    }
+    ps->_count++;
+    psamp->_samples++;
+}
+
+//! Comparaison pour qsort() : les piles les plus échantillonnées d'abord
+static int by_count(const void *a, const void *b) {
+    const Sample *sa = a;
+    const Sample *sb = b;
+    if (sa->_count != sb->_count) {
+        return sa->_count > sb->_count ? -1 : 1;
+    }
+    return memcmp(sa->_stack, sb->_stack, sizeof sa->_stack);
+}
+
+//! Piles d'appels distinctes, par nombre d'échantillons décroissant
+/*!
+ * \param psamp la table d'échantillons
+ * \return un tableau de \c _used piles (à libérer par free())
+ */
+static Sample *sorted_samples(const Sampler *psamp) {
+    Sample *sorted = malloc((psamp->_used > 0 ? psamp->_used : 1) * sizeof (Sample));
+    if (sorted == NULL) {
+        return NULL;
+    }
+    unsigned n = 0;
+    for (unsigned i = 0; i < psamp->_capacity; i++) {
+        if (psamp->_table[i]._count != 0) {
+            sorted[n++] = psamp->_table[i];
+        }
+    }
+    qsort(sorted, n, sizeof (Sample), by_count);
+    return sorted;
+}
+
+//! Écriture d'une pile d'appels : compteur ordinal puis adresses de retour
+static void fprint_stack(FILE *out, const unsigned stack[SAMPLE_MAX_DEPTH + 1]) {
+    for (unsigned i = 0; i <= SAMPLE_MAX_DEPTH && stack[i] != UINT32_MAX; i++) {
+        fprintf(out, " 0x%04X", stack[i]);
+    }
+}
+
+//! Comparaison pour qsort() : les adresses les plus échantillonnées d'abord
+static int by_pc_count(const void *a, const void *b) {
+    const Sample *sa = a;
+    const Sample *sb = b;
+    if (sa->_count != sb->_count) {
+        return sa->_count > sb->_count ? -1 : 1;
+    }
+    return sa->_stack[0] < sb->_stack[0] ? -1 : sa->_stack[0] > sb->_stack[0];
+}
+
+void print_samples(const Sampler *psamp, const Machine *pmach) {
+    Sample *sorted = sorted_samples(psamp);
+    Sample *pcs = calloc(pmach->_textsize > 0 ? pmach->_textsize : 1, sizeof (Sample));
+    if (sorted == NULL || pcs == NULL) {
+        perror("print_samples");
+        free(sorted);
+        free(pcs);
+        return;
+    }
+    for (unsigned i = 0; i < psamp->_used; i++) {
+        unsigned pc = sorted[i]._stack[0];
+        pcs[pc]._stack[0] = pc;
+        pcs[pc]._count += sorted[i]._count;
+    }
+    qsort(pcs, pmach->_textsize, sizeof (Sample), by_pc_count);
+
+    printf("\n*** Samples (%" PRIu64 ") ***\n\n", psamp->_samples);
+    for (unsigned i = 0; i < pmach->_textsize && i < SAMPLE_REPORT_LINES && pcs[i]._count > 0; i++) {
+        unsigned pc = pcs[i]._stack[0];
+        printf("%12" PRIu64 " %6.2f%%  0x%04X: ", pcs[i]._count,
+                100.0 * pcs[i]._count / psamp->_samples, pc);
+        print_instruction(pmach->_text[pc], pc);
+        printf("\n");
+    }
+
+    printf("\n*** Samples by call stack ***\n\n");
+    for (unsigned i = 0; i < psamp->_used && i < SAMPLE_REPORT_LINES; i++) {
+        printf("%12" PRIu64 " %6.2f%% ", sorted[i]._count, 100.0 * sorted[i]._count / psamp->_samples);
+        fprint_stack(stdout, sorted[i]._stack);
+        printf("\n");
+    }
+    free(pcs);
+    free(sorted);
+}
+
+bool write_samples(const Sampler *psamp, const char *file) {
+    Sample *sorted = sorted_samples(psamp);
+    if (sorted == NULL) {
+        return false;
+    }
+    FILE *out = fopen(file, "w");
+    if (out == NULL) {
+        free(sorted);
+        return false;
+    }
+    if (psamp->_options._interval_us != 0) {
+        fprintf(out, "samples %" PRIu64 " interval_us %u depth %u\n",
+                psamp->_samples, psamp->_options._interval_us, psamp->_options._depth);
+    } else {
+        fprintf(out, "samples %" PRIu64 " period %" PRIu64 " depth %u\n",
+                psamp->_samples, psamp->_options._period, psamp->_options._depth);
+    }
+    for (unsigned i = 0; i < psamp->_used; i++) {
+        fprintf(out, "stack %" PRIu64, sorted[i]._count);
+        fprint_stack(out, sorted[i]._stack);
+        fprintf(out, "\n");
+    }
+    free(sorted);
+    bool ok = ferror(out) == 0;
+    return fclose(out) == 0 && ok;
+}
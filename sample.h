@@ -0,0 +1,133 @@
+#ifndef _SAMPLE_H_
+#define _SAMPLE_H_
+
+/*!
+ * \file sample.h
+ * \brief Profil par échantillonnage, pour les longues exécutions.
+ *
+ * Quand l'option \c _sampler est fournie à simul_engine() sans trace ni
+ * mise au point (ni profil, historique ou modèle de caches), le moteur
+ * choisi exécute le programme par tranches (voir run_budget()) au lieu de sa
+ * boucle rapide. Entre deux tranches, on relève le compteur ordinal et les
+ * adresses de retour trouvées dans la pile au-dessus de \c SP : chaque pile
+ * d'appels distincte est comptée dans une table. Les tranches font en
+ * moyenne \c _period instructions ; avec un minuteur (\c _interval_us non
+ * nul), elles sont courtes et un relevé n'est fait qu'après chaque échéance
+ * du signal \c SIGPROF (temps processeur de l'hôte). La longueur de chaque
+ * tranche est tirée uniformément entre la moitié et une fois et demie de sa
+ * moyenne : avec des tranches fixes, une boucle dont la longueur divise la
+ * période serait toujours relevée à la même adresse. Le générateur part
+ * toujours du même germe, et l'échantillonnage d'une exécution est donc
+ * reproductible. Le coût est celui de run_budget()
+ * par rapport à la boucle rapide, plus un relevé par échantillon.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Nombre maximal d'adresses de retour relevées par échantillon
+#define SAMPLE_MAX_DEPTH 8
+
+//! Paramètres de l'échantillonnage
+typedef struct {
+    uint64_t _period; //!< Instructions entre deux échantillons (sans minuteur)
+    unsigned _interval_us; //!< Période du minuteur SIGPROF en µs (0 : pas de minuteur)
+    unsigned _depth; //!< Nombre d'adresses de retour relevées (au plus \c SAMPLE_MAX_DEPTH)
+} Sampler_Options;
+
+//! Un échantillon : le compteur ordinal suivi des adresses de retour
+typedef struct {
+    unsigned _stack[SAMPLE_MAX_DEPTH + 1]; //!< Adresses (\c UINT32_MAX au-delà de la pile relevée)
+    uint64_t _count; //!< Nombre d'échantillons identiques (0 : case libre)
+} Sample;
+
+//! Table des échantillons
+typedef struct {
+    Sampler_Options _options; //!< Paramètres
+    uint64_t _samples; //!< Nombre total d'échantillons
+    Sample *_table; //!< Table de hachage des piles d'appels distinctes
+    unsigned _capacity; //!< Taille de \c _table (puissance de 2)
+    unsigned _used; //!< Nombre de cases occupées de \c _table
+    uint64_t _random; //!< État du tirage des tranches (xorshift 64 bits)
+} Sampler;
+
+//! Création d'une table d'échantillons vide
+/*!
+ * \param poptions les paramètres (période non nulle si pas de minuteur)
+ * \return la table (à libérer par free_sampler())
+ */
+Sampler *create_sampler(const Sampler_Options *poptions);
+
+//! Libération d'une table d'échantillons
+/*!
+ * \param psamp la table (ou NULL)
+ */
+void free_sampler(Sampler *psamp);
+
+//! Nombre d'instructions de la prochaine tranche d'exécution
+/*!
+ * \param psamp la table d'échantillons
+ * \return une longueur tirée autour de \c _period, ou d'une tranche courte
+ * avec un minuteur (au moins 1)
+ */
+uint64_t sampler_chunk(Sampler *psamp);
+
+//! Armement du minuteur (sans effet sans minuteur)
+/*!
+ * Comme \c SIGPROF concerne tout le processus, un seul programme peut être
+ * échantillonné par minuteur à la fois.
+ *
+ * \param psamp la table d'échantillons
+ */
+void start_sampler(Sampler *psamp);
+
+//! Désarmement du minuteur (sans effet sans minuteur)
+/*!
+ * \param psamp la table d'échantillons
+ */
+void stop_sampler(Sampler *psamp);
+
+//! Relevé d'un échantillon entre deux tranches
+/*!
+ * Avec un minuteur, rien n'est relevé si aucune échéance n'a eu lieu depuis
+ * le relevé précédent. Les adresses de retour sont les mots de la pile,
+ * au-dessus de \c SP, qui désignent l'instruction suivant un \c CALL.
+ *
+ * \param psamp la table d'échantillons
+ * \param pmach la machine, arrêtée avant l'instruction \c _pc
+ */
+void sample_machine(Sampler *psamp, const Machine *pmach);
+
+//! Rapport d'échantillonnage
+/*!
+ * Les adresses les plus échantillonnées, avec leur désassemblage, puis les
+ * piles d'appels les plus fréquentes.
+ *
+ * \param psamp la table d'échantillons
+ * \param pmach la machine échantillonnée
+ */
+void print_samples(const Sampler *psamp, const Machine *pmach);
+
+//! Écriture de la table d'échantillons dans un fichier
+/*!
+ * Une ligne d'en-tête, puis une ligne par pile d'appels distincte, par
+ * nombre d'échantillons décroissant : ce nombre, le compteur ordinal, puis
+ * les adresses de retour de la plus récente à la plus ancienne.
+ *
+ * \verbatim
+   samples 1200 period 100000 depth 4
+   stack 900 0x000D 0x0003
+   \endverbatim
+ *
+ * Avec un minuteur, l'en-tête donne <tt>interval_us</tt> au lieu de
+ * <tt>period</tt>.
+ *
+ * \param psamp la table d'échantillons
+ * \param file le nom du fichier
+ * \return faux (et \c errno positionnée) en cas d'échec d'écriture
+ */
+bool write_samples(const Sampler *psamp, const char *file);
+
+#endif
@@ -0,0 +1,113 @@
+/*!
+ * \file simulator.c
+ * \brief Interface de programmation du simulateur (bibliothèque libsimul).
+ */
+
+#include "simulator.h"
+#include <stdlib.h>
+
+Machine *simul_create(void) {
+    return calloc(1, sizeof (Machine));
+}
+
+bool simul_load(Machine *pmach, const char *programfile) {
+    if (pmach->_decoded != NULL) {
+        unload_program(pmach);
+    }
+    return try_read_program(pmach, programfile);
+}
+
+bool simul_load_with(Machine *pmach, const char *programfile, const Memory_Options *options) {
+    if (pmach->_decoded != NULL) {
+        unload_program(pmach);
+    }
+    return try_map_program(pmach, programfile, options);
+}
+
+void simul_load_memory(Machine *pmach,
+        unsigned textsize, Instruction text[textsize],
+        unsigned datasize, Word data[datasize], unsigned dataend) {
+    if (pmach->_decoded != NULL) {
+        unload_program(pmach);
+    }
+    load_program(pmach, textsize, text, datasize, data, dataend);
+}
+
+//! Exécution avec un piège à erreurs posé.
+/*!
+ * Le setjmp() est isolé dans cette fonction pour que les variables de
+ * l'appelant ne soient pas concernées par le retour via longjmp().
+ *
+ * \param pmach la machine chargée
+ * \param options les options d'exécution
+ * \param pbudget le budget d'instructions (voir run_budget()), ou NULL
+ * \param ptrap le piège (renseigné en cas d'erreur)
+ * \param pstopped renseigné à vrai si le budget est épuisé
+ * \return faux en cas d'erreur
+ */
+static bool run_trapped(Machine *pmach, const Simul_Options *options, uint64_t *pbudget,
+        Error_Trap *ptrap, bool *pstopped) {
+    Error_Trap *volatile previous = NULL;
+    bool completed = false;
+
+    if (setjmp(ptrap->_env) == 0) {
+        previous = set_error_trap(ptrap);
+        if (pbudget == NULL) {
+            simul_engine(pmach, options);
+        } else {
+            *pstopped = run_budget(pmach, options->_engine, pbudget);
+        }
+        completed = true;
+    }
+    set_error_trap(previous);
+    return completed;
+}
+
+//! Exécution et issue (voir simul_run() et simul_run_budget())
+static Simul_Status run_status(Machine *pmach, const Simul_Options *options, uint64_t *pbudget) {
+    Error_Trap trap = {._warnings = options->_warnings};
+    Simul_Status status = {._err = ERR_NOERROR, ._stopped = false, ._reported = false};
+
+    bool completed = run_trapped(pmach, options, pbudget, &trap, &status._stopped);
+
+    // L'appelant peut lire directement _cc
+    settle_cc(pmach);
+    if (!completed) {
+        status._err = trap._err;
+        status._addr = trap._addr;
+        status._reported = trap._reported;
+    } else if (status._stopped) {
+        status._addr = pmach->_pc;
+    } else {
+        status._addr = pmach->_pc - 1;
+    }
+    return status;
+}
+
+Simul_Status simul_run(Machine *pmach, const Simul_Options *options) {
+    return run_status(pmach, options, NULL);
+}
+
+Simul_Status simul_run_budget(Machine *pmach, Engine engine, uint64_t *pbudget) {
+    Simul_Options options = {
+        ._engine = engine,
+        ._trace = TRACE_OFF,
+        ._debug = false,
+        ._warnings = false,
+        ._profile = NULL,
+        ._history = NULL,
+        ._cache = NULL,
+        ._sampler = NULL,
+        ._tracefile = NULL,
+    };
+    return run_status(pmach, &options, pbudget);
+}
+
+void simul_destroy(Machine *pmach) {
+    if (pmach != NULL) {
+        if (pmach->_decoded != NULL) {
+            unload_program(pmach);
+        }
+        free(pmach);
+    }
+}
@@ -0,0 +1,152 @@
+#ifndef _SIMULATOR_H_
+#define _SIMULATOR_H_
+
+/*!
+ * \file simulator.h
+ * \brief Interface de programmation du simulateur (bibliothèque libsimul).
+ *
+ * Cette interface permet d'embarquer le simulateur dans une autre
+ * application : on crée une Machine, on y charge un programme, on l'exécute
+ * autant de fois que nécessaire puis on la détruit. Une erreur du programme
+ * simulé (instruction illégale, violation de segment...) ne termine plus le
+ * processus : elle est rendue à l'appelant sous la forme d'un code d'erreur et
+ * d'une adresse (voir \link Simul_Status \endlink).
+ *
+ * L'erreur ne remonte pas les moteurs comme valeur de retour : error() reste
+ * le seul chemin des fautes, et simul_run() pose autour de l'exécution un
+ * piège à erreurs (voir set_error_trap()) dont error() fait sortir par
+ * longjmp(). Un code de retour aurait demandé un test après chaque
+ * instruction dans la boucle de chaque moteur (traitants à enfilage, code
+ * natif du JIT compris), pour des fautes qui n'arrivent qu'une fois par
+ * exécution. Le saut est sûr parce qu'aucun moteur ne tient de ressource
+ * locale au moment de l'appel à error() : les tables du moteur à enfilage et
+ * le code du JIT appartiennent à la machine (voir free_threaded() et
+ * free_jit()), et les moteurs rapides rangent dans la machine leurs
+ * registres, leur compteur ordinal, leur budget et le code condition avant
+ * l'appel. La machine reste donc cohérente après l'erreur, comme avec
+ * l'interpréteur de référence.
+ *
+ * Les fonctions sont réentrantes : plusieurs threads peuvent exécuter en même
+ * temps des machines distinctes. Pour réexécuter un programme sans le
+ * recharger, voir take_snapshot() et restore_snapshot().
+ *
+ * \code
+ * Machine *pmach = simul_create();
+ * if (pmach == NULL || !simul_load(pmach, "prog.bin")) {
+ *     perror("prog.bin");
+ * } else {
+ *     Simul_Status status = simul_run(pmach, &options);
+ *     if (status._err != ERR_NOERROR)
+ *         print_error(status._err, status._addr);
+ * }
+ * simul_destroy(pmach);
+ * \endcode
+ */
+
+#include <stdbool.h>
+
+#include "machine.h"
+#include "engine.h"
+#include "error.h"
+#include "snapshot.h"
+
+//! Issue de l'exécution d'un programme
+typedef struct {
+    Error _err; //!< Erreur survenue, ou \c ERR_NOERROR si fin sur \c HALT
+    unsigned _addr; //!< Adresse du \c HALT ou de l'instruction fautive
+    bool _stopped; //!< Arrêt sur épuisement du budget (voir simul_run_budget()) ?
+    bool _reported; //!< Erreur déjà affichée pendant l'exécution (mise au point) ?
+} Simul_Status;
+
+//! Création d'une machine sans programme
+/*!
+ * \return la machine (à détruire par simul_destroy()), ou NULL si la mémoire
+ * manque
+ */
+Machine *simul_create(void);
+
+//! Chargement d'un programme depuis un fichier binaire
+/*!
+ * Le programme éventuellement chargé auparavant est déchargé. Le format du
+ * fichier est celui de read_program() ; le segment de données n'a pas de zone
+ * de garde, et aucun traitant de signal n'est installé.
+ *
+ * \param pmach la machine
+ * \param programfile le nom du fichier binaire
+ * \return faux (avec \c errno positionné) si le fichier est illisible ou
+ * tronqué ; la machine est alors sans programme
+ */
+bool simul_load(Machine *pmach, const char *programfile);
+
+//! Chargement d'un programme avec un segment de données de taille choisie
+/*!
+ * Comme simul_load(), mais le segment de données peut être déclaré plus
+ * grand que dans le fichier et n'occupe de mémoire que pour les pages
+ * touchées (voir try_map_program()).
+ *
+ * \param pmach la machine
+ * \param programfile le nom du fichier binaire
+ * \param options la taille déclarée du segment, le choix des grandes pages et
+ * de la zone de garde (qui installe un traitant de \c SIGSEGV, voir guard.h)
+ * \return faux (avec \c errno positionné) en cas d'échec ; la machine est
+ * alors sans programme
+ */
+bool simul_load_with(Machine *pmach, const char *programfile, const Memory_Options *options);
+
+//! Chargement d'un programme déjà en mémoire
+/*!
+ * Comme load_program() : les segments restent la propriété de l'appelant et
+ * doivent survivre à la machine. Le programme éventuellement chargé
+ * auparavant est déchargé.
+ *
+ * \param pmach la machine
+ * \param textsize taille utile du segment de texte
+ * \param text le contenu du segment de texte
+ * \param datasize taille utile du segment de données
+ * \param data le contenu initial du segment de données
+ * \param dataend valeur initiale de SP
+ */
+void simul_load_memory(Machine *pmach,
+        unsigned textsize, Instruction text[textsize],
+        unsigned datasize, Word data[datasize], unsigned dataend);
+
+//! Exécution du programme chargé
+/*!
+ * Le programme s'exécute comme avec simul_engine(), jusqu'au \c HALT ou
+ * jusqu'à la première erreur. Le message d'erreur n'est pas affiché (voir
+ * print_error()), sauf en mise au point avec historique, où il précède le
+ * dialogue sur l'erreur (\c _reported est alors vrai) ; l'avertissement du
+ * \c HALT n'est affiché que si l'option \c _warnings est vraie. La machine
+ * reste dans l'état où l'exécution s'est arrêtée.
+ *
+ * \param pmach la machine chargée
+ * \param options le moteur, le niveau de trace, le mode de mise au point et
+ * l'affichage des avertissements
+ * \return l'issue de l'exécution
+ */
+Simul_Status simul_run(Machine *pmach, const Simul_Options *options);
+
+//! Exécution d'un nombre borné d'instructions du programme chargé
+/*!
+ * Comme simul_run(), mais sans trace ni mise au point ni profil, et en
+ * s'arrêtant après \c *pbudget instructions (voir run_budget()). Dans ce
+ * cas, \c _stopped est vrai, \c _err vaut \c ERR_NOERROR et \c _addr est
+ * l'adresse de la prochaine instruction ; on peut reprendre l'exécution.
+ *
+ * \param pmach la machine chargée
+ * \param engine le moteur d'exécution
+ * \param pbudget le nombre maximal d'instructions à exécuter, diminué du
+ * nombre d'instructions exécutées
+ * \return l'issue de l'exécution
+ */
+Simul_Status simul_run_budget(Machine *pmach, Engine engine, uint64_t *pbudget);
+
+//! Destruction d'une machine
+/*!
+ * Le programme chargé est déchargé (voir unload_program()).
+ *
+ * \param pmach la machine (NULL est accepté)
+ */
+void simul_destroy(Machine *pmach);
+
+#endif
@@ -0,0 +1,212 @@
+/*!
+ * \file smp.c
+ * \brief Multiprocesseur : plusieurs cœurs qui partagent le segment de données.
+ */
+
+#include "smp.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Smp *create_smp(Machine *pmach, const Smp_Options *options) {
+    unsigned ncores = options->_cores;
+    unsigned stack = pmach->_sp >= pmach->_dataend ? pmach->_sp + 1 - pmach->_dataend : 0;
+    unsigned slice = ncores > 0 ? stack / ncores : 0;
+
+    if (slice == 0) {
+        errno = EINVAL; // Pas même un mot de pile par cœur
+        return NULL;
+    }
+    Smp *psmp = calloc(1, sizeof (Smp));
+    Core *cores = calloc(ncores, sizeof (Core));
+    if (psmp == NULL || cores == NULL) {
+        perror("smp");
+        exit(1);
+    }
+    psmp->_cores = cores;
+    psmp->_ncores = ncores;
+    psmp->_engine = options->_engine;
+    psmp->_quantum = options->_quantum;
+
+    for (unsigned i = 0; i < ncores; i++) {
+        Machine *pcore = &cores[i]._mach;
+        *pcore = *pmach;
+        // Les segments restent à la machine d'origine
+        pcore->_textmap = (Mapping) {NULL, 0};
+        pcore->_datamap = (Mapping) {NULL, 0};
+        pcore->_guardmap = (Mapping) {NULL, 0};
+        pcore->_decoded = predecode(pcore->_textsize, pcore->_text, pcore->_datasize, false);
+        pcore->_fusion = fuse(pcore->_textsize, pcore->_decoded);
+        pcore->_threaded = NULL;
+        pcore->_jit = NULL;
+        pcore->_smp = psmp;
+        pcore->_core = i;
+        pcore->_registers[0] = i;
+        pcore->_registers[1] = ncores;
+        pcore->_sp = pmach->_sp - i * slice;
+    }
+    return psmp;
+}
+
+void free_smp(Smp *psmp) {
+    if (psmp == NULL) {
+        return;
+    }
+    for (unsigned i = 0; i < psmp->_ncores; i++) {
+        free(psmp->_cores[i]._mach._decoded);
+        free_fusion(psmp->_cores[i]._mach._fusion);
+        free_threaded(&psmp->_cores[i]._mach);
+        free_jit(&psmp->_cores[i]._mach);
+    }
+    free(psmp->_cores);
+    free(psmp);
+}
+
+//! Fin du rendez-vous en cours : tous les cœurs qui l'attendent repartent
+/*!
+ * À appeler verrou pris.
+ */
+static void release_barrier(Smp *psmp) {
+    psmp->_arrived = 0;
+    psmp->_generation++;
+    for (unsigned i = 0; i < psmp->_ncores; i++) {
+        psmp->_cores[i]._waiting = false;
+    }
+    pthread_cond_broadcast(&psmp->_changed);
+}
+
+//! Passage du tour au cœur suivant qui peut s'exécuter (entrelacement déterministe)
+/*!
+ * À appeler verrou pris. Les cœurs arrêtés et ceux qui attendent au
+ * rendez-vous sont sautés ; le cœur \c from lui-même vient en dernier.
+ *
+ * \param psmp le multiprocesseur
+ * \param from le cœur qui cède son tour
+ */
+static void pass_turn(Smp *psmp, unsigned from) {
+    psmp->_turn = psmp->_ncores; // Personne, si tous sont arrêtés
+    for (unsigned k = 1; k <= psmp->_ncores; k++) {
+        unsigned i = (from + k) % psmp->_ncores;
+        if (!psmp->_cores[i]._done && !psmp->_cores[i]._waiting) {
+            psmp->_turn = i;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&psmp->_changed);
+}
+
+//! Arrêt d'un cœur : il n'est plus attendu au rendez-vous
+/*!
+ * À appeler verrou pris.
+ */
+static void stop_core(Smp *psmp, Core *pcore, Simul_Status status) {
+    pcore->_status = status;
+    pcore->_done = true;
+    psmp->_live--;
+    if (psmp->_arrived > 0 && psmp->_arrived == psmp->_live) {
+        release_barrier(psmp);
+    }
+    pthread_cond_broadcast(&psmp->_changed);
+}
+
+void smp_barrier(Machine *pmach) {
+    Smp *psmp = pmach->_smp;
+    if (psmp == NULL) {
+        return; // Machine seule
+    }
+    unsigned core = pmach->_core;
+    bool interleaved = psmp->_quantum != 0;
+
+    pthread_mutex_lock(&psmp->_lock);
+    unsigned generation = psmp->_generation;
+    if (++psmp->_arrived == psmp->_live) {
+        release_barrier(psmp); // Dernier arrivé : il garde son tour
+    } else {
+        if (interleaved) {
+            psmp->_cores[core]._waiting = true;
+            pass_turn(psmp, core);
+        }
+        while (psmp->_generation == generation || (interleaved && psmp->_turn != core)) {
+            pthread_cond_wait(&psmp->_changed, &psmp->_lock);
+        }
+    }
+    pthread_mutex_unlock(&psmp->_lock);
+}
+
+//! Attente du tour d'un cœur (verrou pris)
+static void wait_turn(Smp *psmp, unsigned core) {
+    while (psmp->_turn != core) {
+        pthread_cond_wait(&psmp->_changed, &psmp->_lock);
+    }
+}
+
+//! Thread d'un cœur : exécution jusqu'à son arrêt
+static void *run_core(void *arg) {
+    Core *pcore = arg;
+    Machine *pmach = &pcore->_mach;
+    Smp *psmp = pmach->_smp;
+
+    if (psmp->_quantum == 0) {
+        Simul_Options options = {
+            ._engine = psmp->_engine,
+            ._trace = TRACE_OFF,
+            ._debug = false,
+            ._warnings = false,
+            ._profile = NULL,
+            ._history = NULL,
+            ._cache = NULL,
+            ._sampler = NULL,
+            ._tracefile = NULL,
+        };
+        Simul_Status status = simul_run(pmach, &options);
+        pthread_mutex_lock(&psmp->_lock);
+        stop_core(psmp, pcore, status);
+        pthread_mutex_unlock(&psmp->_lock);
+        return NULL;
+    }
+
+    // Entrelacement déterministe : une tranche d'instructions par tour
+    pthread_mutex_lock(&psmp->_lock);
+    wait_turn(psmp, pmach->_core);
+    while (!pcore->_done) {
+        pthread_mutex_unlock(&psmp->_lock);
+        uint64_t budget = psmp->_quantum;
+        Simul_Status status = simul_run_budget(pmach, psmp->_engine, &budget);
+        pthread_mutex_lock(&psmp->_lock);
+        if (!status._stopped) {
+            stop_core(psmp, pcore, status);
+        }
+        pass_turn(psmp, pmach->_core);
+        if (!pcore->_done) {
+            wait_turn(psmp, pmach->_core);
+        }
+    }
+    pthread_mutex_unlock(&psmp->_lock);
+    return NULL;
+}
+
+bool run_smp(Smp *psmp) {
+    psmp->_live = psmp->_ncores;
+    psmp->_arrived = 0;
+    psmp->_generation = 0;
+    psmp->_turn = 0;
+    pthread_mutex_init(&psmp->_lock, NULL);
+    pthread_cond_init(&psmp->_changed, NULL);
+
+    for (unsigned i = 0; i < psmp->_ncores; i++) {
+        int err = pthread_create(&psmp->_cores[i]._thread, NULL, run_core, &psmp->_cores[i]);
+        if (err != 0) {
+            fprintf(stderr, "smp: %s\n", strerror(err));
+            exit(1);
+        }
+    }
+    bool halted = true;
+    for (unsigned i = 0; i < psmp->_ncores; i++) {
+        pthread_join(psmp->_cores[i]._thread, NULL);
+        halted = halted && psmp->_cores[i]._status._err == ERR_NOERROR;
+    }
+    pthread_cond_destroy(&psmp->_changed);
+    pthread_mutex_destroy(&psmp->_lock);
+    return halted;
+}
@@ -0,0 +1,128 @@
+#ifndef _SMP_H_
+#define _SMP_H_
+
+/*!
+ * \file smp.h
+ * \brief Multiprocesseur : plusieurs cœurs qui partagent le segment de données.
+ *
+ * Un multiprocesseur est construit à partir d'une Machine chargée : chaque
+ * cœur est une copie de la machine, avec son propre compteur ordinal, son
+ * code condition, ses registres et sa propre zone de pile, mais les segments
+ * de texte et de données sont ceux de la machine d'origine, partagés. Au
+ * départ, \c R0 contient le numéro du cœur, \c R1 le nombre de cœurs, et la
+ * zone de pile (de \c _dataend au sommet de pile initial) est découpée en
+ * tranches égales : le cœur \e i commence \e i tranches sous le sommet. Le
+ * contrôle de pile reste celui d'une machine seule : un cœur qui déborde de
+ * sa tranche sur celle d'un autre n'est pas arrêté.
+ *
+ * Chaque cœur s'exécute sur son propre thread hôte, avec le moteur choisi.
+ * Deux instructions servent à la synchronisation des cœurs :
+ *
+ *   - \c XADD et \c XCHG (échange-addition et échange d'un registre avec un
+ *   mot de données) sont indivisibles : ils suffisent pour les compteurs
+ *   partagés, les tickets et les verrous ;
+ *
+ *   - \c BARRIER attend que tous les cœurs encore actifs y soient arrivés ;
+ *   un cœur qui s'arrête (\c HALT ou erreur) n'est plus attendu.
+ *
+ * Sur une machine seule, \c XADD et \c XCHG se comportent de même et
+ * \c BARRIER est sans effet.
+ *
+ * Deux modes d'exécution sont proposés :
+ *
+ *   - <b>cœurs libres</b> (\c _quantum nul) : tous les threads s'exécutent en
+ *   même temps, à pleine vitesse ; l'entrelacement des accès dépend de l'hôte ;
+ *
+ *   - <b>entrelacement déterministe</b> : les cœurs s'exécutent à tour de
+ *   rôle, chacun pour \c _quantum instructions au plus (voir run_budget()),
+ *   dans l'ordre de leurs numéros ; un cœur qui attend au rendez-vous cède
+ *   son tour. Deux exécutions donnent exactement le même résultat, ce qui
+ *   permet de reproduire une course pour la mettre au point.
+ *
+ * Chaque cœur a son propre cache de micro-opérations, sans zone de garde
+ * (voir guard.h) : seule la machine d'origine est inscrite, et le traitant
+ * de \c SIGSEGV ne traduit que les fautes de ses propres accès ; ceux des
+ * cœurs restent contrôlés.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simulator.h"
+
+//! Options d'exécution d'un multiprocesseur
+typedef struct {
+    unsigned _cores; //!< Nombre de cœurs (au moins 1)
+    Engine _engine; //!< Moteur d'exécution de chaque cœur
+    uint64_t _quantum; //!< Instructions par tour en entrelacement déterministe (0 : cœurs libres)
+} Smp_Options;
+
+//! Un cœur et l'issue de son exécution
+typedef struct {
+    Machine _mach; //!< État du cœur (segments partagés avec la machine d'origine)
+    Simul_Status _status; //!< Issue de l'exécution (voir simul_run())
+    bool _done; //!< Cœur arrêté (\c HALT ou erreur) ?
+    bool _waiting; //!< Cœur en attente au rendez-vous (entrelacement déterministe) ?
+    pthread_t _thread; //!< Thread hôte du cœur
+} Core;
+
+//! Multiprocesseur
+typedef struct Smp {
+    Core *_cores; //!< Les cœurs
+    unsigned _ncores; //!< Nombre de cœurs
+    Engine _engine; //!< Moteur d'exécution
+    uint64_t _quantum; //!< Instructions par tour (0 : cœurs libres)
+    pthread_mutex_t _lock; //!< Protection des champs qui suivent et de \c _done, \c _waiting
+    pthread_cond_t _changed; //!< Signalée à chaque changement de ces champs
+    unsigned _live; //!< Nombre de cœurs qui ne sont pas arrêtés
+    unsigned _arrived; //!< Nombre de cœurs arrivés au rendez-vous en cours
+    unsigned _generation; //!< Nombre de rendez-vous passés
+    unsigned _turn; //!< Cœur dont c'est le tour (entrelacement déterministe)
+} Smp;
+
+//! Création d'un multiprocesseur à partir d'une machine chargée
+/*!
+ * Les cœurs partent de l'état de la machine, aux registres \c R0, \c R1 et
+ * \c SP près (voir smp.h). La machine doit survivre au multiprocesseur ; son
+ * segment de données est celui des cœurs.
+ *
+ * \param pmach la machine chargée
+ * \param options le nombre de cœurs, le moteur et le mode d'exécution
+ * \return le multiprocesseur (à libérer par free_smp()), ou NULL (et
+ * \c errno positionnée) si la pile ne peut pas être partagée entre les cœurs
+ */
+Smp *create_smp(Machine *pmach, const Smp_Options *options);
+
+//! Exécution de tous les cœurs jusqu'à leur arrêt
+/*!
+ * Chaque cœur s'exécute sur son propre thread jusqu'au \c HALT ou jusqu'à
+ * sa première erreur, qui est rangée dans son \c _status sans arrêter les
+ * autres cœurs. Aucun avertissement n'est affiché.
+ *
+ * \note Comme avec run_batch(), un cœur qui ne s'arrête jamais bloque
+ * l'exécution.
+ *
+ * \param psmp le multiprocesseur
+ * \return vrai si tous les cœurs se sont arrêtés sur \c HALT
+ */
+bool run_smp(Smp *psmp);
+
+//! Libération d'un multiprocesseur
+/*!
+ * La machine d'origine et ses segments ne sont pas libérés.
+ *
+ * \param psmp le multiprocesseur (ou NULL)
+ */
+void free_smp(Smp *psmp);
+
+//! Rendez-vous des cœurs (instruction \c BARRIER)
+/*!
+ * Le cœur attend que tous les cœurs actifs soient arrivés au rendez-vous ;
+ * en entrelacement déterministe, il cède son tour en attendant.
+ *
+ * \param pmach le cœur en cours d'exécution (sans effet sur une machine seule)
+ */
+void smp_barrier(Machine *pmach);
+
+#endif
@@ -0,0 +1,222 @@
+/*!
+ * \file snapshot.c
+ * \brief Photographie d'une machine et remise à zéro rapide.
+ */
+
+#define _DEFAULT_SOURCE // Pour sigaction() et SA_SIGINFO
+
+#include "snapshot.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//! Nombre maximal de zones suivies simultanément
+#define MAX_TRACKED 256
+
+//! Suivi des pages modifiées d'une zone protégée en écriture
+/*!
+ * Les suivis sont dans un tableau statique et ne sont jamais libérés : le
+ * traitant de \c SIGSEGV peut les parcourir sans verrou pendant qu'un autre
+ * thread en prend ou en rend un. Un suivi est actif quand \c _start n'est pas
+ * NULL ; ses autres champs sont remplis avant.
+ *
+ * Les cœurs d'un multiprocesseur (voir smp.h) partagent le segment de
+ * données : plusieurs threads peuvent faire faute en même temps dans la même
+ * zone, voire dans la même page. Une page n'est notée qu'une fois
+ * (\c _dirty), dans une case réservée par une addition indivisible.
+ */
+struct Tracking {
+    volatile int _busy; //!< Suivi attribué ?
+    char *volatile _start; //!< Début de la zone (aligné sur une page), NULL si inactif
+    size_t _size; //!< Taille de la zone (multiple de la taille de page)
+    unsigned *_pages; //!< Numéros des pages modifiées
+    volatile unsigned _npages; //!< Nombre de pages modifiées
+    uint8_t *_dirty; //!< Page déjà notée ? (une case par page)
+};
+
+//! Les suivis (voir struct Tracking)
+static struct Tracking tracked[MAX_TRACKED];
+
+//! Taille d'une page
+static size_t pagesize;
+
+//! Action de \c SIGSEGV avant l'installation de notre traitant
+static struct sigaction previous_action;
+
+//! Installation du traitant (une seule fois)
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+//! Traitant de \c SIGSEGV : première écriture dans une page suivie.
+/*!
+ * Si l'adresse fautive n'est dans aucune zone suivie, on appelle le traitant
+ * précédent (celui de la zone de garde, voir guard.h, par exemple) ; à
+ * défaut, on réinstalle l'action précédente et on revient : l'instruction
+ * fautive est réexécutée et le signal traité comme si ce module n'existait
+ * pas. Il en va de même si la page suivie ne peut pas être rendue accessible
+ * en écriture (track() écarte d'avance les zones où c'est le cas).
+ */
+static void on_write_fault(int sig, siginfo_t *info, void *context) {
+    char *addr = info->si_addr;
+    int saved = errno;
+
+    for (unsigned i = 0; i < MAX_TRACKED; i++) {
+        char *start = tracked[i]._start;
+        if (start != NULL && addr >= start && addr < start + tracked[i]._size) {
+            unsigned n = (addr - start) / pagesize;
+            if (__sync_bool_compare_and_swap(&tracked[i]._dirty[n], 0, 1)) {
+                tracked[i]._pages[__sync_fetch_and_add(&tracked[i]._npages, 1)] = n;
+            }
+            if (mprotect(start + (size_t) n * pagesize, pagesize, PROT_READ | PROT_WRITE) == 0) {
+                errno = saved;
+                return;
+            }
+            break; // Page qui ne peut être rendue : pas de reprise sans fin
+        }
+    }
+    errno = saved;
+    if ((previous_action.sa_flags & SA_SIGINFO) != 0) {
+        previous_action.sa_sigaction(sig, info, context);
+    } else if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN) {
+        previous_action.sa_handler(sig);
+    } else {
+        sigaction(SIGSEGV, &previous_action, NULL);
+    }
+}
+
+//! Initialisation du module : taille de page et traitant de \c SIGSEGV
+static void init_tracking(void) {
+    struct sigaction action;
+
+    pagesize = sysconf(_SC_PAGESIZE);
+    memset(&action, 0, sizeof action);
+    action.sa_sigaction = on_write_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous_action);
+}
+
+//! Mise sous surveillance d'une zone projetée
+/*!
+ * \param start le début de la zone (aligné sur une page)
+ * \param size la taille de la zone (multiple de la taille de page)
+ * \return le suivi, ou NULL si la zone est déjà suivie ou si tous les suivis
+ * sont pris
+ */
+static struct Tracking *track(char *start, size_t size) {
+    pthread_once(&once, init_tracking);
+    for (unsigned i = 0; i < MAX_TRACKED; i++) {
+        if (tracked[i]._start == start) {
+            return NULL;
+        }
+    }
+    for (unsigned i = 0; i < MAX_TRACKED; i++) {
+        struct Tracking *ptrack = &tracked[i];
+        if (!__sync_bool_compare_and_swap(&ptrack->_busy, 0, 1)) {
+            continue;
+        }
+        ptrack->_pages = malloc(sizeof (unsigned) * (size / pagesize));
+        ptrack->_dirty = calloc(size / pagesize > 0 ? size / pagesize : 1, sizeof (uint8_t));
+        // La protection doit pouvoir se lever page par page : ce n'est pas le
+        // cas des pages géantes (MAP_HUGETLB, voir try_map_program())
+        if (ptrack->_pages == NULL || ptrack->_dirty == NULL
+                || mprotect(start, pagesize, PROT_READ) != 0 || mprotect(start, size, PROT_READ) != 0) {
+            mprotect(start, size, PROT_READ | PROT_WRITE);
+            free(ptrack->_pages);
+            free(ptrack->_dirty);
+            ptrack->_busy = 0;
+            return NULL;
+        }
+        ptrack->_size = size;
+        ptrack->_npages = 0;
+        __sync_synchronize();
+        ptrack->_start = start;
+        return ptrack;
+    }
+    return NULL;
+}
+
+//! Fin de la surveillance d'une zone
+static void untrack(struct Tracking *ptrack) {
+    char *start = ptrack->_start;
+    ptrack->_start = NULL;
+    __sync_synchronize();
+    mprotect(start, ptrack->_size, PROT_READ | PROT_WRITE);
+    free(ptrack->_pages);
+    free(ptrack->_dirty);
+    ptrack->_busy = 0;
+}
+
+Snapshot *take_snapshot(Machine *pmach) {
+    Snapshot *psnap = malloc(sizeof (Snapshot));
+    if (psnap == NULL) {
+        return NULL;
+    }
+    settle_cc(pmach);
+    psnap->_pc = pmach->_pc;
+    psnap->_cc = pmach->_cc;
+    memcpy(psnap->_registers, pmach->_registers, sizeof psnap->_registers);
+
+    if (pmach->_datamap._addr != NULL) {
+        psnap->_start = pmach->_datamap._addr;
+        psnap->_size = pmach->_datamap._size;
+    } else {
+        psnap->_start = (char *) pmach->_data;
+        psnap->_size = sizeof (Word) * pmach->_datasize;
+    }
+    psnap->_copy = malloc(psnap->_size > 0 ? psnap->_size : 1);
+    if (psnap->_copy == NULL) {
+        free(psnap);
+        return NULL;
+    }
+    memcpy(psnap->_copy, psnap->_start, psnap->_size);
+
+    psnap->_tracking = NULL;
+    if (pmach->_datamap._addr != NULL) {
+        psnap->_tracking = track(psnap->_start, psnap->_size);
+    }
+    return psnap;
+}
+
+void restore_snapshot(Snapshot *psnap, Machine *pmach) {
+    pmach->_pc = psnap->_pc;
+    pmach->_cc = psnap->_cc;
+    pmach->_ccresult = CC_SETTLED;
+    memcpy(pmach->_registers, psnap->_registers, sizeof pmach->_registers);
+
+    struct Tracking *ptrack = psnap->_tracking;
+    if (ptrack == NULL) {
+        memcpy(psnap->_start, psnap->_copy, psnap->_size);
+        return;
+    }
+    for (unsigned i = 0; i < ptrack->_npages; i++) {
+        size_t offset = ptrack->_pages[i] * pagesize;
+        memcpy(psnap->_start + offset, psnap->_copy + offset, pagesize);
+        mprotect(psnap->_start + offset, pagesize, PROT_READ);
+        ptrack->_dirty[ptrack->_pages[i]] = 0;
+    }
+    ptrack->_npages = 0;
+}
+
+unsigned dirty_pages(const Snapshot *psnap) {
+    if (psnap->_tracking == NULL) {
+        size_t size = sysconf(_SC_PAGESIZE);
+        return (psnap->_size + size - 1) / size;
+    }
+    return psnap->_tracking->_npages;
+}
+
+void free_snapshot(Snapshot *psnap) {
+    if (psnap == NULL) {
+        return;
+    }
+    if (psnap->_tracking != NULL) {
+        untrack(psnap->_tracking);
+    }
+    free(psnap->_copy);
+    free(psnap);
+}
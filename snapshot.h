@@ -0,0 +1,77 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+/*!
+ * \file snapshot.h
+ * \brief Photographie d'une machine et remise à zéro rapide.
+ *
+ * Pour exécuter plusieurs fois un même programme (avec des entrées
+ * différentes par exemple), on photographie la machine une fois chargée puis
+ * on la restaure après chaque exécution, au lieu de relire le programme.
+ *
+ * Le segment de texte n'est jamais modifié par l'exécution : la photographie
+ * n'en garde pas de copie. Le segment de données est recopié une fois pour
+ * toutes. Si le segment de données est une projection appartenant à la
+ * machine (voir read_program()), ses pages sont ensuite protégées en
+ * écriture : la première écriture dans une page provoque un \c SIGSEGV que
+ * le module intercepte pour noter la page comme modifiée et la rendre à
+ * nouveau accessible en écriture. La restauration ne recopie que les pages
+ * modifiées, et coûte donc ce que l'exécution a touché, pas \c _datasize.
+ * L'exécution elle-même ne paie rien, quel que soit le moteur. Le suivi vaut
+ * aussi pour les cœurs d'un multiprocesseur (voir smp.h), qui écrivent en
+ * même temps dans le segment partagé. Sinon (segments fournis à
+ * load_program(), ou en pages géantes dont la protection ne se lève pas page
+ * par page), la restauration recopie tout le segment.
+ */
+
+#include <stddef.h>
+
+#include "machine.h"
+
+//! Photographie d'une machine
+typedef struct {
+    unsigned _pc; //!< Compteur ordinal
+    Condition_Code _cc; //!< Code condition
+    Word _registers[NREGISTERS]; //!< Registres généraux
+    char *_start; //!< Début de la zone de données sauvegardée
+    size_t _size; //!< Taille de la zone en octets
+    char *_copy; //!< Copie de la zone
+    struct Tracking *_tracking; //!< Suivi des pages modifiées (NULL : restauration complète)
+} Snapshot;
+
+//! Photographie d'une machine chargée
+/*!
+ * Une machine ne peut avoir qu'une photographie à suivi de pages à la fois :
+ * les suivantes recopient tout le segment à la restauration. La photographie
+ * doit être libérée avant que le programme ne soit déchargé.
+ *
+ * \param pmach la machine (qui ne doit pas être en cours d'exécution)
+ * \return la photographie, ou NULL si la mémoire manque
+ */
+Snapshot *take_snapshot(Machine *pmach);
+
+//! Remise de la machine dans l'état de la photographie
+/*!
+ * \param psnap la photographie
+ * \param pmach la machine photographiée (qui ne doit pas être en cours
+ * d'exécution, ni aucun des cœurs qui partagent son segment de données)
+ */
+void restore_snapshot(Snapshot *psnap, Machine *pmach);
+
+//! Nombre de pages de données modifiées depuis la photographie ou la dernière restauration
+/*!
+ * \param psnap la photographie
+ * \return le nombre de pages, ou le nombre de pages de la zone si ses pages
+ * ne sont pas suivies
+ */
+unsigned dirty_pages(const Snapshot *psnap);
+
+//! Libération d'une photographie
+/*!
+ * Les pages de la machine redeviennent accessibles en écriture.
+ *
+ * \param psnap la photographie (ou NULL)
+ */
+void free_snapshot(Snapshot *psnap);
+
+#endif
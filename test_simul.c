@@ -3,11 +3,17 @@
  * \brief Test du simulateur
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "machine.h"
+#include "simulator.h"
 #include "debug.h"
+#include "exec.h"
+#include "batch.h"
+#include "dump.h"
+#include "smp.h"
 
 //! Segment de texte
 extern Instruction text[];
@@ -33,13 +39,117 @@ static void usage()
     printf("Usage: test_simul [options] [binfile]\n");
     printf("where options are:\n"
            "\t-d\tDebug mode (interactive execution)\n"
+           "\t-R\tDebug mode: the next argument is the number of executed\n"
+           "\t\tinstructions recorded (16 bytes each) so that the debugger\n"
+           "\t\tcan step back from a breakpoint or an error\n"
            "\t-b\tA binary file is provided\n"
            "\t-l\tDo not execute; just display the listing\n"
+           "\t-e\tExecution engine: the next argument is one of\n"
+           "\t\tswitch (reference interpreter, default), decoded, threaded,\n"
+           "\t\tjit (native x86-64 code)\n"
+           "\t-t\tTrace level: the next argument is one of\n"
+           "\t\toff, branches (BRANCH/CALL/RET only), all (default),\n"
+           "\t\tregs (all instructions and modified registers)\n"
+           "\t-O\tOutput format of the final state: the next argument is one of\n"
+           "\t\ttext (default), json (one line), binary (raw 32-bit words);\n"
+           "\t\twith json or binary only the final state is printed, and the\n"
+           "\t\ttrace is off unless -t is given\n"
+           "\t-r\tData range: the next argument is first-last or first (word\n"
+           "\t\taddresses, decimal or 0x-prefixed hexadecimal); only these\n"
+           "\t\tdata words are printed\n"
+           "\t-n\tDo not write the binary dump file dump.prog\n"
+           "\t-s\tData segment size: the next argument is the number of words\n"
+           "\t\t(at least the size in the binary file), or max for the whole\n"
+           "\t\t1M-word address space; pages are allocated when first touched\n"
+           "\t\tand the stack starts at the top of the declared segment\n"
+           "\t-H\tBack the data segment with huge pages when available\n"
+           "\t-F\tReport the superinstructions executed by the fast engines\n"
+           "\t-p\tProfile the execution: print the instructions sorted by\n"
+           "\t\texecution count after the final state; the next argument is\n"
+           "\t\ta file receiving the raw counts\n"
+           "\t-S\tSampling profile for long runs: the next argument is a file\n"
+           "\t\treceiving the table of sampled call stacks; the most sampled\n"
+           "\t\taddresses are printed after the final state\n"
+           "\t-i\tSampling interval: the next argument is N[us][:DEPTH], a sample\n"
+           "\t\tevery N instructions (default 1000000) or every N microseconds\n"
+           "\t\tof host CPU time, with DEPTH return addresses (default 4, max 8)\n"
+           "\t-T\tBinary trace: the next argument is a file receiving a compact\n"
+           "\t\trecord of every executed instruction, written by a background\n"
+           "\t\tthread (see tracedump); the text trace is off unless -t is given\n"
+           "\t-C\tCache model of data accesses: the next argument is default\n"
+           "\t\tor L1[,L2],MEMLAT where a level is SIZE:WAYS:LINE:LATENCY\n"
+           "\t\t(words and cycles); hits, misses and cycles per subroutine\n"
+           "\t\tare printed after the final state\n"
+           "\t-B\tBatch mode: the next argument is a file listing binary\n"
+           "\t\tprograms (one per line) or a directory of .bin files; each\n"
+           "\t\tprogram runs without trace on a pool of threads\n"
+           "\t-j\tBatch mode: the next argument is the number of threads\n"
+           "\t\t(default: one per processor)\n"
+           "\t-o\tBatch mode: the next argument is the results file\n"
+           "\t\t(default: standard output)\n"
+           "\t-L\tBatch mode: programs with the same text segment run together\n"
+           "\t\tin SIMD lanes, the next argument being the number of programs\n"
+           "\t\tper run (default: one program at a time)\n"
+           "\t-c\tMultiprocessor: the next argument is the number of cores,\n"
+           "\t\teach running on its own thread without trace and sharing the\n"
+           "\t\tdata segment; core i starts with R0 = i, R1 = the number of\n"
+           "\t\tcores and its own slice of the stack\n"
+           "\t-q\tMultiprocessor: the next argument is a number of instructions;\n"
+           "\t\tthe cores take turns running that many instructions, so that\n"
+           "\t\tevery run is identical (default: cores run freely)\n"
            "\t-h\tprint this help message\n"
            "If -b is given, the next argument must be a file name containing\n"
            "a valid program in binary format. Otherwise an internally defined\n"
-           "example program is used; the program is also dumped in binary into\n"
-           "the file dump.bin\n");
+           "example program is used. The program is also dumped in binary into\n"
+           "the file dump.prog, unless -n is given\n");
+}
+
+//! Exécution sur un multiprocesseur et affichage de l'état final de chaque cœur
+/*!
+ * \param pmach la machine chargée (détruite au retour)
+ * \param smp les options du multiprocesseur
+ * \param dump le format et la partie du segment de données à afficher
+ * \return le code de sortie de test_simul
+ */
+static int run_cores(Machine *pmach, const Smp_Options *smp, const Dump_Options *dump)
+{
+    Smp *psmp = create_smp(pmach, smp);
+    if (psmp == NULL)
+    {
+        fprintf(stderr, "Stack too small for %u cores\n", smp->_cores);
+        exit(EXIT_FAILURE);
+    }
+    bool text_output = dump->_format == DUMP_TEXT;
+    if (text_output)
+        printf("\n*** Execution on %u cores (%s) ***\n", smp->_cores,
+               smp->_quantum != 0 ? "interleaved" : "free-running");
+
+    bool halted = run_smp(psmp);
+
+    if (text_output)
+        printf("\n*** Machine state after execution ***\n");
+    for (unsigned i = 0; i < psmp->_ncores; i++)
+    {
+        Core *pcore = &psmp->_cores[i];
+        if (!text_output)
+        {
+            if (!print_state(&pcore->_mach, pcore->_status, dump))
+                perror("test_simul");
+            continue;
+        }
+        printf("\n*** Core %u ***\n", i);
+        if (pcore->_status._err != ERR_NOERROR)
+            print_error(pcore->_status._err, pcore->_status._addr);
+        else
+            print_warning(WARN_HALT, pcore->_status._addr);
+        print_cpu(&pcore->_mach);
+    }
+    if (text_output)
+        print_data_range(pmach, dump->_first, dump->_end);
+
+    free_smp(psmp);
+    simul_destroy(pmach);
+    return halted ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 //! Programme de test
@@ -49,18 +159,121 @@ static void usage()
  * <dl>
  *   <dt>-d</dt><dd>mode pas à pas (mise au point)</dd>
  *
+ *   <dt>-R</dt><dd>taille de l'historique (voir \link History \endlink) qui
+ *   permet de revenir en arrière dans la mise au point ; le nombre
+ *   d'instructions enregistrées suit l'option.</dd>
+ *
  *   <dt>-f</dt><dd>le programme est dans un fichier binaire ; le nom de ce
  *   fichier doit être fourni également en paramètre de la ligne de
  *   commande ; sans cette option, on exécute un programme de test prédéfini.</dd>
  *
+ *   <dt>-e</dt><dd>choix du moteur d'exécution ; le nom du moteur (voir
+ *   \c engine_names) suit l'option.</dd>
+ *
+ *   <dt>-t</dt><dd>niveau de trace ; le nom du niveau (voir \c trace_names)
+ *   suit l'option. Sans trace ni mise au point, le moteur exécute le
+ *   programme à pleine vitesse.</dd>
+ *
+ *   <dt>-O</dt><dd>format de l'état final (voir print_state()) ; le nom
+ *   du format (voir \c dump_names) suit l'option. En JSON ou en binaire,
+ *   seul l'état final est écrit et la trace est coupée, sauf option \c -t.</dd>
+ *
+ *   <dt>-r</dt><dd>partie du segment de données affichée, de la forme
+ *   <tt>premier-dernier</tt> (adresses incluses) ou <tt>premier</tt>.</dd>
+ *
+ *   <dt>-n</dt><dd>pas de sauvegarde binaire dans dump.prog (voir
+ *   print_memory()).</dd>
+ *
+ *   <dt>-s</dt><dd>taille déclarée du segment de données, en mots, ou
+ *   \c max pour \c MAX_DATASIZE (voir try_map_program()).</dd>
+ *
+ *   <dt>-H</dt><dd>segment de données en grandes pages.</dd>
+ *
+ *   <dt>-F</dt><dd>rapport sur les superinstructions exécutées (voir
+ *   print_fusion()).</dd>
+ *
+ *   <dt>-p</dt><dd>profil de l'exécution (voir print_profile()) ; le nom du
+ *   fichier qui reçoit les compteurs bruts (voir write_profile()) suit
+ *   l'option.</dd>
+ *
+ *   <dt>-S</dt><dd>profil par échantillonnage (voir print_samples()) ; le
+ *   nom du fichier qui reçoit la table des échantillons (voir
+ *   write_samples()) suit l'option.</dd>
+ *
+ *   <dt>-i</dt><dd>période d'échantillonnage, de la forme
+ *   <tt>N[us][:profondeur]</tt> : toutes les \e N instructions, ou toutes
+ *   les \e N microsecondes de temps processeur avec \c us ; la profondeur est
+ *   le nombre d'adresses de retour relevées.</dd>
+ *
+ *   <dt>-T</dt><dd>trace binaire (voir tracefile.h) ; le nom du fichier suit
+ *   l'option. La trace textuelle est coupée, sauf option \c -t.</dd>
+ *
+ *   <dt>-C</dt><dd>modèle de caches des accès aux données (voir
+ *   print_cache_model()) ; la configuration (voir
+ *   cache_config_from_string()) suit l'option.</dd>
+ *
+ *   <dt>-B</dt><dd>exécution d'un lot de programmes (voir run_batch()) ; la
+ *   liste des programmes ou le répertoire qui les contient suit l'option.
+ *   Les options \c -j (nombre de threads), \c -o (fichier des résultats) et
+ *   \c -L (programmes par exécution en voies parallèles, voir lanes.h)
+ *   précisent l'exécution du lot.</dd>
+ *
+ *   <dt>-c</dt><dd>multiprocesseur (voir smp.h) ; le nombre de cœurs suit
+ *   l'option. L'option \c -q (nombre d'instructions par tour) choisit
+ *   l'entrelacement déterministe.</dd>
+ *
  * </dl>
  */
 int main(int argc, char *argv[])
 {
-    bool debug = false;
     bool binfile = false;
     bool no_exec = false;
+    bool fusion_report = false;
+    bool write_dump = true;
+    bool trace_given = false;
+    Memory_Options memory = {
+        ._datasize = 0,
+        ._hugepages = false,
+        ._guard = true,
+    };
+    Dump_Options dump = {
+        ._format = DUMP_TEXT,
+        ._first = 0,
+        ._end = UINT_MAX,
+    };
+    Batch_Options batch = {
+        ._input = NULL,
+        ._output = NULL,
+        ._threads = 0,
+        ._lanes = 0,
+    };
+    Smp_Options smp = {
+        ._cores = 1,
+        ._quantum = 0,
+    };
     char *programfile = NULL;
+    unsigned long history = 0;
+    char *profilefile = NULL;
+    char *samplefile = NULL;
+    char *tracefile = NULL;
+    Sampler_Options sampling = {
+        ._period = 1000000,
+        ._interval_us = 0,
+        ._depth = 4,
+    };
+    Cache_Config cache_config;
+    bool cache_model = false;
+    Simul_Options options = {
+        ._engine = ENGINE_SWITCH,
+        ._trace = TRACE_ALL,
+        ._debug = false,
+        ._warnings = true,
+        ._profile = NULL,
+        ._history = NULL,
+        ._cache = NULL,
+        ._sampler = NULL,
+        ._tracefile = NULL,
+    };
 
     if (argc > 1) 
     {
@@ -70,7 +283,22 @@ int main(int argc, char *argv[])
                 switch (argv[iarg][1])
                 {
                 case 'd':
-                    debug = true;
+                    options._debug = true;
+                    break;
+                case 'R':
+                    if (++iarg < argc)
+                    {
+                        char *end;
+                        history = strtoul(argv[iarg], &end, 0);
+                        if (*end != '\0' || history >= UINT_MAX)
+                            history = 0;
+                    }
+                    if (history == 0)
+                    {
+                        fprintf(stderr, "Missing or invalid history size for option -R\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
                     break;
                 case 'b': 
                     binfile = true;
@@ -78,6 +306,178 @@ int main(int argc, char *argv[])
                  case 'l': 
                     no_exec = true;
                     break;
+                case 'e':
+                    if (++iarg >= argc || !engine_from_name(argv[iarg], &options._engine))
+                    {
+                        fprintf(stderr, "Missing or unknown engine for option -e\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case 't':
+                    if (++iarg >= argc || !trace_from_name(argv[iarg], &options._trace))
+                    {
+                        fprintf(stderr, "Missing or unknown trace level for option -t\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    trace_given = true;
+                    break;
+                case 'O':
+                    if (++iarg >= argc || !dump_from_name(argv[iarg], &dump._format))
+                    {
+                        fprintf(stderr, "Missing or unknown output format for option -O\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case 'r':
+                {
+                    char *end;
+                    unsigned long first = 0, last = 0;
+                    if (++iarg < argc)
+                    {
+                        first = last = strtoul(argv[iarg], &end, 0);
+                        if (end != argv[iarg] && *end == '-')
+                        {
+                            char *range = end + 1;
+                            last = strtoul(range, &end, 0);
+                            if (end == range)
+                                end = range - 1;
+                        }
+                    }
+                    if (iarg >= argc || *end != '\0' || first > last || last >= UINT_MAX)
+                    {
+                        fprintf(stderr, "Missing or invalid data range for option -r\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    dump._first = first;
+                    dump._end = last + 1;
+                    break;
+                }
+                case 'n':
+                    write_dump = false;
+                    break;
+                case 's':
+                    if (++iarg < argc)
+                    {
+                        if (strcmp(argv[iarg], "max") == 0)
+                            memory._datasize = MAX_DATASIZE;
+                        else
+                        {
+                            char *end;
+                            unsigned long size = strtoul(argv[iarg], &end, 0);
+                            memory._datasize = *end == '\0' && size < UINT_MAX ? size : 0;
+                        }
+                    }
+                    if (memory._datasize == 0)
+                    {
+                        fprintf(stderr, "Missing or invalid data segment size for option -s\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case 'H':
+                    memory._hugepages = true;
+                    break;
+                case 'F':
+                    fusion_report = true;
+                    break;
+                case 'i':
+                {
+                    char *end = NULL;
+                    unsigned long n = 0, depth = sampling._depth;
+                    bool timer = false;
+                    if (++iarg < argc)
+                    {
+                        n = strtoul(argv[iarg], &end, 0);
+                        timer = strncmp(end, "us", 2) == 0;
+                        if (timer)
+                            end += 2;
+                        if (*end == ':')
+                            depth = strtoul(end + 1, &end, 0);
+                    }
+                    if (end == NULL || *end != '\0' || n == 0 || n >= UINT_MAX || depth > SAMPLE_MAX_DEPTH)
+                    {
+                        fprintf(stderr, "Missing or invalid sampling interval for option -i\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    sampling._period = n;
+                    sampling._interval_us = timer ? n : 0;
+                    sampling._depth = depth;
+                    break;
+                }
+                case 'C':
+                    if (++iarg >= argc || !cache_config_from_string(argv[iarg], &cache_config))
+                    {
+                        fprintf(stderr, "Missing or invalid cache configuration for option -C\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    cache_model = true;
+                    break;
+                case 'p':
+                case 'S':
+                case 'T':
+                case 'B':
+                case 'o':
+                    if (++iarg >= argc)
+                    {
+                        fprintf(stderr, "Missing file name for option %s\n", argv[iarg - 1]);
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    if (argv[iarg - 1][1] == 'p')
+                        profilefile = argv[iarg];
+                    else if (argv[iarg - 1][1] == 'S')
+                        samplefile = argv[iarg];
+                    else if (argv[iarg - 1][1] == 'T')
+                        tracefile = argv[iarg];
+                    else if (argv[iarg - 1][1] == 'B')
+                        batch._input = argv[iarg];
+                    else
+                        batch._output = argv[iarg];
+                    break;
+                case 'j':
+                    if (++iarg >= argc || atoi(argv[iarg]) <= 0)
+                    {
+                        fprintf(stderr, "Missing or invalid thread count for option -j\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    batch._threads = atoi(argv[iarg]);
+                    break;
+                case 'L':
+                    if (++iarg >= argc || atoi(argv[iarg]) <= 0)
+                    {
+                        fprintf(stderr, "Missing or invalid lane count for option -L\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    batch._lanes = atoi(argv[iarg]);
+                    break;
+                case 'c':
+                case 'q':
+                {
+                    char *end = NULL;
+                    unsigned long n = 0;
+                    if (++iarg < argc)
+                        n = strtoul(argv[iarg], &end, 0);
+                    if (end == NULL || *end != '\0' || n == 0 || n >= UINT_MAX)
+                    {
+                        fprintf(stderr, "Missing or invalid %s for option %s\n",
+                                argv[iarg - 1][1] == 'c' ? "core count" : "quantum", argv[iarg - 1]);
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    if (argv[iarg - 1][1] == 'c')
+                        smp._cores = n;
+                    else
+                        smp._quantum = n;
+                    break;
+                }
                   case 'h':
                     usage();
                     exit(EXIT_SUCCESS);
@@ -93,30 +493,150 @@ int main(int argc, char *argv[])
         }
     }
 
-    Machine mach;
+    if (batch._input != NULL)
+    {
+        batch._engine = options._engine;
+        return run_batch(&batch) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Machine *pmach = simul_create();
+    if (pmach == NULL)
+    {
+        perror("test_simul");
+        exit(1);
+    }
 
+    if (history != 0 && !options._debug)
+    {
+        fprintf(stderr, "Option -R requires debug mode (-d)\n");
+        exit(EXIT_FAILURE);
+    }
+    if (smp._cores == 1 && smp._quantum != 0)
+    {
+        fprintf(stderr, "Option -q requires several cores (-c)\n");
+        exit(EXIT_FAILURE);
+    }
+    if (smp._cores > 1 && (options._debug || profilefile != NULL || samplefile != NULL
+            || tracefile != NULL || cache_model || fusion_report))
+    {
+        fprintf(stderr, "Options -d, -p, -S, -T, -C and -F require a single core\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!binfile && (memory._datasize != 0 || memory._hugepages))
+    {
+        fprintf(stderr, "Options -s and -H require a binary file (-b)\n");
+        exit(EXIT_FAILURE);
+    }
     if (!binfile) 
-        load_program(&mach, textsize, text, datasize, data, dataend);
-    else 
-        read_program(&mach, programfile);   
+        simul_load_memory(pmach, textsize, text, datasize, data, dataend);
+    else if (!simul_load_with(pmach, programfile, &memory))
+    {
+        perror(programfile);
+        exit(1);
+    }
 
-    printf("\n*** Sauvegarde des programmes et données initiales en format binaire ***\n\n");
-    dump_memory(&mach);
+    // La trace binaire remplace la trace textuelle
+    if (tracefile != NULL && !trace_given)
+        options._trace = TRACE_OFF;
 
-    printf("\n*** Machine state before execution ***\n");
-    print_program(&mach);
-    print_data(&mach);
-    print_cpu(&mach);
+    // En JSON ou en binaire, la sortie standard ne reçoit que l'état final
+    bool text_output = dump._format == DUMP_TEXT;
+    if (!text_output)
+    {
+        options._warnings = false;
+        if (!trace_given)
+            options._trace = TRACE_OFF;
+    }
+    else
+    {
+        if (write_dump)
+        {
+            printf("\n*** Sauvegarde des programmes et données initiales en format binaire ***\n\n");
+            dump_memory(pmach);
+        }
+        else
+            print_memory(pmach);
+
+        printf("\n*** Machine state before execution ***\n");
+        print_program(pmach);
+        print_data_range(pmach, dump._first, dump._end);
+        print_cpu(pmach);
+    }
 
     if (no_exec) 
         return 0;
 
-    printf("\n*** Execution trace ***\n\n");
-    simul(&mach, debug);
+    if (smp._cores > 1)
+    {
+        smp._engine = options._engine;
+        return run_cores(pmach, &smp, &dump);
+    }
+
+    if (profilefile != NULL)
+        options._profile = create_profile(pmach->_textsize);
+    if (history != 0)
+        options._history = create_history(history);
+    if (cache_model)
+        options._cache = create_cache_model(&cache_config, pmach->_textsize);
+    if (samplefile != NULL)
+        options._sampler = create_sampler(&sampling);
+    if (tracefile != NULL && (options._tracefile = create_trace_writer(tracefile, pmach)) == NULL)
+    {
+        perror(tracefile);
+        exit(1);
+    }
+
+    if (text_output)
+        printf("\n*** Execution trace ***\n\n");
+    Simul_Status status = simul_run(pmach, &options);
+    if (options._tracefile != NULL && !close_trace_writer(options._tracefile))
+        perror(tracefile);
+    if (!text_output)
+    {
+        if (!print_state(pmach, status, &dump))
+            perror("test_simul");
+    }
+    else if (status._err != ERR_NOERROR)
+    {
+        if (!status._reported)
+            print_error(status._err, status._addr);
+    }
+    else
+    {
+        printf("\n*** Machine state after execution ***\n");
+        print_state(pmach, status, &dump);
+
+        if (fusion_report)
+            print_fusion(pmach->_fusion);
+    }
+
+    if (options._profile != NULL)
+    {
+        if (text_output)
+            print_profile(options._profile, pmach);
+        if (!write_profile(options._profile, pmach, profilefile))
+            perror(profilefile);
+        free_profile(options._profile);
+    }
+
+    if (options._sampler != NULL)
+    {
+        if (text_output)
+            print_samples(options._sampler, pmach);
+        if (!write_samples(options._sampler, samplefile))
+            perror(samplefile);
+        free_sampler(options._sampler);
+    }
+
+    if (options._cache != NULL)
+    {
+        if (text_output)
+            print_cache_model(options._cache);
+        free_cache_model(options._cache);
+    }
 
-    printf("\n*** Machine state after execution ***\n");
-    print_cpu(&mach);
-    print_data(&mach);
+    free_history(options._history);
+    simul_destroy(pmach);
 
-    return 0; 
+    return status._err == ERR_NOERROR ? EXIT_SUCCESS : EXIT_FAILURE; 
 }
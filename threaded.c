@@ -0,0 +1,362 @@
+/*!
+ * \file threaded.c
+ * \brief Interpréteur à enfilage direct (« direct threading »).
+ *
+ * Chaque micro-opération est accompagnée de l'adresse (au sens des \e labels
+ * de GNU C, <tt>&&label</tt>) du code qui l'exécute : à la fin de chaque
+ * traitant, on saute directement (<tt>goto *</tt>) au traitant de
+ * l'instruction suivante, sans revenir dans une boucle ni passer par un
+ * \c switch. Les compilateurs qui ne connaissent pas cette extension se
+ * rabattent sur l'interpréteur du cache de micro-opérations.
+ *
+ * Les tables d'instructions enfilées sont construites au premier appel et
+ * conservées dans la machine (\c Machine::_threaded) jusqu'à
+ * unload_program() : les exécutions bornées successives (échantillonnage,
+ * quanta du multiprocesseur, exécution en parallèle du vérificateur) ne les
+ * reconstruisent pas.
+ *
+ * Une exécution bornée (voir run_budget()) ne teste son budget qu'à l'entrée
+ * des tronçons sans transfert de contrôle (voir fuse()) : après chaque saut et
+ * après chaque branchement non pris, le traitant \c charge décompte tout le
+ * tronçon d'un coup. Le dernier tronçon, qui dépasse le budget, passe par une
+ * seconde table où chaque instruction mène d'abord au traitant \c counted,
+ * qui décompte les instructions une par une.
+ */
+
+#include "engine.h"
+#include "exec.h"
+#include "error.h"
+#include "smp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __GNUC__
+
+//! Instruction enfilée : adresse du traitant et micro-opération
+typedef struct {
+    const void *_handler; //!< Adresse du code du traitant
+    Decoded _d; //!< Micro-opération
+} Threaded;
+
+//! Décompte d'une instruction enfilée (exécution bornée seulement)
+typedef struct {
+    const void *_handler; //!< Traitant de la micro-opération ou de la superinstruction
+    const void *_single; //!< Traitant de la seule première instruction
+    unsigned _length; //!< Nombre d'instructions exécutées par \c _handler
+} Counted;
+
+//! Tables d'exécution d'un programme, conservées entre deux appels
+typedef struct Threaded_Tables {
+    Threaded *_code; //!< Exécution non bornée, puis \c op_end
+    const void **_entries; //!< Traitant de chaque adresse, à l'arrivée d'un saut (exécution non bornée)
+    const void **_charges; //!< \c charge pour chaque adresse, à l'arrivée d'un saut (exécution bornée)
+    Threaded *_fast; //!< Exécution bornée par tronçons (\c charge après chaque transfert de contrôle)
+    Threaded *_slow; //!< Exécution bornée instruction par instruction (\c counted partout)
+    Counted *_counts; //!< Décompte de chaque instruction (exécution bornée)
+} Threaded_Tables;
+
+//! Allocation d'une table d'instructions enfilées, sans ses traitants
+/*!
+ * \param textsize taille utile du segment de texte
+ * \param decoded les micro-opérations et superinstructions du programme
+ * \return la table, de \c textsize + 1 instructions
+ */
+static Threaded *new_table(unsigned textsize, const Decoded *decoded) {
+    Threaded *table = malloc(sizeof (Threaded) * (textsize + 1));
+    if (table == NULL) {
+        perror("threaded");
+        exit(1);
+    }
+    for (unsigned i = 0; i < textsize; i++) {
+        table[i]._d = decoded[i];
+    }
+    return table;
+}
+
+//! Exécution enfilée, éventuellement bornée
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param pbudget le nombre maximal d'instructions à exécuter (diminué du
+ * nombre d'instructions exécutées), ou NULL pour aller jusqu'au \c HALT
+ * \return faux après l'exécution de \c HALT ; vrai si le budget est épuisé
+ */
+static bool threaded(Machine *pmach, uint64_t *pbudget) {
+    static const void *const handlers[] = {
+#define UOP_LABEL(name, cop, mode) [UOP_##name] = &&uop_##name,
+#define FUSION_LABEL(name, ...) [FUSED_##name] = &&fused_##name,
+        UOP_LIST(UOP_LABEL)
+        FUSION3_LIST(FUSION_LABEL)
+        FUSION2_LIST(FUSION_LABEL)
+#undef UOP_LABEL
+#undef FUSION_LABEL
+    };
+
+    const unsigned textsize = pmach->_textsize;
+    const Decoded *decoded = pmach->_fusion->_code;
+    const unsigned *runs = pmach->_fusion->_runs;
+    uint64_t *executed = pmach->_fusion->_executed;
+
+    // Les adresses des traitants ne changent pas d'un appel à l'autre
+    Threaded_Tables *ptables = pmach->_threaded;
+    if (ptables == NULL) {
+        ptables = calloc(1, sizeof (Threaded_Tables));
+        if (ptables == NULL) {
+            perror("threaded");
+            exit(1);
+        }
+        ptables->_code = new_table(textsize, decoded);
+        ptables->_entries = malloc(sizeof (void *) * (textsize > 0 ? textsize : 1));
+        if (ptables->_entries == NULL) {
+            perror("threaded");
+            exit(1);
+        }
+        for (unsigned i = 0; i < textsize; i++) {
+            ptables->_code[i]._handler = handlers[decoded[i]._handler];
+            ptables->_entries[i] = ptables->_code[i]._handler;
+        }
+        ptables->_code[textsize]._handler = &&op_end; // Sortie du segment de texte par la fin
+        pmach->_threaded = ptables;
+    }
+    if (pbudget != NULL && ptables->_counts == NULL) {
+        Counted *counts = malloc(sizeof (Counted) * (textsize > 0 ? textsize : 1));
+        const void **charges = malloc(sizeof (void *) * (textsize > 0 ? textsize : 1));
+        if (counts == NULL || charges == NULL) {
+            perror("threaded");
+            exit(1);
+        }
+        Threaded *fast = new_table(textsize, decoded);
+        Threaded *slow = new_table(textsize, decoded);
+        for (unsigned i = 0; i < textsize; i++) {
+            counts[i]._handler = handlers[decoded[i]._handler];
+            counts[i]._single = handlers[pmach->_decoded[i]._handler];
+            counts[i]._length = handler_length(decoded[i]._handler);
+            // Un nouveau tronçon commence après chaque transfert de contrôle
+            fast[i]._handler = i > 0 && runs[i - 1] == 1 ? &&charge : counts[i]._handler;
+            slow[i]._handler = &&counted;
+            charges[i] = &&charge;
+        }
+        fast[textsize]._handler = &&op_end;
+        slow[textsize]._handler = &&op_end;
+        ptables->_fast = fast;
+        ptables->_slow = slow;
+        ptables->_counts = counts;
+        ptables->_charges = charges;
+    }
+    const Counted *const counts = ptables->_counts;
+    // Table en cours : non bornée, par tronçons, ou instruction par instruction
+    const Threaded *code = pbudget != NULL ? ptables->_fast : ptables->_code;
+    // Traitants à l'arrivée d'un saut : sans test du budget, ou charge
+    const void *const *jumps = pbudget != NULL ? ptables->_charges : ptables->_entries;
+    bool charging = pbudget != NULL; // Décompte par tronçons ?
+    uint64_t budget = pbudget != NULL ? *pbudget : 0; // Budget restant
+
+    // État de la machine conservé en variables locales
+    Word reg[NREGISTERS];
+    memcpy(reg, pmach->_registers, sizeof reg);
+    Condition_Code cc = pmach->_cc;
+    int64_t ccresult = pmach->_ccresult;
+    Word *const data = pmach->_data;
+    const unsigned datasize = pmach->_datasize;
+    const unsigned dataend = pmach->_dataend;
+    const Threaded *ip; // Instruction en cours
+    unsigned target; // Adresse de branchement
+
+    // Recopie de l'état local dans la machine (et du budget restant) ; pc est le compteur ordinal
+#define SYNC(pc) \
+    do { \
+        memcpy(pmach->_registers, reg, sizeof reg); \
+        pmach->_cc = ccresult == CC_SETTLED ? cc : sign_class((Word) ccresult); \
+        pmach->_ccresult = CC_SETTLED; \
+        pmach->_pc = (pc); \
+        if (pbudget != NULL) \
+            *pbudget = budget; \
+    } while (0)
+
+    // Erreur à l'adresse de l'instruction en cours
+#define FAULT(err) \
+    do { \
+        unsigned addr = IADDR; \
+        SYNC(addr + 1); \
+        error((err), addr); \
+    } while (0)
+
+#define DISPATCH() goto *ip->_handler
+
+#define NEXT() \
+    do { \
+        ++ip; \
+        DISPATCH(); \
+    } while (0)
+
+#define JUMP(t) \
+    do { \
+        target = (t); \
+        if (target >= textsize) \
+            goto segtext; \
+        ip = code + target; \
+        goto *jumps[target]; \
+    } while (0)
+
+    // Accès à l'état local pour les macros UOP_DO_xxx (voir uops.h)
+#define CUR (&ip->_d)
+#define REGS reg
+#define CCODE cc
+#define CCRESULT ccresult
+#define DATA data
+#define DATASIZE datasize
+#define DATAEND dataend
+    // L'état local n'est pas dans la machine : le mode G reste contrôlé
+#define GUARDED 0
+#define GUARD_BARRIER()
+#define GUARD_END()
+#define IADDR ((unsigned) (ip - code))
+#define STOP_HALT() \
+    do { \
+        unsigned addr = IADDR; \
+        SYNC(addr + 1); \
+        warning(WARN_HALT, addr); \
+        return false; \
+    } while (0)
+    // Erreur identique à celle de l'interpréteur de référence
+#define INVALID() \
+    do { \
+        unsigned addr = IADDR; \
+        SYNC(addr + 1); \
+        return decode_execute(pmach, pmach->_text[addr]); \
+    } while (0)
+#define BARRIER_WAIT() smp_barrier(pmach)
+
+    JUMP(pmach->_pc);
+
+    // Exécution bornée : décompte du tronçon entier s'il tient dans le budget
+charge:
+    if (!charging) {
+        goto counted;
+    }
+    {
+        unsigned addr = IADDR;
+        if (runs[addr] <= budget) {
+            budget -= runs[addr];
+            goto *counts[addr]._handler;
+        }
+        // Dernier tronçon : décompte instruction par instruction
+        charging = false;
+        code = ptables->_slow;
+        ip = code + addr;
+    }
+    // Exécution bornée : décompte, puis vrai traitant
+counted:
+    {
+        const Counted *pcount = &counts[IADDR];
+        if (budget == 0) {
+            SYNC(IADDR);
+            return true;
+        }
+        if (pcount->_length <= budget) {
+            budget -= pcount->_length;
+            goto *pcount->_handler;
+        }
+        --budget;
+        goto *pcount->_single;
+    }
+
+    // Un traitant par micro-opération, sans aucun test du mode d'adressage
+#define UOP_CODE(name, cop, mode) \
+uop_##name: \
+    UOP_DO_##cop(mode); \
+    NEXT();
+    UOP_LIST(UOP_CODE)
+#undef UOP_CODE
+
+    // Un traitant par superinstruction (voir fusion.h)
+#define FUSION3_CODE(name, c1, m1, c2, m2, c3, m3) \
+fused_##name: \
+    executed[FUSION_INDEX(FUSED_##name)]++; \
+    UOP_DO_##c1(m1); \
+    ++ip; \
+    UOP_DO_##c2(m2); \
+    ++ip; \
+    UOP_DO_##c3(m3); \
+    NEXT();
+#define FUSION2_CODE(name, same, c1, m1, c2, m2) \
+fused_##name: \
+    executed[FUSION_INDEX(FUSED_##name)]++; \
+    UOP_DO_##c1(m1); \
+    ++ip; \
+    UOP_DO_##c2(m2); \
+    NEXT();
+    FUSION3_LIST(FUSION3_CODE)
+    FUSION2_LIST(FUSION2_CODE)
+#undef FUSION3_CODE
+#undef FUSION2_CODE
+
+op_end:
+    target = textsize;
+segtext:
+    SYNC(target);
+    error(ERR_SEGTEXT, target);
+
+#undef SYNC
+#undef FAULT
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef CUR
+#undef REGS
+#undef CCODE
+#undef CCRESULT
+#undef DATA
+#undef DATASIZE
+#undef DATAEND
+#undef GUARDED
+#undef GUARD_BARRIER
+#undef GUARD_END
+#undef IADDR
+#undef STOP_HALT
+#undef INVALID
+#undef BARRIER_WAIT
+}
+
+void run_threaded(Machine *pmach) {
+    threaded(pmach, NULL);
+}
+
+bool run_threaded_budget(Machine *pmach, uint64_t *pbudget) {
+    return threaded(pmach, pbudget);
+}
+
+void free_threaded(Machine *pmach) {
+    Threaded_Tables *ptables = pmach->_threaded;
+    if (ptables != NULL) {
+        free(ptables->_code);
+        free(ptables->_entries);
+        free(ptables->_charges);
+        free(ptables->_fast);
+        free(ptables->_slow);
+        free(ptables->_counts);
+        free(ptables);
+        pmach->_threaded = NULL;
+    }
+}
+
+#else
+
+void run_threaded(Machine *pmach) {
+    do {
+        if (pmach->_pc >= pmach->_textsize) {
+            error(ERR_SEGTEXT, pmach->_pc);
+        }
+        pmach->_pc = pmach->_pc + 1;
+    } while (execute_decoded(pmach, &pmach->_decoded[pmach->_pc - 1]));
+}
+
+bool run_threaded_budget(Machine *pmach, uint64_t *pbudget) {
+    return run_budget(pmach, ENGINE_DECODED, pbudget);
+}
+
+void free_threaded(Machine *pmach) {
+    (void) pmach; // Aucune table
+}
+
+#endif
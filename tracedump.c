@@ -0,0 +1,140 @@
+/*!
+ * \file tracedump.c
+ * \brief Décodage d'une trace binaire (voir tracefile.h) en trace textuelle.
+ *
+ * tracedump relit le fichier écrit par <tt>test_simul -T</tt> et écrit sur
+ * la sortie standard les lignes \c TRACE: qu'aurait écrites test_simul au
+ * niveau de trace choisi (voir trace_instruction() et trace_registers()).
+ * Une plage d'adresses limite l'affichage aux instructions qu'elle contient ;
+ * les registres restent suivis sur toute la trace.
+ *
+ * Le code de retour est non nul si la trace est illisible, incomplète ou
+ * corrompue.
+ */
+
+#define _DEFAULT_SOURCE // Pour getopt()
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "exec.h"
+#include "tracefile.h"
+
+//! Help message.
+static void usage(void) {
+    printf("Usage: tracedump [options] tracefile\n");
+    printf("where options are:\n"
+           "\t-t\tTrace level: branches (BRANCH/CALL/RET only), all (default),\n"
+           "\t\tregs (all instructions and modified registers)\n"
+           "\t-r\tAddress range: first-last or first (instruction addresses,\n"
+           "\t\tdecimal or 0x-prefixed hexadecimal); only the instructions\n"
+           "\t\tin this range are printed\n"
+           "\t-h\tprint this help message\n"
+           "tracefile must be a binary trace written by test_simul -T.\n");
+}
+
+//! Lecture d'une plage d'adresses \c premier-dernier ou \c premier
+/*!
+ * \param arg l'argument de l'option
+ * \param pfirst la première adresse
+ * \param plast la dernière adresse (incluse)
+ * \return faux si la plage est invalide
+ */
+static bool range_from_string(const char *arg, unsigned *pfirst, unsigned *plast) {
+    char *end;
+    unsigned long first = strtoul(arg, &end, 0);
+    unsigned long last = first;
+
+    if (end == arg) {
+        return false;
+    }
+    if (*end == '-') {
+        const char *range = end + 1;
+        last = strtoul(range, &end, 0);
+        if (end == range) {
+            return false;
+        }
+    }
+    if (*end != '\0' || first > last || last >= UINT_MAX) {
+        return false;
+    }
+    *pfirst = first;
+    *plast = last;
+    return true;
+}
+
+//! Programme de décodage
+int main(int argc, char *argv[]) {
+    Trace_Level level = TRACE_ALL;
+    unsigned first = 0, last = UINT_MAX;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:r:h")) != -1) {
+        switch (opt) {
+            case 't':
+                if (!trace_from_name(optarg, &level) || level == TRACE_OFF) {
+                    fprintf(stderr, "Unknown trace level: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                if (!range_from_string(optarg, &first, &last)) {
+                    fprintf(stderr, "Invalid address range: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Missing trace file\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+    const char *file = argv[optind];
+    Trace_Reader *ptr = open_trace_reader(file);
+    if (ptr == NULL) {
+        perror(file);
+        return EXIT_FAILURE;
+    }
+
+    // Machine fictive : seuls ses registres et son code condition servent
+    Machine mach;
+    memset(&mach, 0, sizeof mach);
+    mach._ccresult = CC_SETTLED;
+    Word registers[NREGISTERS];
+    Condition_Code cc = ptr->_state._cc;
+    Trace_Record rec;
+
+    memcpy(registers, ptr->_state._registers, sizeof registers);
+    while (read_trace_record(ptr, &rec)) {
+        if (rec._pc >= first && rec._pc <= last) {
+            trace_instruction(level, &mach, rec._instr, rec._pc);
+            if (level >= TRACE_REGS && !rec._faulted) {
+                memcpy(mach._registers, ptr->_state._registers, sizeof registers);
+                mach._cc = ptr->_state._cc;
+                trace_registers(&mach, registers, cc);
+            }
+        }
+        memcpy(registers, ptr->_state._registers, sizeof registers);
+        cc = ptr->_state._cc;
+    }
+
+    bool truncated = ptr->_truncated;
+    close_trace_reader(ptr);
+    if (truncated) {
+        fprintf(stderr, "tracedump: %s: truncated or corrupted trace\n", file);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,424 @@
+/*!
+ * \file tracefile.c
+ * \brief Trace binaire de l'exécution, écrite par un thread en arrière-plan.
+ */
+
+#define _POSIX_C_SOURCE 200112L // Pour nanosleep()
+
+#include "tracefile.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//! Marque des fichiers de trace ("STRC" en mémoire)
+static const char trace_magic[4] = {'S', 'T', 'R', 'C'};
+
+//! Indicateurs de l'octet qui commence chaque enregistrement compressé
+enum {
+    TRACE_CC = 0x03, //!< Code condition après l'instruction
+    TRACE_FAULTED = 0x04, //!< Instruction fautive
+    TRACE_JUMP = 0x08, //!< Adresse de l'instruction fournie (sinon : celle qui suit la précédente)
+    TRACE_NEW = 0x10, //!< Mot de l'instruction fourni (sinon : déjà rencontré)
+    TRACE_VALUE = 0x20, //!< Écart de la valeur du registre écrit fourni (sinon : inchangée)
+    TRACE_WHERE = 0x40, //!< Écart de l'adresse de données fourni (sinon : pas d'accès)
+    TRACE_END = 0x80, //!< Fin de la trace (octet seul, écrit à la fermeture)
+};
+
+//! Taille au-delà de laquelle les octets compressés sont écrits
+#define TRACE_FLUSH (1u << 16)
+
+//! Enregistrements compressés entre deux mises à jour de \c _tail
+#define TRACE_BATCH 4096u
+
+//! Registre écrit par une instruction
+/*!
+ * \param instr l'instruction
+ * \return le numéro du registre, ou -1 si l'instruction n'en écrit aucun
+ */
+static int written_register(Instruction instr) {
+    switch (instr.instr_generic._cop) {
+        case LOAD:
+        case ADD:
+        case SUB:
+        case XADD:
+        case XCHG:
+            return instr.instr_generic._regcond;
+        case CALL:
+        case RET:
+        case PUSH:
+        case POP:
+            return NREGISTERS - 1;
+        default:
+            return -1;
+    }
+}
+
+//! Adresse du mot de données désigné par l'opérande d'une instruction
+/*!
+ * \param pmach la machine, avant l'instruction
+ * \param instr l'instruction
+ * \param paddress l'adresse du mot
+ * \return faux si l'instruction n'a pas d'opérande en mémoire
+ */
+static bool operand_address(const Machine *pmach, Instruction instr, unsigned *paddress) {
+    switch (instr.instr_generic._cop) {
+        case LOAD:
+        case STORE:
+        case ADD:
+        case SUB:
+        case PUSH:
+        case POP:
+        case XADD:
+        case XCHG:
+            if (instr.instr_generic._immediate) {
+                return false;
+            }
+            if (instr.instr_generic._indexed) {
+                *paddress = pmach->_registers[instr.instr_indexed._rindex] + instr.instr_indexed._offset;
+            } else {
+                *paddress = instr.instr_absolute._address;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+//! Initialisation de l'état de la compression ou de la décompression
+static void init_state(Trace_State *ps, unsigned textsize) {
+    ps->_textsize = textsize;
+    ps->_text = malloc(sizeof (Instruction) * (textsize > 0 ? textsize : 1));
+    ps->_known = calloc(textsize > 0 ? textsize : 1, 1);
+    if (ps->_text == NULL || ps->_known == NULL) {
+        perror("trace");
+        exit(1);
+    }
+    ps->_where = 0;
+}
+
+//! Ajout d'un entier de longueur variable (7 bits par octet, poids faibles d'abord)
+static void put_varint(Output *pout, uint32_t value) {
+    while (value >= 0x80) {
+        output_char(pout, (char) (value | 0x80));
+        value >>= 7;
+    }
+    output_char(pout, (char) value);
+}
+
+//! Lecture d'un entier de longueur variable
+/*!
+ * \return faux si le fichier s'arrête avant la fin de l'entier
+ */
+static bool get_varint(FILE *file, uint32_t *pvalue) {
+    uint32_t value = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        int c = getc(file);
+        if (c == EOF) {
+            return false;
+        }
+        value |= (uint32_t) (c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            *pvalue = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Écart entre deux mots, codé pour que les petits écarts négatifs restent courts
+static uint32_t zigzag(Word after, Word before) {
+    uint32_t delta = after - before;
+    return (delta << 1) ^ (uint32_t) -(delta >> 31);
+}
+
+//! Mot qui diffère de \c before de l'écart codé par zigzag()
+static Word unzigzag(uint32_t code, Word before) {
+    return before + ((code >> 1) ^ (uint32_t) -(code & 1));
+}
+
+//! Compression d'un enregistrement
+/*!
+ * \param ps l'état de la compression (mis à jour)
+ * \param pout le tampon qui reçoit les octets
+ * \param prec l'enregistrement
+ */
+static void encode_record(Trace_State *ps, Output *pout, const Trace_Record *prec) {
+    unsigned pc = prec->_pc;
+    size_t at = pout->_length;
+    unsigned flags;
+
+    output_char(pout, 0); // Indicateurs, complétés à la fin
+    if (prec->_faulted) {
+        flags = TRACE_FAULTED | ps->_cc;
+    } else {
+        flags = prec->_cc;
+        ps->_cc = prec->_cc;
+    }
+    if (pc != ps->_pc) {
+        flags |= TRACE_JUMP;
+        put_varint(pout, pc);
+    }
+    if (pc >= ps->_textsize || !ps->_known[pc]) {
+        flags |= TRACE_NEW;
+        output_bytes(pout, &prec->_instr, sizeof (Instruction));
+        if (pc < ps->_textsize) {
+            ps->_text[pc] = prec->_instr;
+            ps->_known[pc] = 1;
+        }
+    }
+    int reg = written_register(prec->_instr);
+    if (!prec->_faulted && reg >= 0 && prec->_value != ps->_registers[reg]) {
+        flags |= TRACE_VALUE;
+        put_varint(pout, zigzag(prec->_value, ps->_registers[reg]));
+        ps->_registers[reg] = prec->_value;
+    }
+    if (prec->_touched) {
+        flags |= TRACE_WHERE;
+        put_varint(pout, zigzag(prec->_where, ps->_where));
+        ps->_where = prec->_where;
+    }
+    ps->_pc = pc + 1;
+    pout->_buffer[at] = (char) flags;
+}
+
+//! Écriture des octets compressés en attente
+/*!
+ * Après une erreur d'écriture, les octets sont jetés : le producteur ne
+ * doit pas rester bloqué sur un tampon plein.
+ */
+static void flush_trace(Trace_Writer *ptw) {
+    if (!output_flush(&ptw->_out, ptw->_file) && ptw->_errno == 0) {
+        ptw->_errno = errno != 0 ? errno : EIO;
+    }
+}
+
+//! Thread d'écriture : compression des enregistrements déposés jusqu'à la fermeture
+static void *drain_trace(void *arg) {
+    Trace_Writer *ptw = arg;
+    const struct timespec pause = {0, 100000};
+    uint64_t tail = ptw->_tail;
+
+    for (;;) {
+        // _closing est lu avant _head : tout ce qui précède la fermeture est vu
+        bool closing = __atomic_load_n(&ptw->_closing, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&ptw->_head, __ATOMIC_ACQUIRE);
+        if (tail == head) {
+            if (closing) {
+                output_char(&ptw->_out, (char) TRACE_END);
+                break;
+            }
+            flush_trace(ptw);
+            nanosleep(&pause, NULL);
+            continue;
+        }
+        uint64_t end = head - tail > TRACE_BATCH ? tail + TRACE_BATCH : head;
+        for (; tail < end; tail++) {
+            encode_record(&ptw->_state, &ptw->_out, &ptw->_ring[tail % TRACE_RING_SIZE]);
+        }
+        __atomic_store_n(&ptw->_tail, tail, __ATOMIC_RELEASE);
+        if (ptw->_out._length >= TRACE_FLUSH) {
+            flush_trace(ptw);
+        }
+    }
+    flush_trace(ptw);
+    return NULL;
+}
+
+Trace_Writer *create_trace_writer(const char *file, const Machine *pmach) {
+    FILE *out = fopen(file, "w");
+    if (out == NULL) {
+        return NULL;
+    }
+    // En-tête : marque, taille du texte, compteur ordinal, code condition, registres
+    uint32_t header[4 + NREGISTERS];
+    memcpy(&header[0], trace_magic, sizeof trace_magic);
+    header[1] = pmach->_textsize;
+    header[2] = pmach->_pc;
+    header[3] = current_cc(pmach);
+    memcpy(&header[4], pmach->_registers, sizeof (Word) * NREGISTERS);
+    if (fwrite(header, sizeof header, 1, out) != 1) {
+        int saved = errno;
+        fclose(out);
+        errno = saved;
+        return NULL;
+    }
+
+    Trace_Writer *ptw = calloc(1, sizeof (Trace_Writer));
+    if (ptw == NULL || (ptw->_ring = malloc(sizeof (Trace_Record) * TRACE_RING_SIZE)) == NULL) {
+        perror("create_trace_writer");
+        exit(1);
+    }
+    ptw->_free = TRACE_RING_SIZE;
+    ptw->_file = out;
+    output_init(&ptw->_out, 2 * TRACE_FLUSH);
+    init_state(&ptw->_state, pmach->_textsize);
+    ptw->_state._pc = pmach->_pc;
+    ptw->_state._cc = header[3];
+    memcpy(ptw->_state._registers, pmach->_registers, sizeof (Word) * NREGISTERS);
+
+    int err = pthread_create(&ptw->_thread, NULL, drain_trace, ptw);
+    if (err != 0) {
+        fprintf(stderr, "trace: %s\n", strerror(err));
+        exit(1);
+    }
+    return ptw;
+}
+
+//! Dépôt d'un enregistrement dans le tampon circulaire
+/*!
+ * Si le tampon est plein, le producteur cède le processeur jusqu'à ce que
+ * le thread d'écriture en ait libéré une partie.
+ */
+static void deposit_record(Trace_Writer *ptw, const Trace_Record *prec) {
+    uint64_t head = ptw->_head;
+    while (head == ptw->_free) {
+        ptw->_free = __atomic_load_n(&ptw->_tail, __ATOMIC_ACQUIRE) + TRACE_RING_SIZE;
+        if (head == ptw->_free) {
+            sched_yield();
+        }
+    }
+    ptw->_ring[head % TRACE_RING_SIZE] = *prec;
+    __atomic_store_n(&ptw->_head, head + 1, __ATOMIC_RELEASE);
+}
+
+void begin_trace_record(Trace_Writer *ptw, const Machine *pmach, unsigned addr) {
+    Trace_Record *prec = &ptw->_pending;
+
+    if (ptw->_started) {
+        prec->_faulted = true;
+        deposit_record(ptw, prec);
+    }
+    prec->_pc = addr;
+    prec->_cc = CC_U;
+    prec->_faulted = false;
+    prec->_instr = pmach->_text[addr];
+    prec->_value = 0;
+    prec->_where = 0;
+    prec->_touched = operand_address(pmach, prec->_instr, &prec->_where);
+    ptw->_started = true;
+}
+
+void end_trace_record(Trace_Writer *ptw, const Machine *pmach) {
+    Trace_Record *prec = &ptw->_pending;
+    int reg = written_register(prec->_instr);
+
+    prec->_value = reg >= 0 ? pmach->_registers[reg] : 0;
+    prec->_cc = current_cc(pmach);
+    deposit_record(ptw, prec);
+    ptw->_started = false;
+}
+
+bool close_trace_writer(Trace_Writer *ptw) {
+    if (ptw == NULL) {
+        return true;
+    }
+    if (ptw->_started) {
+        ptw->_pending._faulted = true;
+        deposit_record(ptw, &ptw->_pending);
+    }
+    __atomic_store_n(&ptw->_closing, true, __ATOMIC_RELEASE);
+    pthread_join(ptw->_thread, NULL);
+
+    int err = ptw->_errno;
+    if (fclose(ptw->_file) != 0 && err == 0) {
+        err = errno;
+    }
+    output_free(&ptw->_out);
+    free(ptw->_state._text);
+    free(ptw->_state._known);
+    free(ptw->_ring);
+    free(ptw);
+    errno = err;
+    return err == 0;
+}
+
+Trace_Reader *open_trace_reader(const char *file) {
+    FILE *in = fopen(file, "r");
+    if (in == NULL) {
+        return NULL;
+    }
+    uint32_t header[4 + NREGISTERS];
+    if (fread(header, sizeof header, 1, in) != 1 || memcmp(&header[0], trace_magic, sizeof trace_magic) != 0
+            || header[3] > CC_N) {
+        fclose(in);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    Trace_Reader *ptr = malloc(sizeof (Trace_Reader));
+    if (ptr == NULL) {
+        perror("open_trace_reader");
+        exit(1);
+    }
+    ptr->_file = in;
+    ptr->_truncated = false;
+    init_state(&ptr->_state, header[1]);
+    ptr->_state._pc = header[2];
+    ptr->_state._cc = header[3];
+    memcpy(ptr->_state._registers, &header[4], sizeof (Word) * NREGISTERS);
+    return ptr;
+}
+
+bool read_trace_record(Trace_Reader *ptr, Trace_Record *prec) {
+    Trace_State *ps = &ptr->_state;
+    int flags = getc(ptr->_file);
+    uint32_t pc = ps->_pc;
+    uint32_t code;
+
+    if (flags == EOF || flags == TRACE_END) {
+        ptr->_truncated = flags == EOF || getc(ptr->_file) != EOF;
+        return false;
+    }
+    ptr->_truncated = true; // Jusqu'à ce que l'enregistrement soit complet
+    if ((flags & ~(TRACE_CC | TRACE_FAULTED | TRACE_JUMP | TRACE_NEW | TRACE_VALUE | TRACE_WHERE)) != 0
+            || ((flags & TRACE_JUMP) != 0 && !get_varint(ptr->_file, &pc)) || pc >= 1u << 28) {
+        return false;
+    }
+    prec->_pc = pc;
+    if ((flags & TRACE_NEW) != 0) {
+        if (fread(&prec->_instr, sizeof (Instruction), 1, ptr->_file) != 1) {
+            return false;
+        }
+        if (pc < ps->_textsize) {
+            ps->_text[pc] = prec->_instr;
+            ps->_known[pc] = 1;
+        }
+    } else if (pc < ps->_textsize && ps->_known[pc]) {
+        prec->_instr = ps->_text[pc];
+    } else {
+        return false;
+    }
+    int reg = written_register(prec->_instr);
+    if ((flags & TRACE_VALUE) != 0) {
+        if (reg < 0 || !get_varint(ptr->_file, &code)) {
+            return false;
+        }
+        ps->_registers[reg] = unzigzag(code, ps->_registers[reg]);
+    }
+    prec->_value = reg >= 0 ? ps->_registers[reg] : 0;
+    prec->_touched = (flags & TRACE_WHERE) != 0;
+    if (prec->_touched) {
+        if (!get_varint(ptr->_file, &code)) {
+            return false;
+        }
+        ps->_where = unzigzag(code, ps->_where);
+    }
+    prec->_where = prec->_touched ? ps->_where : 0;
+    prec->_faulted = (flags & TRACE_FAULTED) != 0;
+    ps->_cc = flags & TRACE_CC;
+    prec->_cc = ps->_cc;
+    ps->_pc = pc + 1;
+    ptr->_truncated = false;
+    return true;
+}
+
+void close_trace_reader(Trace_Reader *ptr) {
+    if (ptr != NULL) {
+        fclose(ptr->_file);
+        free(ptr->_state._text);
+        free(ptr->_state._known);
+        free(ptr);
+    }
+}
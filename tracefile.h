@@ -0,0 +1,158 @@
+#ifndef _TRACEFILE_H_
+#define _TRACEFILE_H_
+
+/*!
+ * \file tracefile.h
+ * \brief Trace binaire de l'exécution, écrite par un thread en arrière-plan.
+ *
+ * La trace textuelle (voir trace_instruction()) coûte un \c printf par
+ * instruction, bien plus que la simulation elle-même. Quand l'option
+ * \c _tracefile est fournie à simul_engine(), chaque instruction dépose à la
+ * place un enregistrement de taille fixe dans un tampon circulaire : son
+ * adresse, son mot brut, la valeur du registre qu'elle écrit et l'adresse du
+ * mot de données désigné par son opérande. Le tampon n'a qu'un producteur
+ * (le thread qui simule) et qu'un consommateur (le thread d'écriture) :
+ * chacun n'avance que son propre indice, sans verrou. Le producteur n'attend
+ * que si le tampon est plein.
+ *
+ * Le thread d'écriture compresse les enregistrements avant de les écrire :
+ * un octet d'indicateurs, puis seulement ce qui ne se déduit pas de
+ * l'enregistrement précédent (adresse si elle ne suit pas la précédente, mot
+ * de l'instruction la première fois qu'elle est exécutée, écart entre la
+ * nouvelle et l'ancienne valeur du registre écrit, écart avec l'adresse de
+ * données précédente), en entiers de longueur variable. Une instruction
+ * tient le plus souvent en un à trois octets ; un octet final marque la
+ * fermeture de la trace. Le fichier commence par l'état initial de la
+ * machine, ce qui permet au décodage de reconstituer tous les registres
+ * (voir open_trace_reader()) : le programme tracedump en tire la trace
+ * textuelle de test_simul, à tout niveau de trace.
+ *
+ * Comme le profil, la trace binaire impose l'exécution instruction par
+ * instruction (voir simul_engine()).
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "machine.h"
+#include "output.h"
+
+//! Nombre d'enregistrements du tampon circulaire (puissance de 2)
+#define TRACE_RING_SIZE (1u << 16)
+
+//! Enregistrement d'une instruction exécutée (16 octets)
+typedef struct {
+    unsigned _pc : 28; //!< Adresse de l'instruction
+    Condition_Code _cc : 2; //!< Code condition après l'instruction
+    bool _touched : 1; //!< \c _where est-il valide ?
+    bool _faulted : 1; //!< L'instruction a provoqué une erreur (\c _value et \c _cc non valides)
+    Instruction _instr; //!< Mot brut de l'instruction
+    Word _value; //!< Valeur après l'instruction du registre qu'elle écrit (\c SP pour \c CALL, \c RET, \c PUSH et \c POP)
+    unsigned _where; //!< Adresse du mot de données désigné par l'opérande (la pile se déduit de \c SP)
+} Trace_Record;
+
+//! État commun à la compression et à la décompression
+typedef struct {
+    unsigned _textsize; //!< Taille du segment de texte
+    Instruction *_text; //!< Mot de chaque instruction déjà rencontrée
+    uint8_t *_known; //!< Instruction déjà rencontrée ? (une case par adresse)
+    unsigned _pc; //!< Adresse qui suit celle de l'enregistrement précédent
+    unsigned _where; //!< Dernière adresse de données
+    Condition_Code _cc; //!< Code condition
+    Word _registers[NREGISTERS]; //!< Registres
+} Trace_State;
+
+//! Trace en cours d'écriture
+typedef struct {
+    Trace_Record *_ring; //!< Tampon circulaire de \c TRACE_RING_SIZE enregistrements
+    uint64_t _head; //!< Enregistrements déposés (écrit par le producteur seul)
+    uint64_t _free; //!< Dépôts possibles sans relire \c _tail (vu du producteur)
+    char _pad[64]; //!< Indices sur des lignes de cache distinctes
+    uint64_t _tail; //!< Enregistrements compressés (écrit par le consommateur seul)
+    Trace_Record _pending; //!< Instruction commencée (voir begin_trace_record())
+    bool _started; //!< \c _pending attend-il la fin de son instruction ?
+    bool _closing; //!< Plus rien ne sera déposé
+    pthread_t _thread; //!< Thread d'écriture
+    FILE *_file; //!< Fichier de la trace
+    Output _out; //!< Octets compressés en attente d'écriture
+    Trace_State _state; //!< État de la compression
+    int _errno; //!< Première erreur d'écriture (0 : aucune)
+} Trace_Writer;
+
+//! Trace en cours de lecture
+typedef struct {
+    FILE *_file; //!< Fichier de la trace
+    Trace_State _state; //!< État après le dernier enregistrement lu
+    bool _truncated; //!< Le fichier s'arrête au milieu d'un enregistrement, ou est corrompu ?
+} Trace_Reader;
+
+//! Création d'une trace binaire et de son thread d'écriture
+/*!
+ * L'en-tête donne l'état initial de la machine : compteur ordinal, code
+ * condition et registres.
+ *
+ * \param file le nom du fichier
+ * \param pmach la machine chargée, avant l'exécution
+ * \return la trace (à fermer par close_trace_writer()), ou NULL (et
+ * \c errno positionnée) si le fichier ne peut être créé
+ */
+Trace_Writer *create_trace_writer(const char *file, const Machine *pmach);
+
+//! Début de l'enregistrement d'une instruction, avant son exécution
+/*!
+ * Une instruction commencée qui n'a pas été terminée (erreur) est déposée
+ * comme fautive.
+ *
+ * \param ptw la trace
+ * \param pmach la machine, dans l'état qui précède l'instruction
+ * \param addr l'adresse de l'instruction
+ */
+void begin_trace_record(Trace_Writer *ptw, const Machine *pmach, unsigned addr);
+
+//! Fin de l'enregistrement d'une instruction, après son exécution
+/*!
+ * \param ptw la trace
+ * \param pmach la machine, dans l'état qui suit l'instruction
+ */
+void end_trace_record(Trace_Writer *ptw, const Machine *pmach);
+
+//! Fermeture d'une trace binaire
+/*!
+ * L'instruction commencée et non terminée est déposée comme fautive ; le
+ * thread d'écriture vide le tampon et se termine. La trace est libérée.
+ *
+ * \param ptw la trace (ou NULL)
+ * \return faux (et \c errno positionnée) en cas d'échec d'écriture
+ */
+bool close_trace_writer(Trace_Writer *ptw);
+
+//! Ouverture d'une trace binaire
+/*!
+ * \param file le nom du fichier
+ * \return la trace, dans l'état initial de la machine (à fermer par
+ * close_trace_reader()), ou NULL (et \c errno positionnée) si le fichier est
+ * illisible ou n'est pas une trace
+ */
+Trace_Reader *open_trace_reader(const char *file);
+
+//! Lecture de l'enregistrement suivant
+/*!
+ * L'état de la lecture (registres, code condition) devient celui qui suit
+ * l'instruction.
+ *
+ * \param ptr la trace
+ * \param prec l'enregistrement lu
+ * \return faux à la fin de la trace (\c _truncated indique si elle est
+ * incomplète ou corrompue)
+ */
+bool read_trace_record(Trace_Reader *ptr, Trace_Record *prec);
+
+//! Fermeture d'une trace lue
+/*!
+ * \param ptr la trace (ou NULL)
+ */
+void close_trace_reader(Trace_Reader *ptr);
+
+#endif
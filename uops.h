@@ -0,0 +1,272 @@
+#ifndef _UOPS_H_
+#define _UOPS_H_
+
+/*!
+ * \file uops.h
+ * \brief Micro-opérations spécialisées par code opération et mode d'adressage.
+ *
+ * Le mode d'adressage d'une instruction est fixé une fois pour toutes dans
+ * son mot : plutôt que de le tester à chaque exécution, on choisit au
+ * pré-décodage une micro-opération spécialisée pour le triplet (code
+ * opération, bit immédiat, bit indexé), c'est-à-dire pour les 8 bits de poids
+ * faible du mot d'instruction.
+ *
+ * Les micro-opérations sont décrites une seule fois, dans la liste
+ * \c UOP_LIST (technique des « X-macros »). La sémantique de chaque code
+ * opération est décrite une seule fois aussi, par les macros
+ * <tt>UOP_DO_<i>cop</i>(mode)</tt>. Chaque moteur d'exécution en déduit ses
+ * propres traitants spécialisés après avoir défini les macros d'accès à
+ * l'état de la machine suivantes :
+ *
+ *   - \c CUR : la micro-opération en cours (<tt>const Decoded *</tt>) ;
+ *   - \c REGS : les registres généraux ;
+ *   - \c CCODE, \c CCRESULT : le code condition et le dernier résultat dont
+ *     il n'a pas encore été déduit (\c CC_SETTLED si \c CCODE est à jour) ;
+ *   - \c DATA, \c DATASIZE, \c DATAEND : le segment de données ;
+ *   - \c GUARDED : vrai si le moteur laisse la zone de garde (voir guard.h)
+ *     intercepter les accès indexés hors du segment en mode \c G ;
+ *   - \c GUARD_BARRIER() : barrière qui range en mémoire l'état de la machine
+ *     avant un accès non contrôlé en mode \c G, et \c GUARD_END() : fin de
+ *     cet accès (sans objet si \c GUARDED est faux) ;
+ *   - \c IADDR : l'adresse de l'instruction en cours ;
+ *   - \c FAULT(err) : erreur \c err à l'adresse de l'instruction en cours ;
+ *   - \c JUMP(target) : branchement à l'adresse \c target ;
+ *   - \c STOP_HALT() : fin normale du programme (sur \c HALT) ;
+ *   - \c BARRIER_WAIT() : rendez-vous des cœurs (voir smp_barrier()) ;
+ *   - \c INVALID() : instruction invalide, confiée à decode_execute().
+ *
+ * Les combinaisons illégales (code inconnu, \c ILLOP, valeur immédiate avec
+ * \c STORE, \c BRANCH, \c CALL, \c POP, \c XADD ou \c XCHG) n'ont pas de
+ * micro-opération : elles sont toutes traduites en \c UOP_FAULT.
+ *
+ * Les adresses absolues de données sont vérifiées au chargement (voir
+ * predecode()) : une instruction dont l'adresse sort du segment est elle
+ * aussi traduite en \c UOP_FAULT, et le mode \c A n'a donc aucun contrôle
+ * d'adresse à faire.
+ */
+
+#include "instruction.h"
+
+//! Liste des micro-opérations : DEF(nom, code opération, mode)
+/*!
+ * Le mode est \c I (immédiat), \c A (absolu), \c X (indexé), \c G (indexé,
+ * segment suivi d'une zone de garde) ou \c N (sans objet). Le mode \c G
+ * n'est choisi qu'au chargement d'un programme dont le segment de données
+ * est gardé (voir predecode()) ; \c POP n'en a pas, car son contrôle
+ * d'adresse précède la modification de \c SP. \c UOP_FAULT doit rester la
+ * première (valeur 0) et \c UOP_HALT la dernière.
+ */
+#define UOP_LIST(DEF) \
+    DEF(FAULT, ILLOP, N) \
+    DEF(NOP, NOP, N) \
+    DEF(LOAD_I, LOAD, I) \
+    DEF(LOAD_A, LOAD, A) \
+    DEF(LOAD_X, LOAD, X) \
+    DEF(LOAD_G, LOAD, G) \
+    DEF(STORE_A, STORE, A) \
+    DEF(STORE_X, STORE, X) \
+    DEF(STORE_G, STORE, G) \
+    DEF(ADD_I, ADD, I) \
+    DEF(ADD_A, ADD, A) \
+    DEF(ADD_X, ADD, X) \
+    DEF(ADD_G, ADD, G) \
+    DEF(SUB_I, SUB, I) \
+    DEF(SUB_A, SUB, A) \
+    DEF(SUB_X, SUB, X) \
+    DEF(SUB_G, SUB, G) \
+    DEF(BRANCH_A, BRANCH, A) \
+    DEF(BRANCH_X, BRANCH, X) \
+    DEF(CALL_A, CALL, A) \
+    DEF(CALL_X, CALL, X) \
+    DEF(RET, RET, N) \
+    DEF(PUSH_I, PUSH, I) \
+    DEF(PUSH_A, PUSH, A) \
+    DEF(PUSH_X, PUSH, X) \
+    DEF(PUSH_G, PUSH, G) \
+    DEF(POP_A, POP, A) \
+    DEF(POP_X, POP, X) \
+    DEF(XADD_A, XADD, A) \
+    DEF(XADD_X, XADD, X) \
+    DEF(XCHG_A, XCHG, A) \
+    DEF(XCHG_X, XCHG, X) \
+    DEF(BARRIER, BARRIER, N) \
+    DEF(HALT, HALT, N)
+
+//! Micro-opérations spécialisées
+typedef enum {
+#define UOP_ENUM(name, cop, mode) UOP_##name,
+    UOP_LIST(UOP_ENUM)
+#undef UOP_ENUM
+} Uop;
+
+//! Dernière valeur possible d'une micro-opération
+static const unsigned LAST_UOP = UOP_HALT;
+
+//! Clé de sélection d'une micro-opération (8 bits de poids faible de l'instruction)
+#define UOP_KEY(cop, imm, idx) ((cop) | (imm) << 6 | (idx) << 7)
+
+//! Entrées de la table de sélection pour une micro-opération de la liste
+/*!
+ * Avec le bit immédiat, le bit indexé est ignoré (comme dans decode_execute()).
+ */
+#define UOP_ENTRY(name, cop, mode) UOP_ENTRY_##mode(UOP_##name, cop)
+#define UOP_ENTRY_I(uop, cop) [UOP_KEY(cop, 1, 0)] = uop, [UOP_KEY(cop, 1, 1)] = uop,
+#define UOP_ENTRY_A(uop, cop) [UOP_KEY(cop, 0, 0)] = uop,
+#define UOP_ENTRY_X(uop, cop) [UOP_KEY(cop, 0, 1)] = uop,
+#define UOP_ENTRY_G(uop, cop)
+#define UOP_ENTRY_N(uop, cop) UOP_ENTRY_I(uop, cop) UOP_ENTRY_A(uop, cop) UOP_ENTRY_X(uop, cop)
+
+// Opérandes selon le mode d'adressage
+
+#define UOP_ADDRESS_A() ((unsigned) CUR->_operand)
+#define UOP_ADDRESS_X() (REGS[CUR->_rindex] + CUR->_operand)
+#define UOP_ADDRESS_G() UOP_ADDRESS_X()
+
+// Contrôle d'une adresse de données selon le mode d'adressage
+
+#define UOP_CHECK_A(a) ((void) 0) // Vérifiée au chargement
+#define UOP_CHECK_X(a) \
+    do { \
+        if ((a) > DATASIZE) \
+            FAULT(ERR_SEGDATA); \
+    } while (0)
+#define UOP_CHECK_G(a) \
+    do { \
+        if (!GUARDED) \
+            UOP_CHECK_X(a); \
+        GUARD_BARRIER(); \
+    } while (0)
+
+// Fin de l'accès à une adresse de données contrôlée par UOP_CHECK_xxx
+#define UOP_DONE_A() ((void) 0)
+#define UOP_DONE_X() ((void) 0)
+#define UOP_DONE_G() GUARD_END()
+
+#define UOP_READ(v, M) \
+    do { \
+        unsigned a_ = UOP_ADDRESS_##M(); \
+        UOP_CHECK_##M(a_); \
+        (v) = DATA[a_]; \
+        UOP_DONE_##M(); \
+    } while (0)
+
+#define UOP_FETCH_I(v) ((v) = (Word) CUR->_operand)
+#define UOP_FETCH_A(v) UOP_READ(v, A)
+#define UOP_FETCH_X(v) UOP_READ(v, X)
+#define UOP_FETCH_G(v) UOP_READ(v, G)
+
+#define UOP_SP REGS[NREGISTERS - 1]
+
+#define UOP_CHECK_SP() \
+    do { \
+        if (UOP_SP < DATAEND || UOP_SP >= DATASIZE) \
+            FAULT(ERR_SEGSTACK); \
+    } while (0)
+
+// Le code condition n'est déduit du dernier résultat qu'aux branchements
+#define UOP_CC() (CCRESULT == CC_SETTLED ? CCODE : sign_class((Word) CCRESULT))
+#define UOP_CONDITION() ((condition_masks[CUR->_regcond] >> UOP_CC()) & 1)
+
+// Sémantique de chaque code opération (mêmes contrôles, dans le même ordre, que exec.c)
+
+#define UOP_DO_ILLOP(M) INVALID()
+
+#define UOP_DO_NOP(M)
+
+#define UOP_DO_LOAD(M) \
+    do { \
+        Word v_; \
+        UOP_FETCH_##M(v_); \
+        REGS[CUR->_regcond] = v_; \
+        CCRESULT = v_; \
+    } while (0)
+
+#define UOP_DO_STORE(M) \
+    do { \
+        unsigned a_ = UOP_ADDRESS_##M(); \
+        UOP_CHECK_##M(a_); \
+        DATA[a_] = REGS[CUR->_regcond]; \
+        UOP_DONE_##M(); \
+    } while (0)
+
+#define UOP_DO_ADD(M) \
+    do { \
+        Word v_; \
+        UOP_FETCH_##M(v_); \
+        REGS[CUR->_regcond] += v_; \
+        CCRESULT = REGS[CUR->_regcond]; \
+    } while (0)
+
+#define UOP_DO_SUB(M) \
+    do { \
+        Word v_; \
+        UOP_FETCH_##M(v_); \
+        REGS[CUR->_regcond] -= v_; \
+        CCRESULT = REGS[CUR->_regcond]; \
+    } while (0)
+
+#define UOP_DO_BRANCH(M) \
+    do { \
+        if (UOP_CONDITION()) \
+            JUMP(UOP_ADDRESS_##M()); \
+    } while (0)
+
+#define UOP_DO_CALL(M) \
+    do { \
+        UOP_CHECK_SP(); \
+        if (UOP_CONDITION()) { \
+            DATA[UOP_SP--] = IADDR + 1; \
+            JUMP(UOP_ADDRESS_##M()); \
+        } \
+    } while (0)
+
+#define UOP_DO_RET(M) \
+    do { \
+        ++UOP_SP; \
+        UOP_CHECK_SP(); \
+        JUMP(DATA[UOP_SP]); \
+    } while (0)
+
+#define UOP_DO_PUSH(M) \
+    do { \
+        Word v_; \
+        UOP_CHECK_SP(); \
+        UOP_FETCH_##M(v_); \
+        DATA[UOP_SP--] = v_; \
+    } while (0)
+
+#define UOP_DO_POP(M) \
+    do { \
+        unsigned a_ = UOP_ADDRESS_##M(); \
+        UOP_CHECK_##M(a_); \
+        ++UOP_SP; \
+        UOP_CHECK_SP(); \
+        DATA[a_] = DATA[UOP_SP]; \
+        UOP_DONE_##M(); \
+    } while (0)
+
+// Opérations indivisibles : le segment de données peut être partagé (voir smp.h)
+
+#define UOP_DO_XADD(M) \
+    do { \
+        unsigned a_ = UOP_ADDRESS_##M(); \
+        UOP_CHECK_##M(a_); \
+        REGS[CUR->_regcond] = fetch_add_word(&DATA[a_], REGS[CUR->_regcond]); \
+        UOP_DONE_##M(); \
+        CCRESULT = REGS[CUR->_regcond]; \
+    } while (0)
+
+#define UOP_DO_XCHG(M) \
+    do { \
+        unsigned a_ = UOP_ADDRESS_##M(); \
+        UOP_CHECK_##M(a_); \
+        REGS[CUR->_regcond] = exchange_word(&DATA[a_], REGS[CUR->_regcond]); \
+        UOP_DONE_##M(); \
+        CCRESULT = REGS[CUR->_regcond]; \
+    } while (0)
+
+#define UOP_DO_BARRIER(M) BARRIER_WAIT()
+
+#define UOP_DO_HALT(M) STOP_HALT()
+
+#endif